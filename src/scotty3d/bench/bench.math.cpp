@@ -0,0 +1,186 @@
+
+// Micro-benchmarks for the math library's SIMD kernels, compared against their scalar versions.
+//  Usage: Scotty3D-bench [element count] [repetitions]
+
+#include "lib/mathlib.h"
+#include "lib/batch.h"
+#include "util/timer.h"
+
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+//per-element nanoseconds of running 'op' (which processes 'count' elements) 'reps' times:
+template< typename F > float time_ns(size_t count, uint32_t reps, F const &op) {
+	op(); //warm up
+	Timer timer;
+	for (uint32_t r = 0; r < reps; r++) op();
+	return timer.ms() * 1.0e6f / float(count * reps);
+}
+
+void report(std::string const &name, float scalar_ns, float simd_ns, float max_error) {
+	log("%-20s scalar %7.2f ns  simd %7.2f ns  speedup %5.2fx  max error %g\n", name.c_str(), scalar_ns, simd_ns, scalar_ns / simd_ns, max_error);
+}
+
+float max_error(Vec3 a, Vec3 b) {
+	Vec3 d = a - b;
+	return std::max(std::abs(d.x), std::max(std::abs(d.y), std::abs(d.z)));
+}
+float max_error(Mat4 const &a, Mat4 const &b) {
+	float ret = 0.0f;
+	for (uint32_t i = 0; i < 16; i++) ret = std::max(ret, std::abs(a.data[i] - b.data[i]));
+	return ret;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+	size_t count = (argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1 << 16);
+	uint32_t reps = (argc > 2 ? uint32_t(std::strtoul(argv[2], nullptr, 10)) : 100);
+
+#ifdef SCOTTY3D_SSE
+	log("Math kernels with SSE, %zu elements x %u repetitions:\n", count, reps);
+#else
+	log("Math kernels without SIMD (scalar versions timed twice), %zu elements x %u repetitions:\n", count, reps);
+#endif
+
+	std::mt19937 mt(0x5c077d);
+	std::uniform_real_distribution< float > dist(-2.0f, 2.0f);
+	auto random_vec3 = [&]() { return Vec3{dist(mt), dist(mt), dist(mt)}; };
+
+	//well-conditioned transforms (rotation * scale, plus translation):
+	std::vector< Mat4 > mats(count), mats_out(count), mats_ref(count);
+	for (auto &m : mats) {
+		m = Mat4::translate(random_vec3()) * Mat4::euler(random_vec3() * 90.0f) * Mat4::scale(hmax(random_vec3().abs(), Vec3{0.5f}));
+	}
+	std::vector< Vec3 > points(count), points_out(count), points_ref(count);
+	for (auto &p : points) p = random_vec3();
+	std::vector< BBox > boxes(count), boxes_out(count), boxes_ref(count);
+	for (auto &b : boxes) {
+		b = BBox(random_vec3(), random_vec3());
+		b.min = hmin(b.min, b.max);
+	}
+	Mat4 T = Mat4::perspective(60.0f, 1.5f, 0.1f) * mats[0];
+
+	{ //Mat4 * Mat4:
+		float scalar = time_ns(count, reps, [&]() {
+			for (size_t i = 0; i + 1 < count; i++) mats_ref[i] = Mat4::multiply_scalar(mats[i], mats[i + 1]);
+		});
+		float simd = time_ns(count, reps, [&]() {
+			for (size_t i = 0; i + 1 < count; i++) mats_out[i] = mats[i] * mats[i + 1];
+		});
+		float err = 0.0f;
+		for (size_t i = 0; i + 1 < count; i++) err = std::max(err, max_error(mats_out[i], mats_ref[i]));
+		report("Mat4 * Mat4", scalar, simd, err);
+	}
+
+	{ //Mat4::inverse:
+		float scalar = time_ns(count, reps, [&]() {
+			for (size_t i = 0; i < count; i++) mats_ref[i] = Mat4::inverse_scalar(mats[i]);
+		});
+		float simd = time_ns(count, reps, [&]() {
+			for (size_t i = 0; i < count; i++) mats_out[i] = Mat4::inverse(mats[i]);
+		});
+		float err = 0.0f;
+		for (size_t i = 0; i < count; i++) err = std::max(err, max_error(mats_out[i], mats_ref[i]));
+		report("Mat4::inverse", scalar, simd, err);
+	}
+
+	{ //Mat4 * Vec3 (one at a time vs. batched):
+		float scalar = time_ns(count, reps, [&]() {
+			Batch::Scalar::transform_points(T, points.data(), points_ref.data(), count);
+		});
+		float simd = time_ns(count, reps, [&]() {
+			Batch::transform_points(T, points.data(), points_out.data(), count);
+		});
+		float err = 0.0f;
+		for (size_t i = 0; i < count; i++) err = std::max(err, max_error(points_out[i], points_ref[i]));
+		report("transform_points", scalar, simd, err);
+	}
+
+	{ //Mat4::rotate:
+		float scalar = time_ns(count, reps, [&]() {
+			Batch::Scalar::transform_vectors(T, points.data(), points_ref.data(), count);
+		});
+		float simd = time_ns(count, reps, [&]() {
+			Batch::transform_vectors(T, points.data(), points_out.data(), count);
+		});
+		float err = 0.0f;
+		for (size_t i = 0; i < count; i++) err = std::max(err, max_error(points_out[i], points_ref[i]));
+		report("transform_vectors", scalar, simd, err);
+	}
+
+	{ //normals:
+		Mat4 N = T.inverse().T();
+		float scalar = time_ns(count, reps, [&]() {
+			Batch::Scalar::transform_normals(N, points.data(), points_ref.data(), count);
+		});
+		float simd = time_ns(count, reps, [&]() {
+			Batch::transform_normals(N, points.data(), points_out.data(), count);
+		});
+		float err = 0.0f;
+		for (size_t i = 0; i < count; i++) err = std::max(err, max_error(points_out[i], points_ref[i]));
+		report("transform_normals", scalar, simd, err);
+	}
+
+	{ //positions inside vertex records (like the rasterizer's vertex attributes) to clip space:
+		constexpr size_t stride = 8;
+		std::vector< float > records(count * stride), clip(count * 4), clip_ref(count * 4);
+		for (size_t i = 0; i < count; i++) {
+			for (uint32_t c = 0; c < 3; c++) records[i * stride + c] = points[i][c];
+		}
+		float scalar = time_ns(count, reps, [&]() {
+			Batch::Scalar::transform< Batch::Op::Homogeneous >(T, records.data(), stride, clip_ref.data(), 4, count);
+		});
+		float simd = time_ns(count, reps, [&]() {
+			Batch::transform< Batch::Op::Homogeneous >(T, records.data(), stride, clip.data(), 4, count);
+		});
+		float err = 0.0f;
+		for (size_t i = 0; i < clip.size(); i++) err = std::max(err, std::abs(clip[i] - clip_ref[i]));
+		report("strided homogeneous", scalar, simd, err);
+	}
+
+	{ //BBox::transform:
+		float scalar = time_ns(count, reps, [&]() {
+			for (size_t i = 0; i < count; i++) boxes_ref[i] = BBox(boxes[i]).transform_scalar(mats[i]);
+		});
+		float simd = time_ns(count, reps, [&]() {
+			for (size_t i = 0; i < count; i++) boxes_out[i] = BBox(boxes[i]).transform(mats[i]);
+		});
+		float batched = time_ns(count, reps, [&]() {
+			Batch::transform_bboxes(T, boxes.data(), boxes_out.data(), count);
+		});
+		float err = 0.0f;
+		for (size_t i = 0; i < count; i++) {
+			boxes_ref[i] = BBox(boxes[i]).transform_scalar(T);
+			err = std::max(err, std::max(max_error(boxes_out[i].min, boxes_ref[i].min), max_error(boxes_out[i].max, boxes_ref[i].max)));
+		}
+		report("BBox::transform", scalar, simd, err);
+		report("transform_bboxes", scalar, batched, err);
+	}
+
+	{ //Spectrum accumulation (like resolving framebuffer samples), vs. packed r,g,b floats:
+		std::vector< float > packed(count * 3), packed_acc(count * 3);
+		std::vector< Spectrum > spectra(count), spectra_acc(count);
+		for (size_t i = 0; i < count; i++) {
+			spectra[i] = Spectrum(random_vec3());
+			for (uint32_t c = 0; c < 3; c++) packed[3 * i + c] = spectra[i][c];
+		}
+		float scalar = time_ns(count, reps, [&]() {
+			for (size_t i = 0; i < packed.size(); i++) packed_acc[i] += packed[i] * 0.25f;
+		});
+		float simd = time_ns(count, reps, [&]() {
+			Batch::add_scaled(spectra_acc.data(), spectra.data(), 0.25f, count);
+		});
+		float err = 0.0f;
+		for (size_t i = 0; i < count; i++) {
+			err = std::max(err, max_error(spectra_acc[i].to_vec(), Vec3{packed_acc[3 * i], packed_acc[3 * i + 1], packed_acc[3 * i + 2]}));
+		}
+		report("Spectrum add_scaled", scalar, simd, err);
+	}
+
+	return 0;
+}
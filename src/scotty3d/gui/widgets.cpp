@@ -1046,7 +1046,7 @@ void Widget_Texture::ui(const std::string& name, Manager& manager, Undo& undo,
 			if (Selectable("Nearest", selected == "Nearest")) {
 				try {
 					img.sampler = Textures::Image::Sampler::nearest;
-					img.update_mipmap();
+					img.make_valid();
 					update = old != *texture;
 				} catch (std::exception const& e) {
 					*texture = std::move(old);
@@ -1056,7 +1056,7 @@ void Widget_Texture::ui(const std::string& name, Manager& manager, Undo& undo,
 			if (Selectable("Bilinear", selected == "Bilinear")) {
 				try {
 					img.sampler = Textures::Image::Sampler::bilinear;
-					img.update_mipmap();
+					img.make_valid();
 					update = old != *texture;
 				} catch (std::exception const& e) {
 					*texture = std::move(old);
@@ -1066,7 +1066,7 @@ void Widget_Texture::ui(const std::string& name, Manager& manager, Undo& undo,
 			if (Selectable("Trilinear", selected == "Trilinear")) {
 				try {
 					img.sampler = Textures::Image::Sampler::trilinear;
-					img.update_mipmap();
+					img.make_valid();
 					update = old != *texture;
 				} catch (std::exception const& e) {
 					*texture = std::move(old);
@@ -1080,7 +1080,9 @@ void Widget_Texture::ui(const std::string& name, Manager& manager, Undo& undo,
 		float x = GetContentRegionAvail().x;
 		float y = 0.5f * x;
 		//now shrink to match aspect ratio:
-		float aspect = img.image.h / float(img.image.w);
+		auto held = img.pixels();
+		HDR_Image const &shown = (held ? held->image : img.image);
+		float aspect = shown.h / float(shown.w);
 		if (x * aspect < y) {
 			y = x * aspect;
 		} else {
@@ -1092,7 +1094,7 @@ void Widget_Texture::ui(const std::string& name, Manager& manager, Undo& undo,
 				old = std::move(*texture);
 				try {
 					img.image = HDR_Image::load(path.value());
-					img.update_mipmap();
+					img.make_valid();
 					update = old != *texture;
 				} catch (std::exception const& e) {
 					*texture = std::move(old);
@@ -1359,6 +1361,8 @@ void Widget_Render::begin_window(Scene& scene, Undo& undo, Manager& manager, Vie
 
 	if (method == Method::path_trace) {
 		Checkbox("Use BVH", &use_bvh);
+		Checkbox("Denoise", &use_denoiser);
+		Checkbox("Light guiding", &use_light_guiding);
 	}
 }
 
@@ -1419,6 +1423,8 @@ void Widget_Render::ui_animate(Scene& scene, Manager& manager, Undo& undo, View_
 
 			if(!render_cam.expired()) {
 				if (method == Method::path_trace) {
+					pathtracer.use_denoiser(use_denoiser);
+					pathtracer.use_light_guiding(use_light_guiding);
 					pathtracer.render(scene, render_cam.lock(), std::move(report_callback), &quit);
 				} else if(method == Method::software_raster) {
 					rasterizer.reset(new Rasterizer(scene, *render_cam.lock(), std::move(report_callback)));
@@ -1478,6 +1484,8 @@ bool Widget_Render::ui_render(Scene& scene, Manager& manager, Undo& undo, View_3
 				has_rendered = true;
 				rebuild_ray_log = true;
 				pathtracer.use_bvh(use_bvh);
+				pathtracer.use_denoiser(use_denoiser);
+				pathtracer.use_light_guiding(use_light_guiding);
 				pathtracer.render(scene, render_cam.lock(), [this, report_callback](PT::Pathtracer::Render_Report &&report){
 					report_callback(std::move(report));
 					rebuild_ray_log = true;
@@ -1683,6 +1691,8 @@ std::string Widget_Render::step_animation(Scene& scene, Animator& animator, Mana
 
 				render_progress = 0.0f;
 				pathtracer.use_bvh(use_bvh);
+				pathtracer.use_denoiser(use_denoiser);
+				pathtracer.use_light_guiding(use_light_guiding);
 				pathtracer.render(scene, render_cam.lock(), std::move(report_callback), &quit);
 				next_frame++;
 			}
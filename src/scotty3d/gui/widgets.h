@@ -242,6 +242,8 @@ private:
 
 	float exposure = 1.0f;
 	bool use_bvh = true;
+	bool use_denoiser = false;
+	bool use_light_guiding = false;
 	bool has_rendered = false, rebuild_ray_log = false;
 	bool render_window = false, render_window_focus = false;
 	bool quit = false;
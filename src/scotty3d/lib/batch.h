@@ -0,0 +1,284 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "mathlib.h"
+
+// Transforms and Spectrum arithmetic over whole arrays at once.
+//  Results match transforming each element on its own (Mat4 * Vec3, Mat4::rotate, BBox::transform);
+//  the SIMD versions transform four elements at a time. 'out' may be the same array as 'in'.
+
+namespace Batch {
+
+/// What happens to each (x,y,z):
+enum class Op {
+	Point,       // T * v (like Mat4 * Vec3, so includes perspective division)
+	Vector,      // T.rotate(v)
+	Normal,      // T.rotate(v).unit() (so T should be the normal matrix, e.g., M.inverse().T())
+	Homogeneous, // T * Vec4(v, 1.0f) (writes four floats: x,y,z,w)
+};
+
+/// Transform 'count' elements stored inside larger records (e.g., rasterizer vertex attributes):
+///  element i is read from in + i * in_stride and written to out + i * out_stride (strides are in floats)
+template< Op op >
+inline void transform(const Mat4& T, const float* in, size_t in_stride, float* out, size_t out_stride, size_t count);
+
+/// out[i] = T * in[i] (as points; includes perspective division)
+inline void transform_points(const Mat4& T, const Vec3* in, Vec3* out, size_t count);
+/// out[i] = T.rotate(in[i]) (as vectors; ignores translation)
+inline void transform_vectors(const Mat4& T, const Vec3* in, Vec3* out, size_t count);
+/// out[i] = N.rotate(in[i]).unit() (N is the normal matrix)
+inline void transform_normals(const Mat4& N, const Vec3* in, Vec3* out, size_t count);
+/// out[i] = in[i] transformed by T
+inline void transform_bboxes(const Mat4& T, const BBox* in, BBox* out, size_t count);
+
+/// The same, in place, over whole arrays:
+inline void transform_points(const Mat4& T, std::vector< Vec3 >& points) {
+	transform_points(T, points.data(), points.data(), points.size());
+}
+inline void transform_vectors(const Mat4& T, std::vector< Vec3 >& vectors) {
+	transform_vectors(T, vectors.data(), vectors.data(), vectors.size());
+}
+inline void transform_normals(const Mat4& N, std::vector< Vec3 >& normals) {
+	transform_normals(N, normals.data(), normals.data(), normals.size());
+}
+inline void transform_bboxes(const Mat4& T, std::vector< BBox >& boxes) {
+	transform_bboxes(T, boxes.data(), boxes.data(), boxes.size());
+}
+
+/// Clip-space outcodes of homogeneous points (x,y,z,w) stored inside larger records (stride in floats):
+///  bit 2a of out[i] is set when coordinate a is below -w and bit 2a+1 when it is above w (beyond 'slack'), so a
+///  primitive whose vertices' codes are all zero needs no clipping, and one whose codes share a bit is entirely outside
+inline void clip_outcodes(const float* in, size_t in_stride, uint8_t* out, size_t count, float slack);
+
+/// Spectrum arrays (each Spectrum op is already one SIMD instruction, so these are plain loops):
+/// acc[i] += in[i]
+inline void add(Spectrum* acc, const Spectrum* in, size_t count) {
+	for (size_t i = 0; i < count; i++) acc[i] += in[i];
+}
+/// acc[i] += in[i] * w
+inline void add_scaled(Spectrum* acc, const Spectrum* in, float w, size_t count) {
+	for (size_t i = 0; i < count; i++) acc[i] += in[i] * w;
+}
+/// out[i] = in[i] * s
+inline void scale(Spectrum* out, const Spectrum* in, float s, size_t count) {
+	for (size_t i = 0; i < count; i++) out[i] = in[i] * s;
+}
+
+/// Scalar versions of the transforms above; used when SIMD isn't available (and to check and benchmark the SIMD versions)
+namespace Scalar {
+
+template< Op op >
+inline void transform(const Mat4& T, const float* in, size_t in_stride, float* out, size_t out_stride, size_t count) {
+	for (size_t i = 0; i < count; i++, in += in_stride, out += out_stride) {
+		Vec3 v{in[0], in[1], in[2]};
+		if constexpr (op == Op::Homogeneous) {
+			Vec4 h = T * Vec4(v, 1.0f);
+			for (uint32_t c = 0; c < 4; c++) out[c] = h[c];
+		} else {
+			if constexpr (op == Op::Point) v = T * v;
+			else if constexpr (op == Op::Vector) v = T.rotate(v);
+			else v = T.rotate(v).unit();
+			for (uint32_t c = 0; c < 3; c++) out[c] = v[c];
+		}
+	}
+}
+
+inline void transform_points(const Mat4& T, const Vec3* in, Vec3* out, size_t count) {
+	for (size_t i = 0; i < count; i++) out[i] = T * in[i];
+}
+inline void transform_vectors(const Mat4& T, const Vec3* in, Vec3* out, size_t count) {
+	for (size_t i = 0; i < count; i++) out[i] = T.rotate(in[i]);
+}
+inline void transform_normals(const Mat4& N, const Vec3* in, Vec3* out, size_t count) {
+	for (size_t i = 0; i < count; i++) out[i] = N.rotate(in[i]).unit();
+}
+inline void transform_bboxes(const Mat4& T, const BBox* in, BBox* out, size_t count) {
+	for (size_t i = 0; i < count; i++) out[i] = BBox(in[i]).transform_scalar(T);
+}
+
+inline void clip_outcodes(const float* in, size_t in_stride, uint8_t* out, size_t count, float slack) {
+	for (size_t i = 0; i < count; i++, in += in_stride) {
+		float w = in[3];
+		uint8_t code = 0;
+		for (uint32_t a = 0; a < 3; a++) {
+			if (!(in[a] + w >= -slack)) code |= uint8_t(1u << (2 * a));
+			if (!(w - in[a] >= -slack)) code |= uint8_t(2u << (2 * a));
+		}
+		out[i] = code;
+	}
+}
+
+} // namespace Scalar
+
+#ifdef SCOTTY3D_SSE
+
+//T applied to four elements given (and returned) as [x0..x3] [y0..y3] [z0..z3]:
+template< Op op >
+inline void transform_4(const Mat4& T, __m128 x, __m128 y, __m128 z, __m128& tx, __m128& ty, __m128& tz) {
+	//row i of T, dotted with (x, y, z, [1]):
+	auto row = [&](uint32_t i) {
+		__m128 r = _mm_mul_ps(SIMD::splat(T[0][i]), x);
+		r = _mm_add_ps(r, _mm_mul_ps(SIMD::splat(T[1][i]), y));
+		r = _mm_add_ps(r, _mm_mul_ps(SIMD::splat(T[2][i]), z));
+		if constexpr (op == Op::Point) r = _mm_add_ps(r, SIMD::splat(T[3][i]));
+		return r;
+	};
+	tx = row(0);
+	ty = row(1);
+	tz = row(2);
+	if constexpr (op == Op::Point) {
+		__m128 tw = row(3);
+		tx = _mm_div_ps(tx, tw);
+		ty = _mm_div_ps(ty, tw);
+		tz = _mm_div_ps(tz, tw);
+	} else if constexpr (op == Op::Normal) {
+		__m128 n = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, tx), _mm_mul_ps(ty, ty)), _mm_mul_ps(tz, tz)));
+		tx = _mm_div_ps(tx, n);
+		ty = _mm_div_ps(ty, n);
+		tz = _mm_div_ps(tz, n);
+	}
+}
+
+//T applied to four Vec3s stored one after another:
+template< Op op >
+inline void transform_4(const Mat4& T, const float* in, float* out) {
+	__m128 x, y, z, tx, ty, tz;
+	SIMD::unpack_xyz(_mm_loadu_ps(in), _mm_loadu_ps(in + 4), _mm_loadu_ps(in + 8), x, y, z);
+	transform_4< op >(T, x, y, z, tx, ty, tz);
+	__m128 a, b, c;
+	SIMD::pack_xyz(tx, ty, tz, a, b, c);
+	_mm_storeu_ps(out, a);
+	_mm_storeu_ps(out + 4, b);
+	_mm_storeu_ps(out + 8, c);
+}
+
+template< Op op >
+inline void transform(const Mat4& T, const float* in, size_t in_stride, float* out, size_t out_stride, size_t count) {
+	if constexpr (op == Op::Homogeneous) {
+		//outputs are whole Vec4s, so transform one element at a time, all four components at once:
+		__m128 c0 = _mm_loadu_ps(T.cols[0].data), c1 = _mm_loadu_ps(T.cols[1].data);
+		__m128 c2 = _mm_loadu_ps(T.cols[2].data), c3 = _mm_loadu_ps(T.cols[3].data);
+		for (size_t i = 0; i < count; i++, in += in_stride, out += out_stride) {
+			__m128 r = _mm_mul_ps(c0, SIMD::splat(in[0]));
+			r = _mm_add_ps(r, _mm_mul_ps(c1, SIMD::splat(in[1])));
+			r = _mm_add_ps(r, _mm_mul_ps(c2, SIMD::splat(in[2])));
+			_mm_storeu_ps(out, _mm_add_ps(r, c3));
+		}
+		return;
+	}
+
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		const float* p[4] = {in, in + in_stride, in + 2 * in_stride, in + 3 * in_stride};
+		__m128 x = _mm_setr_ps(p[0][0], p[1][0], p[2][0], p[3][0]);
+		__m128 y = _mm_setr_ps(p[0][1], p[1][1], p[2][1], p[3][1]);
+		__m128 z = _mm_setr_ps(p[0][2], p[1][2], p[2][2], p[3][2]);
+		__m128 tx, ty, tz;
+		transform_4< op >(T, x, y, z, tx, ty, tz);
+		float o[3][4];
+		_mm_storeu_ps(o[0], tx);
+		_mm_storeu_ps(o[1], ty);
+		_mm_storeu_ps(o[2], tz);
+		for (uint32_t e = 0; e < 4; e++) {
+			for (uint32_t c = 0; c < 3; c++) out[e * out_stride + c] = o[c][e];
+		}
+		in += 4 * in_stride;
+		out += 4 * out_stride;
+	}
+	Scalar::transform< op >(T, in, in_stride, out, out_stride, count - i);
+}
+
+inline void transform_points(const Mat4& T, const Vec3* in, Vec3* out, size_t count) {
+	static_assert(sizeof(Vec3) == 3 * sizeof(float), "Vec3s are packed floats");
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) transform_4< Op::Point >(T, in[i].data, out[i].data);
+	Scalar::transform_points(T, in + i, out + i, count - i);
+}
+
+inline void transform_vectors(const Mat4& T, const Vec3* in, Vec3* out, size_t count) {
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) transform_4< Op::Vector >(T, in[i].data, out[i].data);
+	Scalar::transform_vectors(T, in + i, out + i, count - i);
+}
+
+inline void transform_normals(const Mat4& N, const Vec3* in, Vec3* out, size_t count) {
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) transform_4< Op::Normal >(N, in[i].data, out[i].data);
+	Scalar::transform_normals(N, in + i, out + i, count - i);
+}
+
+inline void transform_bboxes(const Mat4& T, const BBox* in, BBox* out, size_t count) {
+	__m128 cols[4];
+	for (uint32_t j = 0; j < 4; j++) cols[j] = _mm_loadu_ps(T.cols[j].data);
+
+	for (size_t i = 0; i < count; i++) {
+		__m128 lo = cols[3], hi = cols[3];
+		for (uint32_t j = 0; j < 3; j++) {
+			__m128 a = _mm_mul_ps(cols[j], SIMD::splat(in[i].min[j]));
+			__m128 b = _mm_mul_ps(cols[j], SIMD::splat(in[i].max[j]));
+			lo = _mm_add_ps(lo, _mm_min_ps(a, b));
+			hi = _mm_add_ps(hi, _mm_max_ps(b, a));
+		}
+		float l[4], h[4];
+		_mm_storeu_ps(l, lo);
+		_mm_storeu_ps(h, hi);
+		out[i] = BBox(Vec3{l[0], l[1], l[2]}, Vec3{h[0], h[1], h[2]});
+	}
+}
+
+inline void clip_outcodes(const float* in, size_t in_stride, uint8_t* out, size_t count, float slack) {
+	__m128 neg_slack = SIMD::splat(-slack);
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128 x = _mm_loadu_ps(in), y = _mm_loadu_ps(in + in_stride);
+		__m128 z = _mm_loadu_ps(in + 2 * in_stride), w = _mm_loadu_ps(in + 3 * in_stride);
+		_MM_TRANSPOSE4_PS(x, y, z, w);
+		//(cmpnge, so NaNs count as outside)
+		__m128i code = _mm_setzero_si128();
+		auto add_bits = [&](__m128 a, int bit) {
+			__m128i lo = _mm_castps_si128(_mm_cmpnge_ps(_mm_add_ps(a, w), neg_slack));
+			__m128i hi = _mm_castps_si128(_mm_cmpnge_ps(_mm_sub_ps(w, a), neg_slack));
+			code = _mm_or_si128(code, _mm_and_si128(lo, _mm_set1_epi32(1 << bit)));
+			code = _mm_or_si128(code, _mm_and_si128(hi, _mm_set1_epi32(2 << bit)));
+		};
+		add_bits(x, 0);
+		add_bits(y, 2);
+		add_bits(z, 4);
+		//four 32-bit codes to four bytes:
+		__m128i bytes = _mm_packus_epi16(_mm_packs_epi32(code, code), code);
+		int packed = _mm_cvtsi128_si32(bytes);
+		std::memcpy(out + i, &packed, 4);
+		in += 4 * in_stride;
+	}
+	Scalar::clip_outcodes(in, in_stride, out + i, count - i, slack);
+}
+
+#else
+
+template< Op op >
+inline void transform(const Mat4& T, const float* in, size_t in_stride, float* out, size_t out_stride, size_t count) {
+	Scalar::transform< op >(T, in, in_stride, out, out_stride, count);
+}
+inline void transform_points(const Mat4& T, const Vec3* in, Vec3* out, size_t count) {
+	Scalar::transform_points(T, in, out, count);
+}
+inline void transform_vectors(const Mat4& T, const Vec3* in, Vec3* out, size_t count) {
+	Scalar::transform_vectors(T, in, out, count);
+}
+inline void transform_normals(const Mat4& N, const Vec3* in, Vec3* out, size_t count) {
+	Scalar::transform_normals(N, in, out, count);
+}
+inline void transform_bboxes(const Mat4& T, const BBox* in, BBox* out, size_t count) {
+	Scalar::transform_bboxes(T, in, out, count);
+}
+inline void clip_outcodes(const float* in, size_t in_stride, uint8_t* out, size_t count, float slack) {
+	Scalar::clip_outcodes(in, in_stride, out, count, slack);
+}
+
+#endif
+
+} // namespace Batch
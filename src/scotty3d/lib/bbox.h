@@ -60,6 +60,27 @@ struct BBox {
 
 	/// Transform box by a matrix
 	BBox& transform(const Mat4& trans) {
+#ifdef SCOTTY3D_SSE
+		__m128 lo = _mm_loadu_ps(trans.cols[3].data), hi = lo;
+		for (uint32_t j = 0; j < 3; j++) {
+			__m128 col = _mm_loadu_ps(trans.cols[j].data);
+			__m128 a = _mm_mul_ps(col, SIMD::splat(min[j]));
+			__m128 b = _mm_mul_ps(col, SIMD::splat(max[j]));
+			lo = _mm_add_ps(lo, _mm_min_ps(a, b));
+			hi = _mm_add_ps(hi, _mm_max_ps(b, a));
+		}
+		float out[4];
+		_mm_storeu_ps(out, lo);
+		min = Vec3{out[0], out[1], out[2]};
+		_mm_storeu_ps(out, hi);
+		max = Vec3{out[0], out[1], out[2]};
+		return *this;
+#else
+		return transform_scalar(trans);
+#endif
+	}
+	/// Scalar version of transform; used when SIMD isn't available (and to check and benchmark the SIMD version)
+	BBox& transform_scalar(const Mat4& trans) {
 		Vec3 amin = min, amax = max;
 		min = max = trans[3].xyz();
 		for (uint32_t i = 0; i < 3; i++) {
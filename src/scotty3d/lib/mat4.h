@@ -7,6 +7,7 @@
 #include <ostream>
 
 #include "log.h"
+#include "simd.h"
 #include "vec4.h"
 
 struct Mat4 {
@@ -22,6 +23,10 @@ struct Mat4 {
 	static Mat4 transpose(const Mat4& m);
 	/// Return inverse matrix (will be NaN if m is not invertible)
 	static Mat4 inverse(const Mat4& m);
+	/// Scalar versions of inverse and operator*(Mat4); used when SIMD isn't available
+	/// (and to check and benchmark the SIMD versions)
+	static Mat4 inverse_scalar(const Mat4& m);
+	static Mat4 multiply_scalar(const Mat4& a, const Mat4& b);
 	/// Return transformation matrix for given translation vector
 	static Mat4 translate(Vec3 t);
 	/// Return transformation matrix for given angle (degrees) and axis
@@ -162,22 +167,32 @@ struct Mat4 {
 		return *this;
 	}
 	Mat4 operator*(const Mat4& m) const {
+#ifdef SCOTTY3D_SSE
 		Mat4 ret;
 		for (uint32_t i = 0; i < 4; i++) {
-			for (uint32_t j = 0; j < 4; j++) {
-				ret[i][j] = 0.0f;
-				for (uint32_t k = 0; k < 4; k++) {
-					ret[i][j] += m[i][k] * cols[k][j];
-				}
-			}
+			_mm_storeu_ps(ret.cols[i].data, column_times(_mm_loadu_ps(m.cols[i].data)));
 		}
 		return ret;
+#else
+		return multiply_scalar(*this, m);
+#endif
 	}
 
 	Vec4 operator*(Vec4 v) const {
+		//(single vectors are left to the compiler; see lib/batch.h for transforming many at once)
 		return v[0] * cols[0] + v[1] * cols[1] + v[2] * cols[2] + v[3] * cols[3];
 	}
 
+#ifdef SCOTTY3D_SSE
+	/// (this matrix) * v, with v and the result in SSE registers
+	__m128 column_times(__m128 v) const {
+		__m128 r = _mm_mul_ps(_mm_loadu_ps(cols[0].data), SIMD::broadcast<0>(v));
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(cols[1].data), SIMD::broadcast<1>(v)));
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(cols[2].data), SIMD::broadcast<2>(v)));
+		return _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(cols[3].data), SIMD::broadcast<3>(v)));
+	}
+#endif
+
 	/// Expands v to Vec4(v, 1.0), multiplies, and projects back to 3D
 	Vec3 operator*(Vec3 v) const {
 		return operator*(Vec4(v, 1.0f)).project();
@@ -338,7 +353,68 @@ inline Mat4 Mat4::transpose(const Mat4& m) {
 	return r;
 }
 
+inline Mat4 Mat4::multiply_scalar(const Mat4& a, const Mat4& b) {
+	Mat4 ret;
+	for (uint32_t i = 0; i < 4; i++) {
+		for (uint32_t j = 0; j < 4; j++) {
+			ret[i][j] = 0.0f;
+			for (uint32_t k = 0; k < 4; k++) {
+				ret[i][j] += b[i][k] * a[k][j];
+			}
+		}
+	}
+	return ret;
+}
+
 inline Mat4 Mat4::inverse(const Mat4& m) {
+#ifdef SCOTTY3D_SSE
+	//blockwise inverse via the 2x2 blocks | A B |
+	//                                     | C D |
+	// (stored column-major, so each block is a transposed 2x2 matrix -- which works out, since
+	//  the inverse of a transpose is the transpose of the inverse)
+	__m128 c0 = _mm_loadu_ps(m.cols[0].data), c1 = _mm_loadu_ps(m.cols[1].data);
+	__m128 c2 = _mm_loadu_ps(m.cols[2].data), c3 = _mm_loadu_ps(m.cols[3].data);
+	__m128 A = _mm_movelh_ps(c0, c1), B = _mm_movehl_ps(c1, c0);
+	__m128 C = _mm_movelh_ps(c2, c3), D = _mm_movehl_ps(c3, c2);
+
+	//determinants of A, B, C, D:
+	__m128 dets = _mm_sub_ps(
+		_mm_mul_ps(_mm_shuffle_ps(c0, c2, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(c1, c3, _MM_SHUFFLE(3, 1, 3, 1))),
+		_mm_mul_ps(_mm_shuffle_ps(c0, c2, _MM_SHUFFLE(3, 1, 3, 1)), _mm_shuffle_ps(c1, c3, _MM_SHUFFLE(2, 0, 2, 0)))
+	);
+	__m128 det_A = SIMD::broadcast<0>(dets), det_B = SIMD::broadcast<1>(dets);
+	__m128 det_C = SIMD::broadcast<2>(dets), det_D = SIMD::broadcast<3>(dets);
+
+	__m128 D_C = SIMD::adj_mul_2x2(D, C);
+	__m128 A_B = SIMD::adj_mul_2x2(A, B);
+	//adjugates of the blocks of the inverse (times det(m)):
+	__m128 X = _mm_sub_ps(_mm_mul_ps(det_D, A), SIMD::mul_2x2(B, D_C));
+	__m128 W = _mm_sub_ps(_mm_mul_ps(det_A, D), SIMD::mul_2x2(C, A_B));
+	__m128 Y = _mm_sub_ps(_mm_mul_ps(det_B, C), SIMD::mul_adj_2x2(D, A_B));
+	__m128 Z = _mm_sub_ps(_mm_mul_ps(det_C, B), SIMD::mul_adj_2x2(A, D_C));
+
+	//det(m) = det(A) det(D) + det(B) det(C) - trace((A#B)(D#C)):
+	__m128 det = _mm_add_ps(_mm_mul_ps(det_A, det_D), _mm_mul_ps(det_B, det_C));
+	det = _mm_sub_ps(det, SIMD::sum(_mm_mul_ps(A_B, _mm_shuffle_ps(D_C, D_C, _MM_SHUFFLE(3, 1, 2, 0)))));
+
+	__m128 scale = _mm_div_ps(_mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f), det);
+	X = _mm_mul_ps(X, scale);
+	Y = _mm_mul_ps(Y, scale);
+	Z = _mm_mul_ps(Z, scale);
+	W = _mm_mul_ps(W, scale);
+
+	Mat4 r;
+	_mm_storeu_ps(r.cols[0].data, _mm_shuffle_ps(X, Y, _MM_SHUFFLE(1, 3, 1, 3)));
+	_mm_storeu_ps(r.cols[1].data, _mm_shuffle_ps(X, Y, _MM_SHUFFLE(0, 2, 0, 2)));
+	_mm_storeu_ps(r.cols[2].data, _mm_shuffle_ps(Z, W, _MM_SHUFFLE(1, 3, 1, 3)));
+	_mm_storeu_ps(r.cols[3].data, _mm_shuffle_ps(Z, W, _MM_SHUFFLE(0, 2, 0, 2)));
+	return r;
+#else
+	return inverse_scalar(m);
+#endif
+}
+
+inline Mat4 Mat4::inverse_scalar(const Mat4& m) {
 	Mat4 r;
 	r[0][0] = m[1][2] * m[2][3] * m[3][1] - m[1][3] * m[2][2] * m[3][1] +
 	          m[1][3] * m[2][1] * m[3][2] - m[1][1] * m[2][3] * m[3][2] -
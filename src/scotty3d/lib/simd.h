@@ -0,0 +1,72 @@
+#pragma once
+
+// SIMD support for the math library.
+//  SSE2 is part of every x86-64 target, so it is used whenever the compiler targets one;
+//  everywhere else (e.g., ARM), the scalar code paths are used instead.
+//  Define SCOTTY3D_NO_SIMD to force the scalar paths (e.g., to compare results).
+
+#if !defined(SCOTTY3D_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define SCOTTY3D_SSE 1
+#include <emmintrin.h>
+#endif
+
+#ifdef SCOTTY3D_SSE
+
+namespace SIMD {
+
+//four floats, each equal to f:
+inline __m128 splat(float f) {
+	return _mm_set1_ps(f);
+}
+
+//lane i of v in all four lanes:
+template< int i > inline __m128 broadcast(__m128 v) {
+	return _mm_shuffle_ps(v, v, _MM_SHUFFLE(i, i, i, i));
+}
+
+//transpose four points stored as [x0 y0 z0 x1] [y1 z1 x2 y2] [z2 x3 y3 z3] into [x0..x3] [y0..y3] [z0..z3]:
+inline void unpack_xyz(__m128 a, __m128 b, __m128 c, __m128 &x, __m128 &y, __m128 &z) {
+	__m128 t = _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 0, 3, 2)); //x2 y2 z2 x3
+	__m128 u = _mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 0, 2, 1)); //y0 z0 y1 z1
+	__m128 v = _mm_shuffle_ps(t, c, _MM_SHUFFLE(3, 2, 2, 1)); //y2 z2 y3 z3
+	x = _mm_shuffle_ps(a, t, _MM_SHUFFLE(3, 0, 3, 0));
+	y = _mm_shuffle_ps(u, v, _MM_SHUFFLE(2, 0, 2, 0));
+	z = _mm_shuffle_ps(u, v, _MM_SHUFFLE(3, 1, 3, 1));
+}
+
+//inverse of unpack_xyz:
+inline void pack_xyz(__m128 x, __m128 y, __m128 z, __m128 &a, __m128 &b, __m128 &c) {
+	__m128 xy01 = _mm_unpacklo_ps(x, y); //x0 y0 x1 y1
+	__m128 xy23 = _mm_unpackhi_ps(x, y); //x2 y2 x3 y3
+	a = _mm_shuffle_ps(xy01, _mm_shuffle_ps(z, xy01, _MM_SHUFFLE(2, 2, 0, 0)), _MM_SHUFFLE(2, 0, 1, 0));
+	b = _mm_shuffle_ps(_mm_shuffle_ps(xy01, z, _MM_SHUFFLE(1, 1, 3, 3)), xy23, _MM_SHUFFLE(1, 0, 2, 0));
+	c = _mm_shuffle_ps(_mm_shuffle_ps(z, xy23, _MM_SHUFFLE(2, 2, 2, 2)), _mm_shuffle_ps(xy23, z, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+}
+
+//2x2 matrices stored as [m00 m01 m10 m11]:
+
+//a * b:
+inline __m128 mul_2x2(__m128 a, __m128 b) {
+	return _mm_add_ps(_mm_mul_ps(a, _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 3, 0))),
+	                  _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 2, 1, 2))));
+}
+//adjugate(a) * b:
+inline __m128 adj_mul_2x2(__m128 a, __m128 b) {
+	return _mm_sub_ps(_mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(0, 0, 3, 3)), b),
+	                  _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 2, 1, 1)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 0, 3, 2))));
+}
+//a * adjugate(b):
+inline __m128 mul_adj_2x2(__m128 a, __m128 b) {
+	return _mm_sub_ps(_mm_mul_ps(a, _mm_shuffle_ps(b, b, _MM_SHUFFLE(0, 3, 0, 3))),
+	                  _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 2, 1, 2))));
+}
+
+//sum of all four lanes, in all four lanes:
+inline __m128 sum(__m128 v) {
+	v = _mm_add_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_add_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+}
+
+} // namespace SIMD
+
+#endif
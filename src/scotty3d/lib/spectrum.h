@@ -1,10 +1,13 @@
 #pragma once
 
+#include "simd.h"
 #include "vec3.h"
 #include <cmath>
 #include <ostream>
 
-struct Spectrum {
+// Spectrum is stored as four floats (r, g, b, and an unused pad) so that each operation is one SIMD instruction.
+//  The pad lane is never read: comparisons, luma, and file formats only look at r, g, and b.
+struct alignas(16) Spectrum {
 
 	Spectrum() {
 		r = 0.0f;
@@ -24,6 +27,11 @@ struct Spectrum {
 		g = c.y;
 		b = c.z;
 	}
+#ifdef SCOTTY3D_SSE
+	explicit Spectrum(__m128 _v) {
+		v = _v;
+	}
+#endif
 
 	Spectrum(const Spectrum&) = default;
 	Spectrum& operator=(const Spectrum&) = default;
@@ -38,6 +46,20 @@ struct Spectrum {
 		return data[idx];
 	}
 
+#ifdef SCOTTY3D_SSE
+	Spectrum operator+=(Spectrum o) {
+		v = _mm_add_ps(v, o.v);
+		return *this;
+	}
+	Spectrum operator*=(Spectrum o) {
+		v = _mm_mul_ps(v, o.v);
+		return *this;
+	}
+	Spectrum operator*=(float s) {
+		v = _mm_mul_ps(v, SIMD::splat(s));
+		return *this;
+	}
+#else
 	Spectrum operator+=(Spectrum v) {
 		r += v.r;
 		g += v.g;
@@ -56,6 +78,7 @@ struct Spectrum {
 		b *= s;
 		return *this;
 	}
+#endif
 
 	static Spectrum direction(Vec3 v) {
 		v.normalize();
@@ -103,6 +126,27 @@ struct Spectrum {
 		return ret;
 	}
 
+#ifdef SCOTTY3D_SSE
+	Spectrum operator+(Spectrum o) const {
+		return Spectrum(_mm_add_ps(v, o.v));
+	}
+	Spectrum operator-(Spectrum o) const {
+		return Spectrum(_mm_sub_ps(v, o.v));
+	}
+	Spectrum operator*(Spectrum o) const {
+		return Spectrum(_mm_mul_ps(v, o.v));
+	}
+
+	Spectrum operator+(float s) const {
+		return Spectrum(_mm_add_ps(v, SIMD::splat(s)));
+	}
+	Spectrum operator*(float s) const {
+		return Spectrum(_mm_mul_ps(v, SIMD::splat(s)));
+	}
+	Spectrum operator/(float s) const {
+		return Spectrum(_mm_div_ps(v, SIMD::splat(s)));
+	}
+#else
 	Spectrum operator+(Spectrum v) const {
 		return Spectrum(r + v.r, g + v.g, b + v.b);
 	}
@@ -122,6 +166,7 @@ struct Spectrum {
 	Spectrum operator/(float s) const {
 		return Spectrum(r / s, g / s, b / s);
 	}
+#endif
 
 	bool operator==(Spectrum v) const {
 		return r == v.r && g == v.g && b == v.b;
@@ -148,15 +193,20 @@ struct Spectrum {
 			float g;
 			float b;
 		};
-		float data[3] = {};
+		float data[4] = {}; //data[3] is the pad
+#ifdef SCOTTY3D_SSE
+		__m128 v;
+#endif
 	};
 };
 
+static_assert(sizeof(Spectrum) == 4 * sizeof(float), "Spectrum is r, g, b, pad");
+
 inline Spectrum operator+(float s, Spectrum v) {
-	return Spectrum(v.r + s, v.g + s, v.b + s);
+	return v + s;
 }
 inline Spectrum operator*(float s, Spectrum v) {
-	return Spectrum(v.r * s, v.g * s, v.b * s);
+	return v * s;
 }
 
 inline std::ostream& operator<<(std::ostream& out, Spectrum v) {
@@ -14,6 +14,24 @@
 #include "test.h"
 
 #include <filesystem>
+#include <fstream>
+#include <optional>
+#include <random>
+#include <sstream>
+
+//tonemap and write an image as a png:
+static bool write_png(std::filesystem::path const &filename, HDR_Image const &image, float exposure) {
+	std::vector<uint8_t> data;
+	image.tonemap_to(data, exposure);
+
+	stbi_flip_vertically_on_write(true);
+	if (!stbi_write_png(filename.generic_string().c_str(), image.w, image.h, 4, data.data(), image.w * 4)) {
+		warn("ERROR: Failed to write output to '%s'", filename.generic_string().c_str());
+		return false;
+	}
+	std::cout << "Wrote result to '" << filename.generic_string() << "'." << std::endl;
+	return true;
+}
 
 int main(int argc, char** argv) {
 
@@ -37,6 +55,11 @@ int main(int argc, char** argv) {
 
 	float exp = 1.0f;
 	bool no_bvh = false;
+	float bvh_optimize = 0.0f;
+	bool denoise = false;
+	bool light_guiding = false;
+	std::string texture_format;
+	uint32_t texture_cache_mb = -1U; //override texture cache budget (if not -1U)
 
 	uint32_t film_width = -1U; //override film width (if not -1U)
 	uint32_t film_height = -1U; //override film height (if not -1U)
@@ -46,6 +69,9 @@ int main(int argc, char** argv) {
 
 	std::string write_file = ""; //write file (useful for conversions)
 
+	std::string shard = ""; //render only one shard ("i/N") of the image and write the raw accumulator
+	std::vector<std::string> merge_shards; //merge shard files into one image and exit
+
 
 	CLI::App args{"Scotty3D - Student Version"};
 
@@ -57,11 +83,16 @@ int main(int argc, char** argv) {
 	args.add_flag("--trace", pathtrace, "Path trace scene without opening the GUI");
 	args.add_flag("--rasterize", rasterize, "Rasterize scene without opening the GUI");
 	args.add_option("-c,--camera", camera_name, "Camera instance to render (if headless)");
-	args.add_option("-o,--output", output_file, "Image file to write (if headless) [for animation, can also be a directory]");
+	args.add_option("-o,--output", output_file, "Image file to write (if headless); .exr and .pfm are written as linear floats [for animation, can also be a directory]");
 	args.add_flag("--animate", animate, "Output animation frames [min_frame,max_frame] (if headless)");
 	args.add_option("--min-frame", min_frame, "First animation frame");
 	args.add_option("--max-frame", max_frame, "Last animation frame (-1 is last keyframe)");
 	args.add_flag("--no_bvh", no_bvh, "Don't use BVH (if headless)");
+	args.add_option("--bvh-optimize", bvh_optimize, "Spend up to this many seconds optimizing BVHs after building them (if headless)");
+	args.add_option("--texture-format", texture_format, "Store image textures tiled as 'float', 'half', or 'rgb9e5' while path tracing (if headless)");
+	args.add_option("--texture-cache", texture_cache_mb, "Megabytes of decoded image textures to keep in memory when not in use");
+	args.add_flag("--light-guiding", light_guiding, "Learn which area lights matter where in a short training pass, and sample those more often (if headless)");
+	args.add_flag("--denoise", denoise, "Denoise the path traced image using first-hit albedo and normals (if headless; not with --shard)");
 	args.add_option("--exposure", exp, "Output exposure (if headless)");
 	args.add_option("--seed", RNG::fixed_seed, "Use fixed seed for RNG when rendering; (0 disables).");
 	args.add_option("--film-width",          film_width, "Override camera film width (pixels)");
@@ -70,6 +101,8 @@ int main(int argc, char** argv) {
 	args.add_option("--film-max-ray-depth",  film_max_ray_depth, "Override film max ray depth (for pathtracer)");
 	args.add_option("--film-sample-pattern", film_sample_pattern, "Override film sample pattern (for rasterizer)");
 	args.add_option("--force-dpi", Platform::force_dpi, "Force DPI to a given number (will scale UI).");
+	args.add_option("--shard", shard, "Trace only shard i of N (given as 'i/N') and write the raw accumulator to the output file (requires --trace and --seed)");
+	args.add_option("--merge-shards", merge_shards, "Merge shard files written by --shard into the output image and exit");
 
 	CLI11_PARSE(args, argc, argv);
 
@@ -82,6 +115,76 @@ int main(int argc, char** argv) {
 		}
 	}
 
+	//merge shards (from renders with --shard) and exit:
+	if (!merge_shards.empty()) {
+		PT::Pathtracer::Shard merged;
+		for (size_t i = 0; i < merge_shards.size(); ++i) {
+			try {
+				std::ifstream in(merge_shards[i], std::ios::binary);
+				PT::Pathtracer::Shard loaded = PT::Pathtracer::Shard::load(in);
+				if (i == 0) merged = std::move(loaded);
+				else merged.merge(loaded);
+			} catch (std::exception const &e) {
+				warn("ERROR: Failed to merge shard '%s': %s", merge_shards[i].c_str(), e.what());
+				return 1;
+			}
+		}
+		if (!merged.complete()) {
+			warn("WARNING: merged %u of %u shards; image will be missing samples.", uint32_t(merged.indices.size()), merged.count);
+		}
+		if (output_file == "") {
+			std::cout << "No output was requested, not writing any file." << std::endl;
+			return 0;
+		}
+		if (HDR_Image_Writer::supports(output_file)) {
+			try {
+				merged.to_image().save(output_file);
+			} catch (std::exception const &e) {
+				warn("ERROR: Failed to write output to '%s': %s", output_file.c_str(), e.what());
+				return 1;
+			}
+			std::cout << "Wrote result to '" << output_file << "'." << std::endl;
+			return 0;
+		}
+		return write_png(output_file, merged.to_image(), exp) ? 0 : 1;
+	}
+
+	if (texture_cache_mb != -1U) {
+		Texture_Cache::get().set_budget(size_t(texture_cache_mb) << 20);
+	}
+
+	std::optional<Tiled_Image::Format> tiled_format;
+	if (texture_format != "") {
+		try {
+			tiled_format = Tiled_Image::parse_format(texture_format);
+		} catch (std::exception const &e) {
+			warn("ERROR: %s", e.what());
+			return 1;
+		}
+	}
+
+	uint32_t shard_index = 0, shard_count = 1;
+	if (shard != "") {
+		char slash = '\0';
+		std::istringstream str(shard);
+		if (!(str >> shard_index >> slash >> shard_count) || slash != '/' || shard_count == 0 || shard_index >= shard_count) {
+			warn("ERROR: --shard should look like 'i/N' with 0 <= i < N (got '%s').", shard.c_str());
+			return 1;
+		}
+		if (!pathtrace) {
+			warn("ERROR: --shard only works with --trace.");
+			return 1;
+		}
+		if (RNG::fixed_seed == 0) {
+			warn("ERROR: --shard needs a --seed so that all shards split the image the same way.");
+			return 1;
+		}
+		if (denoise) {
+			warn("ERROR: --denoise doesn't work with --shard (shards hold raw samples).");
+			return 1;
+		}
+	}
+
 	if (animate && !(pathtrace || rasterize)) {
 		warn("ERROR: must specify --trace or --rasterize when doing --animate.");
 		return 1;
@@ -232,10 +335,15 @@ int main(int argc, char** argv) {
 		info("\texposure: %f", exp);
 		info("\tseed: 0x%X", RNG::fixed_seed);
 		if (pathtrace) {
+			if (shard_count > 1) info("\tshard: %u of %u", shard_index, shard_count);
 			info("\tsamples: %d", camera->film.samples);
 			info("\tmax depth: %d", camera->film.max_ray_depth);
 			info("\trender threads: %u", std::thread::hardware_concurrency());
 			if (no_bvh) info("\tusing object list instead of BVH");
+			else if (bvh_optimize > 0.0f) info("\tBVH optimization budget: %fs", bvh_optimize);
+			if (denoise) info("\tdenoising");
+			if (light_guiding) info("\tlight guiding");
+			if (tiled_format) info("\ttexture format: tiled %s", Tiled_Image::format_name(*tiled_format));
 			info("\tpathtracing...");
 		} else { assert(rasterize);
 			std::string name;
@@ -251,6 +359,26 @@ int main(int argc, char** argv) {
 			//do the render:
 			info(" frame %d", frame);
 
+			std::filesystem::path filename(output_file);
+			if (output_file != "" && animate) {
+				std::stringstream str;
+				str << std::setfill('0') << std::setw(4) << frame;
+
+				std::error_code ec;
+				if (std::filesystem::is_directory(filename, ec) ) {
+					//numbered files within the directory:
+					filename = filename / (str.str() + (shard != "" ? ".s3dshard" : ".png"));
+				} else {
+					//number goes after the stem:
+					std::filesystem::path ext = filename.extension();
+					filename.replace_extension("");
+					filename += str.str();
+					filename += ext;
+				}
+			}
+			//write linear floating point output (rather than a tonemapped png)?
+			bool hdr_output = output_file != "" && shard == "" && HDR_Image_Writer::supports(filename.generic_string());
+
 			auto print_progress = [](float f) {
 				std::cout << "Progress: [";
 
@@ -273,6 +401,7 @@ int main(int argc, char** argv) {
 			std::mutex report_mut;
 			float percent_done = 0.0f;
 			HDR_Image display_hdr;
+			std::optional<PT::Pathtracer::Shard> traced_shard;
 
 			auto report_callback = [&](auto&& report) {
 				std::lock_guard<std::mutex> lock(report_mut);
@@ -287,6 +416,31 @@ int main(int argc, char** argv) {
 				PT::Pathtracer pathtracer;
 
 				pathtracer.use_bvh(!no_bvh);
+				pathtracer.use_bvh_optimization(bvh_optimize);
+				pathtracer.use_denoiser(denoise);
+				pathtracer.use_light_guiding(light_guiding);
+				pathtracer.use_texture_format(tiled_format);
+				pathtracer.set_shard(shard_index, shard_count);
+
+				//floating point output is streamed to disk as tiles finish:
+				std::optional<HDR_Image_Writer> writer;
+				std::string write_error;
+				if (hdr_output) {
+					try {
+						writer.emplace(filename.generic_string(), camera->film.width, camera->film.height);
+					} catch (std::exception const &e) {
+						warn("ERROR: Failed to write output to '%s': %s", filename.generic_string().c_str(), e.what());
+						return 1;
+					}
+					pathtracer.stream_regions([&](PT::Pathtracer::Region_Report &&region) {
+						try {
+							if (write_error == "") writer->write(region.x, region.y, region.image);
+						} catch (std::exception const &e) {
+							write_error = e.what();
+						}
+					});
+				}
+
 				pathtracer.render(scene, camera_instance.lock(), std::move(report_callback), &quit);
 
 				while (pathtracer.in_progress()) {
@@ -295,6 +449,16 @@ int main(int argc, char** argv) {
 				}
 				std::cout << std::endl;
 
+				if (shard != "") traced_shard = pathtracer.copy_shard();
+
+				if (writer) {
+					if (write_error != "") {
+						warn("ERROR: Failed to write output to '%s': %s", filename.generic_string().c_str(), write_error.c_str());
+						return 1;
+					}
+					std::cout << "Wrote result to '" << filename.generic_string() << "'." << std::endl;
+				}
+
 			} else { assert(rasterize);
 
 				Rasterizer rasterizer(scene, *camera_instance.lock(), std::move(report_callback));
@@ -309,39 +473,29 @@ int main(int argc, char** argv) {
 			//write frame:
 			if (output_file == "") {
 				std::cout << "No output was requested, not writing any file." << std::endl;
+			} else if (hdr_output && pathtrace) {
+				//already streamed to disk during the render
+			} else if (hdr_output) {
+				try {
+					display_hdr.save(filename.generic_string());
+				} catch (std::exception const &e) {
+					warn("ERROR: Failed to write output to '%s': %s", filename.generic_string().c_str(), e.what());
+					return 1;
+				}
+				std::cout << "Wrote result to '" << filename.generic_string() << "'." << std::endl;
 			} else {
-
-				std::filesystem::path filename(output_file);
-
-				if (animate) {
-					std::stringstream str;
-					str << std::setfill('0') << std::setw(4) << frame;
-
-					std::error_code ec;
-					if (std::filesystem::is_directory(filename, ec) ) {
-						//numbered files within the directory:
-						filename = filename / (str.str() + ".png");
-					} else {
-						//number goes after the stem:
-						std::filesystem::path ext = filename.extension();
-						filename.replace_extension("");
-						filename += str.str();
-						filename += ext;
+				if (traced_shard) {
+					try {
+						std::ofstream out(filename, std::ios::binary);
+						traced_shard->save(out);
+					} catch (std::exception const &e) {
+						warn("ERROR: Failed to write shard to '%s': %s", filename.generic_string().c_str(), e.what());
+						return 1;
 					}
-				}
-
-				uint32_t data_w, data_h;
-				std::vector<uint8_t> data;
-				display_hdr.tonemap_to(data, exp);
-				data_w = display_hdr.w;
-				data_h = display_hdr.h;
-
-				stbi_flip_vertically_on_write(true);
-				if (!stbi_write_png(filename.generic_string().c_str(), data_w, data_h, 4, data.data(), data_w * 4)) {
-					warn("ERROR: Failed to write output to '%s'", filename.generic_string().c_str());
+					std::cout << "Wrote shard to '" << filename.generic_string() << "'." << std::endl;
+				} else if (!write_png(filename, display_hdr, exp)) {
 					return 1;
 				}
-				std::cout << "Wrote result to '" << filename.generic_string() << "'." << std::endl;
 			}
 
 			//advance (if animating):
@@ -4,6 +4,9 @@
 #include "instance.h"
 #include "tri_mesh.h"
 
+#include "../util/thread_pool.h"
+#include "../util/timer.h"
+
 #include <stack>
 
 namespace PT {
@@ -36,6 +39,243 @@ void BVH<Primitive>::build(std::vector<Primitive>&& prims, size_t max_leaf_size)
 
 }
 
+//relative costs of visiting an interior node and testing a primitive, used by the SAH:
+constexpr float SAH_TRAVERSE_COST = 1.0f;
+constexpr float SAH_INTERSECT_COST = 1.0f;
+
+//maximum number of leaves in a treelet considered by BVH::optimize:
+// (the optimal topology search is O(3^n) in this)
+constexpr uint32_t TREELET_LEAVES = 7;
+
+//list the nodes of the subtree at 'root' in pre-order (so parents come before children):
+template<typename Node>
+static std::vector<size_t> preorder(std::vector<Node> const &nodes, size_t root) {
+	std::vector<size_t> order;
+	std::vector<size_t> todo{root};
+	while (!todo.empty()) {
+		size_t idx = todo.back();
+		todo.pop_back();
+		order.push_back(idx);
+		if (!nodes[idx].is_leaf()) {
+			todo.push_back(nodes[idx].r);
+			todo.push_back(nodes[idx].l);
+		}
+	}
+	return order;
+}
+
+//(un-normalized) SAH cost of every subtree listed in 'order':
+template<typename Node>
+static void compute_costs(std::vector<Node> const &nodes, std::vector<size_t> const &order, std::vector<float> &cost) {
+	for (auto it = order.rbegin(); it != order.rend(); ++it) {
+		Node const &node = nodes[*it];
+		float area = node.bbox.surface_area();
+		if (node.is_leaf()) {
+			cost[*it] = SAH_INTERSECT_COST * area * node.size;
+		} else {
+			cost[*it] = SAH_TRAVERSE_COST * area + cost[node.l] + cost[node.r];
+		}
+	}
+}
+
+//find the SAH-optimal topology of the treelet rooted at 'root' and rewrite it in place if it is cheaper.
+// (Karras and Aila, "Fast Parallel Construction of High-Quality Bounding Volume Hierarchies", 2013)
+// only touches nodes inside the subtree at 'root'; returns true if the treelet was changed.
+template<typename Node>
+static bool restructure_treelet(std::vector<Node> &nodes, std::vector<float> &cost, size_t root) {
+	if (nodes[root].is_leaf()) return false;
+
+	//grow the treelet by repeatedly opening up its largest interior leaf:
+	std::array<size_t, TREELET_LEAVES> leaves;
+	std::array<size_t, TREELET_LEAVES - 1> interior;
+	uint32_t n_leaves = 0, n_interior = 0;
+	interior[n_interior++] = root;
+	leaves[n_leaves++] = nodes[root].l;
+	leaves[n_leaves++] = nodes[root].r;
+	while (n_leaves < TREELET_LEAVES) {
+		uint32_t open = n_leaves;
+		float open_area = -1.0f;
+		for (uint32_t i = 0; i < n_leaves; ++i) {
+			Node const &leaf = nodes[leaves[i]];
+			if (!leaf.is_leaf() && leaf.bbox.surface_area() > open_area) {
+				open = i;
+				open_area = leaf.bbox.surface_area();
+			}
+		}
+		if (open == n_leaves) break;
+		size_t idx = leaves[open];
+		interior[n_interior++] = idx;
+		leaves[open] = nodes[idx].l;
+		leaves[n_leaves++] = nodes[idx].r;
+	}
+	//two leaves only have one possible topology:
+	if (n_leaves < 3) return false;
+
+	auto lowest_bit = [](uint32_t set) {
+		uint32_t i = 0;
+		while (!(set & (1u << i))) ++i;
+		return i;
+	};
+
+	//dynamic program over subsets of the treelet's leaves:
+	// (every proper subset of 'set' is numerically smaller than 'set', so ascending order works)
+	uint32_t all = (1u << n_leaves) - 1u;
+	std::array<BBox, (1u << TREELET_LEAVES)> bounds;
+	std::array<float, (1u << TREELET_LEAVES)> best;
+	std::array<uint32_t, (1u << TREELET_LEAVES)> split;
+	for (uint32_t set = 1; set <= all; ++set) {
+		uint32_t low = set & (~set + 1u);
+		uint32_t rest = set ^ low;
+		if (rest == 0) {
+			size_t idx = leaves[lowest_bit(set)];
+			bounds[set] = nodes[idx].bbox;
+			best[set] = cost[idx];
+			continue;
+		}
+		bounds[set] = bounds[rest];
+		bounds[set].enclose(bounds[low]);
+
+		//try every partition; requiring 'low' on the left skips mirrored duplicates:
+		best[set] = std::numeric_limits<float>::infinity();
+		for (uint32_t left = (set - 1u) & set; left != 0; left = (left - 1u) & set) {
+			if (!(left & low)) continue;
+			float c = best[left] + best[set ^ left];
+			if (c < best[set]) {
+				best[set] = c;
+				split[set] = left;
+			}
+		}
+		best[set] += SAH_TRAVERSE_COST * bounds[set].surface_area();
+	}
+
+	//small relative tolerance so floating point noise doesn't cause endless rewrites:
+	if (!(best[all] < cost[root] * (1.0f - 1e-5f))) return false;
+
+	//rewrite the treelet, reusing its interior nodes:
+	uint32_t next_interior = 1;
+	auto emit = [&](auto &&self, uint32_t set, size_t into) -> void {
+		auto child = [&](uint32_t sub) {
+			if ((sub & (sub - 1u)) == 0) return leaves[lowest_bit(sub)];
+			size_t idx = interior[next_interior++];
+			self(self, sub, idx);
+			return idx;
+		};
+		size_t l = child(split[set]);
+		size_t r = child(set ^ split[set]);
+		Node &node = nodes[into];
+		node.l = l;
+		node.r = r;
+		node.bbox = bounds[set];
+		node.size = nodes[l].size + nodes[r].size;
+		cost[into] = best[set];
+	};
+	emit(emit, all, root);
+	assert(next_interior == n_interior);
+
+	return true;
+}
+
+template<typename Primitive>
+size_t BVH<Primitive>::optimize(Thread_Pool* pool, float time_budget) {
+	if (nodes.empty() || nodes[root_idx].is_leaf()) return 0;
+
+	Timer timer;
+	auto out_of_time = [&]() { return timer.s() >= time_budget; };
+
+	std::vector<float> cost(nodes.size(), 0.0f);
+	compute_costs(nodes, preorder(nodes, root_idx), cost);
+
+	//bottom-up pass over the subtree at 'sub', restructuring the treelet at every interior node:
+	auto optimize_subtree = [&](size_t sub) {
+		std::vector<size_t> order = preorder(nodes, sub);
+		size_t changed = 0;
+		for (auto it = order.rbegin(); it != order.rend(); ++it) {
+			if (out_of_time()) break;
+			if (restructure_treelet(nodes, cost, *it)) ++changed;
+		}
+		return changed;
+	};
+
+	//don't bother handing out subtrees smaller than this to the thread pool:
+	constexpr size_t min_parallel_size = 256;
+	const size_t target_jobs = pool ? 4 * size_t(std::max(1u, std::thread::hardware_concurrency())) : 1;
+
+	//a few rounds, since restructuring a parent changes which treelets its children can form:
+	constexpr uint32_t max_rounds = 3;
+	size_t total = 0;
+	for (uint32_t round = 0; round < max_rounds && !out_of_time(); ++round) {
+
+		//cut the top of the tree into disjoint subtrees that can be processed independently:
+		std::vector<size_t> top, subtrees{root_idx};
+		while (subtrees.size() < target_jobs) {
+			auto largest = subtrees.end();
+			for (auto it = subtrees.begin(); it != subtrees.end(); ++it) {
+				Node const &node = nodes[*it];
+				if (node.is_leaf() || node.size < min_parallel_size) continue;
+				if (largest == subtrees.end() || node.size > nodes[*largest].size) largest = it;
+			}
+			if (largest == subtrees.end()) break;
+			size_t idx = *largest;
+			top.push_back(idx);
+			*largest = nodes[idx].l;
+			subtrees.push_back(nodes[idx].r);
+		}
+
+		size_t changed = 0;
+		if (pool && subtrees.size() > 1) {
+			std::vector<std::future<size_t>> jobs;
+			for (size_t sub : subtrees) {
+				jobs.emplace_back(pool->enqueue([&optimize_subtree, sub]() { return optimize_subtree(sub); }));
+			}
+			for (auto &job : jobs) changed += job.get();
+		} else {
+			for (size_t sub : subtrees) changed += optimize_subtree(sub);
+		}
+
+		//nodes above the cut were split parent-first, so walk them backwards:
+		for (auto it = top.rbegin(); it != top.rend(); ++it) {
+			if (out_of_time()) break;
+			if (restructure_treelet(nodes, cost, *it)) ++changed;
+		}
+
+		total += changed;
+		if (changed == 0) break;
+	}
+
+	if (total == 0) return 0;
+
+	//restructuring moves leaves around, so re-pack primitives so every node covers a contiguous range again:
+	std::vector<size_t> order = preorder(nodes, root_idx);
+	std::vector<Primitive> packed;
+	packed.reserve(primitives.size());
+	for (size_t idx : order) {
+		Node &node = nodes[idx];
+		if (!node.is_leaf()) continue;
+		size_t start = packed.size();
+		for (size_t i = node.start; i < node.start + node.size; ++i) {
+			packed.emplace_back(std::move(primitives[i]));
+		}
+		node.start = start;
+	}
+	for (auto it = order.rbegin(); it != order.rend(); ++it) {
+		Node &node = nodes[*it];
+		if (node.is_leaf()) continue;
+		node.start = nodes[node.l].start;
+		node.size = nodes[node.l].size + nodes[node.r].size;
+	}
+	primitives = std::move(packed);
+
+	return total;
+}
+
+template<typename Primitive> float BVH<Primitive>::sah_cost() const {
+	if (nodes.empty()) return 0.0f;
+	std::vector<float> cost(nodes.size(), 0.0f);
+	compute_costs(nodes, preorder(nodes, root_idx), cost);
+	float area = nodes[root_idx].bbox.surface_area();
+	return area > 0.0f ? cost[root_idx] / area : cost[root_idx];
+}
+
 template<typename Primitive> Trace BVH<Primitive>::hit(const Ray& ray) const {
 	//A3T3 - traverse your BVH
 
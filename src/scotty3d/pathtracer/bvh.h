@@ -7,6 +7,7 @@
 #include "trace.h"
 
 struct RNG;
+class Thread_Pool;
 
 namespace PT {
 
@@ -26,6 +27,13 @@ public:
 	BVH(std::vector<Primitive>&& primitives, size_t max_leaf_size = 1);
 	void build(std::vector<Primitive>&& primitives, size_t max_leaf_size = 1);
 
+	// Optional post-build pass: restructure small treelets of the tree to lower its SAH cost.
+	// Independent subtrees are processed on 'pool' (if given); gives up after 'time_budget' seconds.
+	// Returns the number of treelets that were restructured.
+	size_t optimize(Thread_Pool* pool = nullptr, float time_budget = 1.0f);
+	// SAH cost of the tree, normalized by the surface area of the root:
+	float sah_cost() const;
+
 	BVH(BVH&& src) = default;
 	BVH& operator=(BVH&& src) = default;
 
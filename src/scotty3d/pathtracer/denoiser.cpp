@@ -0,0 +1,110 @@
+
+#include "denoiser.h"
+
+#include "../util/thread_pool.h"
+
+#include <cmath>
+
+namespace PT {
+
+//run f(y_begin, y_end) over bands of [0,h), on 'pool' if there is one:
+template< typename F >
+static void for_each_band(uint32_t h, Thread_Pool *pool, F const &f) {
+	if (!pool || pool->size() <= 1) {
+		f(0u, h);
+		return;
+	}
+	//(a few bands per thread, so uneven rows balance out)
+	uint32_t bands = 4 * pool->size();
+	pool->for_each_chunk(h, std::max(1u, (h + bands - 1) / bands), f);
+}
+
+HDR_Image denoise(HDR_Image const &color, Denoise_Features const &features, Denoise_Options const &opts) {
+	assert(color.w == features.w && color.h == features.h);
+	assert(features.albedo.size() == size_t(features.w) * features.h);
+	assert(features.normal.size() == size_t(features.w) * features.h);
+
+	uint32_t w = features.w, h = features.h;
+
+	//demodulate (leaving channels with ~no albedo alone, since dividing by them would only amplify noise):
+	std::vector< Spectrum > modulation(size_t(w) * h);
+	std::vector< Spectrum > current(size_t(w) * h), next(size_t(w) * h);
+	//colors are compared with highlights compressed, so fireflies don't dominate:
+	std::vector< Spectrum > compressed(size_t(w) * h);
+	for (size_t i = 0; i < modulation.size(); ++i) {
+		Spectrum const &albedo = features.albedo[i];
+		Spectrum &m = modulation[i];
+		for (uint32_t c = 0; c < 3; ++c) {
+			m[c] = (albedo[c] > 0.01f ? albedo[c] : 1.0f);
+		}
+		//(non-finite samples would spread to every pixel the kernel reaches, so they are treated as black)
+		Spectrum in = color.at(uint32_t(i));
+		for (uint32_t c = 0; c < 3; ++c) {
+			if (!std::isfinite(in[c])) in[c] = 0.0f;
+		}
+		current[i] = Spectrum(in.r / m.r, in.g / m.g, in.b / m.b);
+	}
+
+	//B3-spline kernel taps:
+	const float kernel[5] = {1.0f / 16.0f, 1.0f / 4.0f, 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f};
+
+	const float inv_albedo2 = 1.0f / (opts.sigma_albedo * opts.sigma_albedo);
+	const float inv_normal2 = 1.0f / (opts.sigma_normal * opts.sigma_normal);
+
+	for (uint32_t pass = 0; pass < opts.passes; ++pass) {
+		const int32_t step = 1 << pass;
+		const float sigma_color = opts.sigma_color / float(step);
+		const float inv_color2 = 1.0f / (sigma_color * sigma_color);
+
+		for (size_t i = 0; i < current.size(); ++i) {
+			Spectrum const &c = current[i];
+			compressed[i] = Spectrum(c.r / (1.0f + c.r), c.g / (1.0f + c.g), c.b / (1.0f + c.b));
+		}
+
+		for_each_band(h, opts.pool, [&](uint32_t y_begin, uint32_t y_end) {
+			for (uint32_t y = y_begin; y < y_end; ++y) {
+				for (uint32_t x = 0; x < w; ++x) {
+					size_t p = size_t(y) * w + x;
+					Spectrum const &color_p = compressed[p];
+					Spectrum const &albedo_p = features.albedo[p];
+					Vec3 const &normal_p = features.normal[p];
+
+					Spectrum sum;
+					float weight_sum = 0.0f;
+					for (int32_t ky = 0; ky < 5; ++ky) {
+						int32_t qy = int32_t(y) + (ky - 2) * step;
+						if (qy < 0 || qy >= int32_t(h)) continue;
+						for (int32_t kx = 0; kx < 5; ++kx) {
+							int32_t qx = int32_t(x) + (kx - 2) * step;
+							if (qx < 0 || qx >= int32_t(w)) continue;
+							size_t q = size_t(qy) * w + qx;
+
+							Spectrum d_color = compressed[q] - color_p;
+							Spectrum d_albedo = features.albedo[q] - albedo_p;
+							Vec3 d_normal = features.normal[q] - normal_p;
+							float distance = (d_color.r * d_color.r + d_color.g * d_color.g + d_color.b * d_color.b) * inv_color2
+							               + (d_albedo.r * d_albedo.r + d_albedo.g * d_albedo.g + d_albedo.b * d_albedo.b) * inv_albedo2
+							               + d_normal.norm_squared() * inv_normal2;
+							float weight = kernel[kx] * kernel[ky] * std::exp(-distance);
+
+							sum += current[q] * weight;
+							weight_sum += weight;
+						}
+					}
+					//(the center tap has weight > 0 unless the features aren't finite, in which case the pixel is left alone)
+					next[p] = (weight_sum > 0.0f ? sum * (1.0f / weight_sum) : current[p]);
+				}
+			}
+		});
+		std::swap(current, next);
+	}
+
+	//remodulate:
+	HDR_Image result(w, h);
+	for (size_t i = 0; i < current.size(); ++i) {
+		result.at(uint32_t(i)) = current[i] * modulation[i];
+	}
+	return result;
+}
+
+} // namespace PT
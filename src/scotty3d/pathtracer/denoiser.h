@@ -0,0 +1,36 @@
+#pragma once
+
+#include <vector>
+
+#include "../lib/mathlib.h"
+#include "../util/hdr_image.h"
+
+class Thread_Pool;
+
+namespace PT {
+
+//Denoising in Scotty3D is an edge-avoiding a-trous wavelet filter [Dammertz et al. 2010]:
+// each pass blurs with a sparse 5x5 B3-spline kernel whose taps are twice as far apart as the last pass,
+// and each tap is down-weighted by how different its color, albedo, and normal are from the center pixel.
+//
+//Filtering happens on demodulated color (color / albedo), so texture detail comes back unblurred
+// when the result is multiplied by albedo again.
+
+struct Denoise_Features {
+	uint32_t w = 0, h = 0;
+	std::vector< Spectrum > albedo; //first-hit surface color (zero where camera rays missed)
+	std::vector< Vec3 > normal; //first-hit world-space normal (zero where camera rays missed)
+};
+
+struct Denoise_Options {
+	uint32_t passes = 5; //kernel footprint is 4 * 2^passes pixels across
+	float sigma_color = 0.5f; //halved every pass
+	float sigma_albedo = 0.1f;
+	float sigma_normal = 0.3f;
+	Thread_Pool *pool = nullptr; //if set, each pass is split into bands of rows run on this pool (which must not be running the caller)
+};
+
+//returns denoised copy of 'color' (same size as 'features'):
+HDR_Image denoise(HDR_Image const &color, Denoise_Features const &features, Denoise_Options const &opts = Denoise_Options());
+
+} // namespace PT
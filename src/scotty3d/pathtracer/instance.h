@@ -14,33 +14,59 @@ namespace PT {
 
 class Instance {
 public:
-	Instance(Shape const * shape, Material* material, const Mat4& T)
+	Instance(Shape const * shape, Material const * material, const Mat4& T)
 		: T(T), iT(T.inverse()), material(material), geometry(shape) {
-		has_transform = T != Mat4::I;
+		precompute();
 	}
-	Instance(Tri_Mesh const * mesh, Material* material, const Mat4& T)
+	Instance(Tri_Mesh const * mesh, Material const * material, const Mat4& T)
 		: T(T), iT(T.inverse()), material(material), geometry(mesh) {
-		has_transform = T != Mat4::I;
+		precompute();
 	}
 
 	BBox bbox() const {
-		auto box = std::visit([](const auto& g) { return g->bbox(); }, geometry);
-		if (has_transform) box.transform(T);
-		return box;
+		return world_bbox;
 	}
 
 	Trace hit(Ray ray) const {
-		if (has_transform) ray.transform(iT);
+		if (kind == Identity) {
+			auto trace = std::visit([&](const auto& g) { return g->hit(ray); }, geometry);
+			if (trace.hit) trace.material = material;
+			return trace;
+		}
+
+		if (kind == Translation) {
+			//translation doesn't change directions, normals, or distances:
+			ray.point -= to_world.t;
+			auto trace = std::visit([&](const auto& g) { return g->hit(ray); }, geometry);
+			if (trace.hit) {
+				trace.material = material;
+				trace.position += to_world.t;
+				trace.origin += to_world.t;
+			}
+			return trace;
+		}
+
+		//move ray to local space, remembering how much its direction was scaled:
+		Vec3 world_point = ray.point;
+		ray.point = to_local.point(ray.point);
+		ray.dir = to_local.vector(ray.dir);
+		float scale = ray.dir.norm();
+		ray.dir /= scale;
+		ray.dist_bounds *= scale;
+
 		auto trace = std::visit([&](const auto& g) { return g->hit(ray); }, geometry);
 		if (trace.hit) {
 			trace.material = material;
-			if (has_transform) trace.transform(T, iT.T());
+			trace.position = to_world.point(trace.position);
+			trace.origin = world_point;
+			trace.normal = to_world_normal.vector(trace.normal).unit();
+			trace.distance /= scale;
 		}
 		return trace;
 	}
 
 	uint32_t visualize(GL::Lines& lines, GL::Lines& active, uint32_t level, Mat4 vtrans) const {
-		if (has_transform) vtrans = vtrans * T;
+		if (kind != Identity) vtrans = vtrans * T;
 		return std::visit(overloaded{[&](const Tri_Mesh* mesh) {
 										 return mesh->visualize(lines, active, level, vtrans);
 									 },
@@ -49,14 +75,14 @@ public:
 	}
 
 	Vec3 sample(RNG &rng, Vec3 from) const {
-		if (has_transform) from = iT * from;
+		if (kind != Identity) from = to_local.point(from);
 		auto dir = std::visit([&](const auto& g) { return g->sample(rng, from); }, geometry);
-		if (has_transform) dir = T.rotate(dir).unit();
+		if (kind == Affine) dir = to_world.vector(dir).unit();
 		return dir;
 	}
 
 	float pdf(Ray ray, Mat4 pdf_T = Mat4::I, Mat4 pdf_iT = Mat4::I) const {
-		if (has_transform) {
+		if (kind != Identity) {
 			pdf_T = pdf_T * T;
 			pdf_iT = iT * pdf_iT;
 		}
@@ -64,8 +90,44 @@ public:
 	}
 
 private:
+	//the 3x4 (affine) part of a transform, which is all instances need:
+	struct Affine_Transform {
+		Vec3 x, y, z, t;
+
+		Affine_Transform() = default;
+		explicit Affine_Transform(const Mat4& m)
+			: x(m[0].xyz()), y(m[1].xyz()), z(m[2].xyz()), t(m[3].xyz()) {
+		}
+
+		Vec3 point(Vec3 p) const {
+			return x * p.x + y * p.y + z * p.z + t;
+		}
+		Vec3 vector(Vec3 v) const {
+			return x * v.x + y * v.y + z * v.z;
+		}
+	};
+
+	void precompute() {
+		to_world = Affine_Transform(T);
+		to_local = Affine_Transform(iT);
+		to_world_normal = Affine_Transform(iT.T());
+
+		if (T == Mat4::I) {
+			kind = Identity;
+		} else if (Mat4::translate(T[3].xyz()) == T) {
+			kind = Translation;
+		} else {
+			kind = Affine;
+		}
+
+		world_bbox = std::visit([](const auto& g) { return g->bbox(); }, geometry);
+		if (kind != Identity && !world_bbox.empty()) world_bbox.transform(T);
+	}
+
 	Mat4 T, iT;
-	bool has_transform = false;
+	Affine_Transform to_world, to_local, to_world_normal;
+	enum : uint8_t { Identity, Translation, Affine } kind = Identity;
+	BBox world_bbox;
 
 	const Material* material = nullptr;
 	std::variant<const Shape*, const Tri_Mesh*> geometry;
@@ -0,0 +1,108 @@
+
+#include "light_grid.h"
+
+#include <algorithm>
+
+namespace PT {
+
+void Light_Grid::reset(BBox bounds_, uint32_t lights_) {
+	clear();
+	bounds = bounds_;
+	lights = lights_;
+
+	//cells are roughly cubes, with Max_Resolution along the longest axis (fewer if there are many lights):
+	res[0] = res[1] = res[2] = 1;
+	cells_per_unit = Vec3{0.0f};
+	if (lights == 0 || bounds.empty()) return;
+
+	Vec3 extent = bounds.max - bounds.min;
+	float longest = std::max(extent.x, std::max(extent.y, extent.z));
+	if (!(longest > 0.0f)) return;
+
+	uint32_t resolution = Max_Resolution;
+	while (resolution > 1) {
+		for (uint32_t a = 0; a < 3; ++a) {
+			res[a] = std::clamp(uint32_t(std::ceil(resolution * extent[a] / longest)), 1u, resolution);
+		}
+		if (size_t(res[0]) * res[1] * res[2] * lights <= Max_Entries) break;
+		resolution /= 2;
+	}
+	if (resolution == 1) res[0] = res[1] = res[2] = 1;
+
+	for (uint32_t a = 0; a < 3; ++a) {
+		cells_per_unit[a] = (extent[a] > 0.0f ? res[a] / extent[a] : 0.0f);
+	}
+
+	size_t entries = size_t(res[0]) * res[1] * res[2] * lights;
+	sums.assign(entries, 0.0f);
+	counts.assign(entries, 0);
+}
+
+void Light_Grid::clear() {
+	lights = 0;
+	sums.clear();
+	counts.clear();
+	probs.clear();
+	cdfs.clear();
+}
+
+uint32_t Light_Grid::cell(Vec3 point) const {
+	uint32_t index[3];
+	for (uint32_t a = 0; a < 3; ++a) {
+		float f = (point[a] - bounds.min[a]) * cells_per_unit[a];
+		index[a] = (f > 0.0f ? std::min(uint32_t(f), res[a] - 1) : 0);
+	}
+	return (index[2] * res[1] + index[1]) * res[0] + index[0];
+}
+
+void Light_Grid::record(Vec3 point, uint32_t light, float contribution) {
+	if (sums.empty() || light >= lights || !std::isfinite(contribution)) return;
+	size_t i = size_t(cell(point)) * lights + light;
+	sums[i] += contribution;
+	counts[i] += 1;
+}
+
+void Light_Grid::finish() {
+	if (sums.empty()) return;
+
+	probs.assign(sums.size(), 0.0f);
+	cdfs.assign(sums.size(), 0.0f);
+	float uniform = 1.0f / lights;
+
+	for (size_t begin = 0; begin < sums.size(); begin += lights) {
+		//average contribution of each light when it was picked:
+		float total = 0.0f;
+		for (uint32_t l = 0; l < lights; ++l) {
+			size_t i = begin + l;
+			probs[i] = (counts[i] ? sums[i] / counts[i] : 0.0f);
+			total += probs[i];
+		}
+
+		//mix with uniform (or just uniform, for cells where nothing was learned):
+		float sum = 0.0f;
+		for (uint32_t l = 0; l < lights; ++l) {
+			size_t i = begin + l;
+			probs[i] = (total > 0.0f ? (1.0f - Uniform_Fraction) * probs[i] / total + Uniform_Fraction * uniform : uniform);
+			sum += probs[i];
+			cdfs[i] = sum;
+		}
+		cdfs[begin + lights - 1] = 1.0f;
+	}
+
+	sums.clear();
+	counts.clear();
+}
+
+uint32_t Light_Grid::select(RNG &rng, Vec3 point) const {
+	if (!trained()) return uint32_t(rng.integer(0, int32_t(lights)));
+	float const *cdf = cdfs.data() + size_t(cell(point)) * lights;
+	float u = rng.unit();
+	return std::min(uint32_t(std::upper_bound(cdf, cdf + lights, u) - cdf), lights - 1);
+}
+
+float const *Light_Grid::probabilities(Vec3 point) const {
+	if (!trained()) return nullptr;
+	return probs.data() + size_t(cell(point)) * lights;
+}
+
+} // namespace PT
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "../lib/mathlib.h"
+#include "../util/rand.h"
+
+#include <vector>
+
+namespace PT {
+
+/*
+ *
+ * Light_Grid learns how much each emissive instance contributes to points in each cell of a
+ * uniform grid over the scene, and then picks lights in proportion to what it learned.
+ *
+ * Usage: reset() for the scene, record() light samples while tracing some training paths,
+ * then finish(). Before finish() (or after clear()), lights are picked uniformly.
+ *
+ * Every light keeps Uniform_Fraction of the uniform probability in every cell, so lights that
+ * never showed up during training are still sampled (and estimates stay unbiased).
+ *
+ */
+class Light_Grid {
+public:
+	//start learning over 'bounds' for 'lights' emitters:
+	void reset(BBox bounds, uint32_t lights);
+	//forget everything (lights are picked uniformly):
+	void clear();
+
+	//training: light 'light', sampled from 'point', contributed 'contribution':
+	void record(Vec3 point, uint32_t light, float contribution);
+	//build per-cell distributions from what was recorded:
+	void finish();
+	bool trained() const {
+		return !cdfs.empty();
+	}
+
+	//pick a light to sample from 'point':
+	uint32_t select(RNG &rng, Vec3 point) const;
+	//probability of select() picking each light from 'point' (null if not trained, i.e., uniform):
+	float const *probabilities(Vec3 point) const;
+
+	uint32_t lights = 0;
+	static constexpr float Uniform_Fraction = 0.2f;
+	//largest number of cells along an axis, and of (cell, light) pairs:
+	static constexpr uint32_t Max_Resolution = 16;
+	static constexpr size_t Max_Entries = size_t(1) << 22;
+
+private:
+	uint32_t cell(Vec3 point) const;
+
+	BBox bounds;
+	uint32_t res[3] = {1, 1, 1};
+	Vec3 cells_per_unit;
+
+	//training, per (cell, light):
+	std::vector< float > sums;
+	std::vector< uint32_t > counts;
+
+	//trained, per (cell, light):
+	std::vector< float > probs;
+	std::vector< float > cdfs;
+};
+
+} // namespace PT
@@ -65,6 +65,10 @@ public:
 		return prims.size();
 	}
 
+	std::vector<Primitive> const &primitives() const {
+		return prims;
+	}
+
 private:
 	std::vector<Primitive> prims;
 };
@@ -0,0 +1,48 @@
+
+#include "material_table.h"
+
+namespace PT {
+
+//resolve texture to either a raw handle or (if it is constant) its color:
+static void resolve(std::weak_ptr<Texture> const &texture, Texture const *&handle, Spectrum &color) {
+	handle = nullptr;
+	color = Spectrum{};
+	if (auto tex = texture.lock()) {
+		if (tex->is<Textures::Constant>()) {
+			color = tex->evaluate(Vec2{});
+		} else {
+			handle = tex.get();
+		}
+	}
+}
+
+uint32_t Material_Table::add(Material material) {
+	uint32_t id = size();
+
+	flags.emplace_back(uint8_t((material.is_emissive() ? Emissive : 0)
+	                         | (material.is_specular() ? Specular : 0)
+	                         | (material.is_sided() ? Sided : 0)));
+
+	//only emissive materials emit, and they emit their display texture:
+	emission_textures.emplace_back(nullptr);
+	emission_colors.emplace_back();
+	if (material.is_emissive()) resolve(material.display(), emission_textures.back(), emission_colors.back());
+
+	albedo_textures.emplace_back(nullptr);
+	albedo_colors.emplace_back();
+	resolve(material.display(), albedo_textures.back(), albedo_colors.back());
+
+	materials.emplace_back(std::move(material));
+	return id;
+}
+
+void Material_Table::clear() {
+	materials.clear();
+	flags.clear();
+	emission_textures.clear();
+	emission_colors.clear();
+	albedo_textures.clear();
+	albedo_colors.clear();
+}
+
+} // namespace PT
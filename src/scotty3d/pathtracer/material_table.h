@@ -0,0 +1,71 @@
+#pragma once
+
+#include <vector>
+
+#include "../scene/material.h"
+
+namespace PT {
+
+//Material_Table is the pathtracer's compiled copy of the scene's materials.
+//
+//Materials are stored contiguously, so a hit's material is identified by its index in the table.
+// Everything the integrator asks about on every bounce (flags, emission, albedo) is pulled out into
+// parallel arrays when the material is added, with texture handles resolved to raw pointers -- or to
+// plain colors for constant textures -- so those queries need neither std::visit nor weak_ptr::lock().
+//
+//The BSDF itself (evaluate / scatter / pdf) is still reached through material(id).
+//
+//NOTE: add() may move materials, so only take pointers to them after the table is complete.
+
+class Material_Table {
+public:
+	enum Flags : uint8_t {
+		Emissive = 1 << 0,
+		Specular = 1 << 1,
+		Sided = 1 << 2,
+	};
+
+	//add material (whose textures must outlive the table), returns its id:
+	uint32_t add(Material material);
+	void clear();
+	uint32_t size() const {
+		return uint32_t(materials.size());
+	}
+
+	Material const &material(uint32_t id) const {
+		return materials[id];
+	}
+	//id of a material stored in this table:
+	uint32_t id(Material const *material) const {
+		assert(material >= materials.data() && material < materials.data() + materials.size());
+		return uint32_t(material - materials.data());
+	}
+
+	bool is_emissive(uint32_t id) const {
+		return flags[id] & Emissive;
+	}
+	bool is_specular(uint32_t id) const {
+		return flags[id] & Specular;
+	}
+	bool is_sided(uint32_t id) const {
+		return flags[id] & Sided;
+	}
+
+	//light emitted at uv (zero for non-emissive materials):
+	Spectrum emission(uint32_t id, Vec2 uv) const {
+		return emission_textures[id] ? emission_textures[id]->evaluate(uv) : emission_colors[id];
+	}
+	//color of the surface at uv, ignoring lighting (same as Material::albedo):
+	Spectrum albedo(uint32_t id, Vec2 uv) const {
+		return albedo_textures[id] ? albedo_textures[id]->evaluate(uv) : albedo_colors[id];
+	}
+
+private:
+	std::vector< Material > materials;
+	std::vector< uint8_t > flags;
+	//texture handles (nullptr if the texture is constant, in which case the color is used instead):
+	std::vector< Texture const * > emission_textures, albedo_textures;
+	std::vector< Spectrum > emission_colors, albedo_colors;
+};
+
+} // namespace PT
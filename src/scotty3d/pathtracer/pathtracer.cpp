@@ -1,14 +1,17 @@
 
 #include "pathtracer.h"
+#include "denoiser.h"
 #include "../geometry/util.h"
 #include "../test.h"
 
 #include <SDL.h>
+#include <cstring>
 #include <thread>
 
 namespace PT {
 
 constexpr bool SAMPLE_AREA_LIGHTS = true;
+constexpr bool USE_MIS = true; //use sample_lighting_mis() instead of the separate direct + indirect estimates below
 constexpr bool RENDER_NORMALS = false;
 constexpr bool LOG_CAMERA_RAYS = false;
 constexpr bool LOG_AREA_LIGHT_RAYS = false;
@@ -79,6 +82,65 @@ Spectrum Pathtracer::sample_indirect_lighting(RNG &rng, const Shading_Info& hit)
     return radiance;
 }
 
+//power heuristic (beta = 2) weight for a sample from a strategy with density 'pdf' when 'other_pdf' is the other strategy's density:
+static float power_heuristic(float pdf, float other_pdf) {
+	float a = pdf * pdf, b = other_pdf * other_pdf;
+	return (a + b > 0.0f ? a / (a + b) : 0.0f);
+}
+
+Spectrum Pathtracer::sample_lighting_mis(RNG &rng, const Shading_Info& hit) {
+	//Estimate direct + indirect lighting with one light sample and one BSDF sample, combined by
+	// multiple importance sampling. The BSDF-sampled ray is also the next bounce, so its emitted
+	// light (MIS-weighted) and reflected light both come from one trace().
+
+	//(delta lights can't be hit by chance, so are summed separately)
+	Spectrum radiance = sum_delta_lights(hit);
+
+	uint32_t material = materials.id(&hit.bsdf);
+	bool specular = materials.is_specular(material);
+	bool lights = (emissive_objects.n_primitives() > 0 || !env_lights.empty());
+
+	//light sample (not for specular BSDFs, which are zero in any direction other than the one they scatter):
+	if (!specular && lights) {
+		uint32_t emitter = -1U;
+		Vec3 world_in = sample_area_lights(rng, hit.pos, &emitter);
+		Vec3 in = hit.world_to_object.rotate(world_in);
+		Spectrum attenuation = hit.bsdf.evaluate(hit.out_dir, in, hit.uv);
+		float contribution = 0.0f;
+		if (attenuation.luma() > 0.0f) {
+			Spectrum emitted = trace(rng, Ray(hit.pos, world_in, Vec2{EPS_F, std::numeric_limits<float>::infinity()}, 0)).first;
+			//(the light pdf means another traversal, so is only computed when light was found)
+			if (emitted.luma() > 0.0f) {
+				float light_pdf = area_lights_pdf(hit.pos, world_in);
+				if (light_pdf > 0.0f) {
+					float weight = power_heuristic(light_pdf, hit.bsdf.pdf(hit.out_dir, in));
+					radiance += attenuation * emitted * (weight / light_pdf);
+					contribution = (attenuation * emitted).luma() / light_pdf;
+				}
+			}
+		}
+		if (training_light_grid && emitter != -1U) light_grid.record(hit.pos, emitter, contribution);
+	}
+
+	//BSDF sample:
+	// (specular BSDFs pick among discrete directions, with the choice already folded into the attenuation,
+	//  so the sampled direction has probability mass one; their pdf() isn't a density to divide by)
+	Materials::Scatter scatter = hit.bsdf.scatter(rng, hit.out_dir, hit.uv);
+	float bsdf_pdf = specular ? 1.0f : hit.bsdf.pdf(hit.out_dir, scatter.direction);
+	if (bsdf_pdf <= 0.0f || scatter.attenuation.luma() <= 0.0f) return radiance;
+
+	Vec3 world_in = hit.object_to_world.rotate(scatter.direction);
+	auto [emitted, reflected] = trace(rng, Ray(hit.pos, world_in, Vec2{EPS_F, std::numeric_limits<float>::infinity()}, hit.depth - 1));
+
+	float weight = 1.0f;
+	if (!specular && lights && emitted.luma() > 0.0f) {
+		weight = power_heuristic(bsdf_pdf, area_lights_pdf(hit.pos, world_in));
+	}
+	radiance += scatter.attenuation * (emitted * weight + reflected) * (1.0f / bsdf_pdf);
+
+	return radiance;
+}
+
 std::pair<Spectrum, Spectrum> Pathtracer::trace(RNG &rng, const Ray& ray) {
 
 	Trace result = scene.hit(ray);
@@ -93,30 +155,24 @@ std::pair<Spectrum, Spectrum> Pathtracer::trace(RNG &rng, const Ray& ray) {
 		return {};
 	}
 
-	const Material* bsdf = result.material;
-	if (!bsdf) return {};
+	if (!result.material) return {};
+	//(flags and emission come from the material table, to skip dispatching through the material variant)
+	uint32_t material = materials.id(result.material);
 
-	if (!bsdf->is_sided() && dot(result.normal, ray.dir) > 0.0f) {
-		result.normal = -result.normal;
-	}
+	Shading_Info info = shade(ray, result);
 
 	if constexpr (RENDER_NORMALS) {
-		return {Spectrum::direction(result.normal), {}};
+		return {Spectrum::direction(info.normal), {}};
 	}
 
-	Mat4 object_to_world = Mat4::rotate_to(result.normal);
-	Mat4 world_to_object = object_to_world.T();
-	Vec3 out_dir = world_to_object.rotate(ray.point - result.position).unit();
-
-	// TODO DEV: do we want to add ray differentials to track UV derivatives for texture sampling?
-	// https://pbr-book.org/3ed-2018/Geometry_and_Transformations/Rays#RayDifferentials
-	Shading_Info info = {*bsdf,         world_to_object, object_to_world, result.position, out_dir,
-	                     result.normal, result.uv, ray.depth};
-
-	Spectrum emissive = bsdf->emission(info.uv);
+	Spectrum emissive = materials.emission(material, info.uv);
 
 	//if no recursion was requested, or the material doesn't scatter light (i.e., is Materials::Emissive), don't recurse:
-	if (ray.depth == 0 || bsdf->is_emissive()) return {emissive, {}};
+	if (ray.depth == 0 || materials.is_emissive(material)) return {emissive, {}};
+
+	if constexpr (USE_MIS) {
+		return {emissive, sample_lighting_mis(rng, info)};
+	}
 
 	Spectrum direct;
 	if constexpr (SAMPLE_AREA_LIGHTS) {
@@ -128,6 +184,45 @@ std::pair<Spectrum, Spectrum> Pathtracer::trace(RNG &rng, const Ray& ray) {
 	return {emissive, direct + sample_indirect_lighting(rng, info)};
 }
 
+Pathtracer::Shading_Info Pathtracer::shade(const Ray& ray, Trace& result) {
+	assert(result.material);
+
+	if (!materials.is_sided(materials.id(result.material)) && dot(result.normal, ray.dir) > 0.0f) {
+		result.normal = -result.normal;
+	}
+
+	Mat4 object_to_world = Mat4::rotate_to(result.normal);
+	Mat4 world_to_object = object_to_world.T();
+	Vec3 out_dir = world_to_object.rotate(ray.point - result.position).unit();
+
+	// TODO DEV: do we want to add ray differentials to track UV derivatives for texture sampling?
+	// https://pbr-book.org/3ed-2018/Geometry_and_Transformations/Rays#RayDifferentials
+	return Shading_Info{*result.material, world_to_object, object_to_world, result.position, out_dir,
+	                    result.normal,    result.uv,       ray.depth};
+}
+
+std::optional<Pathtracer::Shading_Info> Pathtracer::shading_info(const Ray& ray) {
+	Trace result = scene.hit(ray);
+	if (!result.hit || !result.material || materials.is_emissive(materials.id(result.material))) return std::nullopt;
+	return shade(ray, result);
+}
+
+void Pathtracer::trace_features(const Ray& ray, Spectrum& albedo, Vec3& normal) {
+	albedo = Spectrum{};
+	normal = Vec3{};
+
+	Trace result = scene.hit(ray);
+	if (!result.hit || !result.material) return;
+	uint32_t material = materials.id(result.material);
+
+	//(same flip as trace(), so normals face the camera)
+	if (!materials.is_sided(material) && dot(result.normal, ray.dir) > 0.0f) {
+		result.normal = -result.normal;
+	}
+	albedo = materials.albedo(material, result.uv);
+	normal = result.normal;
+}
+
 Pathtracer::Pathtracer() : thread_pool(std::thread::hardware_concurrency()) {
 }
 
@@ -160,10 +255,11 @@ void Pathtracer::build_scene(Scene& scene_) {
 	std::unordered_map<std::shared_ptr<Skinned_Mesh>, std::string> skinned_mesh_names;
 	std::unordered_map<std::shared_ptr<Shape>, std::string> shape_names;
 	std::unordered_map<std::shared_ptr<Texture>, std::string> texture_names;
-	std::unordered_map<std::shared_ptr<Material>, std::string> material_names;
+	std::unordered_map<std::shared_ptr<Material>, uint32_t> material_ids;
 	std::unordered_map<std::shared_ptr<Delta_Light>, std::string> delta_light_names;
 	std::unordered_map<std::shared_ptr<Environment_Light>, std::string> env_light_names;
-	std::string default_texture_name, default_material_name;
+	std::string default_texture_name;
+	uint32_t default_material_id = 0;
 
 	{ // copy scene data into path tracing formats
 		std::vector<std::future<std::pair<std::string, Tri_Mesh>>> mesh_futs;
@@ -187,6 +283,7 @@ void Pathtracer::build_scene(Scene& scene_) {
 			shapes.emplace(name, std::make_shared<Shape>(*shape));
 		}
 
+		//(copies share pixels with the scene's textures)
 		std::unordered_map<std::shared_ptr<Texture>, std::shared_ptr<Texture>> texture_to_copy;
 		for (const auto& [name, texture] : scene_.textures) {
 			texture_names[texture] = name;
@@ -194,19 +291,27 @@ void Pathtracer::build_scene(Scene& scene_) {
 			texture_to_copy[texture] = copy;
 			textures.emplace(name, std::move(copy));
 		}
+		//point at the copy of a texture, loading it (if needed) since it will be sampled:
+		// (textures that aren't in the scene have no copy, so are let go of)
+		auto use_copy = [&](std::weak_ptr<Texture>& tex) {
+			if (tex.expired()) return;
+			auto copy = texture_to_copy.find(tex.lock());
+			if (copy == texture_to_copy.end()) {
+				tex.reset();
+				return;
+			}
+			tex = copy->second;
+			if (auto image = std::get_if<Textures::Image>(&copy->second->texture)) image->load();
+		};
 		default_texture_name = scene_.make_unique("default_texture");
 		textures.emplace(default_texture_name, std::make_shared<Texture>(Textures::Constant{Spectrum{0.0f}, 1.0f}));
 
 		for (const auto& [name, material] : scene_.materials) {
-			material_names[material] = name;
-			auto copy = std::make_shared<Material>(*material);
-			copy->for_each([&](std::weak_ptr<Texture>& tex) {
-				if (!tex.expired()) tex = texture_to_copy[tex.lock()];
-			});
-			materials.emplace(name, std::move(copy));
+			Material copy = *material;
+			copy.for_each(use_copy);
+			material_ids[material] = materials.add(std::move(copy));
 		}
-		default_material_name = scene_.make_unique("default_material");
-		materials.emplace(default_material_name, std::make_shared<Material>(Materials::Lambertian{ textures.at(default_texture_name) }));
+		default_material_id = materials.add(Material(Materials::Lambertian{ textures.at(default_texture_name) }));
 
 		for (const auto& [name, delta_light] : scene_.delta_lights) {
 			delta_light_names[delta_light] = name;
@@ -216,15 +321,13 @@ void Pathtracer::build_scene(Scene& scene_) {
 		for (const auto& [name, env_light] : scene_.env_lights) {
 			env_light_names[env_light] = name;
 			auto light = std::make_shared<Environment_Light>(*env_light);
-			light->for_each([&](std::weak_ptr<Texture>& tex) {
-				if (!tex.expired()) tex = texture_to_copy[tex.lock()];
-			});
+			light->for_each(use_copy);
 			if (light->is<Environment_Lights::Sphere>()) {
 				auto& sphere_map = std::get<Environment_Lights::Sphere>(light->light);
 				if (auto radiance = sphere_map.radiance.lock()) {
 					if (radiance->is<Textures::Image>()) {
 						sphere_map.importance = Samplers::Sphere::Image{
-							std::get<Textures::Image>(radiance->texture).image
+							std::get<Textures::Image>(radiance->texture).base()
 						};
 					}
 				}
@@ -232,12 +335,39 @@ void Pathtracer::build_scene(Scene& scene_) {
 			env_lights.emplace(name, std::move(light));
 		}
 
+		//(done after environment lights have built their importance maps from the original images)
+		if (texture_format) {
+			for (auto& [name, texture] : textures) {
+				if (texture->is<Textures::Image>()) {
+					std::get<Textures::Image>(texture->texture).compact(*texture_format);
+				}
+			}
+		}
+
 		for (auto& f : mesh_futs) {
 			auto [name, mesh] = f.get();
 			meshes.emplace(name, std::make_shared<Tri_Mesh>(std::move(mesh)));
 		}
 	}
 
+	Timer optimize_timer;
+	auto optimize_time_left = [&]() {
+		return std::max(bvh_optimize_budget - optimize_timer.s(), 0.0f);
+	};
+
+	if (scene_use_bvh && bvh_optimize_budget > 0.0f) { // optimize mesh BVHs (largest first, since they matter most)
+		std::vector<Tri_Mesh*> by_size;
+		for (auto& [name, mesh] : meshes) by_size.emplace_back(mesh.get());
+		std::sort(by_size.begin(), by_size.end(), [](Tri_Mesh* a, Tri_Mesh* b) {
+			return a->n_triangles() > b->n_triangles();
+		});
+		for (Tri_Mesh* mesh : by_size) {
+			float left = optimize_time_left();
+			if (left <= 0.0f) break;
+			mesh->optimize(&thread_pool, left);
+		}
+	}
+
 	{ // create scene instances
 		std::vector<Instance> objects, area_lights;
 		std::vector<Light_Instance> lights;
@@ -248,15 +378,16 @@ void Pathtracer::build_scene(Scene& scene_) {
 			if (mesh_inst->mesh.expired()) continue;
 
 			auto& mesh = meshes.at(mesh_names.at(mesh_inst->mesh.lock()));
-			auto& material = materials.at(mesh_inst->material.expired()
-			                                  ? default_material_name
-			                                  : material_names.at(mesh_inst->material.lock()));
+			uint32_t material_id = mesh_inst->material.expired()
+			                       ? default_material_id
+			                       : material_ids.at(mesh_inst->material.lock());
+			Material const* material = &materials.material(material_id);
 			Mat4 T = mesh_inst->transform.lock()->local_to_world();
 
-			objects.emplace_back(mesh.get(), material.get(), T);
+			objects.emplace_back(mesh.get(), material, T);
 
-			if (material->is_emissive()) {
-				area_lights.emplace_back(mesh.get(), material.get(), T);
+			if (materials.is_emissive(material_id)) {
+				area_lights.emplace_back(mesh.get(), material, T);
 			}
 		}
 
@@ -266,15 +397,16 @@ void Pathtracer::build_scene(Scene& scene_) {
 			if (mesh_inst->mesh.expired()) continue;
 
 			auto& mesh = meshes.at(skinned_mesh_names.at(mesh_inst->mesh.lock()));
-			auto& material = materials.at(mesh_inst->material.expired()
-			                                  ? default_material_name
-			                                  : material_names.at(mesh_inst->material.lock()));
+			uint32_t material_id = mesh_inst->material.expired()
+			                       ? default_material_id
+			                       : material_ids.at(mesh_inst->material.lock());
+			Material const* material = &materials.material(material_id);
 			Mat4 T = mesh_inst->transform.lock()->local_to_world();
 
-			objects.emplace_back(mesh.get(), material.get(), T);
+			objects.emplace_back(mesh.get(), material, T);
 
-			if (material->is_emissive()) {
-				area_lights.emplace_back(mesh.get(), material.get(), T);
+			if (materials.is_emissive(material_id)) {
+				area_lights.emplace_back(mesh.get(), material, T);
 			}
 		}
 
@@ -284,15 +416,16 @@ void Pathtracer::build_scene(Scene& scene_) {
 			if (shape_inst->shape.expired()) continue;
 
 			auto& shape = shapes.at(shape_names.at(shape_inst->shape.lock()));
-			auto& material = materials.at(shape_inst->material.expired()
-			                                  ? default_material_name
-			                                  : material_names.at(shape_inst->material.lock()));
+			uint32_t material_id = shape_inst->material.expired()
+			                       ? default_material_id
+			                       : material_ids.at(shape_inst->material.lock());
+			Material const* material = &materials.material(material_id);
 			Mat4 T = shape_inst->transform.lock()->local_to_world();
 
-			objects.emplace_back(shape.get(), material.get(), T);
+			objects.emplace_back(shape.get(), material, T);
 
-			if (material->is_emissive()) {
-				area_lights.emplace_back(shape.get(), material.get(), T);
+			if (materials.is_emissive(material_id)) {
+				area_lights.emplace_back(shape.get(), material, T);
 			}
 		}
 
@@ -303,9 +436,10 @@ void Pathtracer::build_scene(Scene& scene_) {
 			if (part_inst->particles.expired()) continue;
 
 			auto& mesh = meshes.at(mesh_names.at(part_inst->mesh.lock()));
-			auto& material = materials.at(part_inst->material.expired()
-			                                  ? default_material_name
-			                                  : material_names.at(part_inst->material.lock()));
+			uint32_t material_id = part_inst->material.expired()
+			                       ? default_material_id
+			                       : material_ids.at(part_inst->material.lock());
+			Material const* material = &materials.material(material_id);
 			//Mat4 T = part_inst->transform.lock()->local_to_world();
 
 			auto particles = part_inst->particles.lock();
@@ -313,9 +447,9 @@ void Pathtracer::build_scene(Scene& scene_) {
 				//NOTE: particle positions stored in world space (thus no 'T *' here):
 				Mat4 pT = Mat4::translate(p.position) * Mat4::scale(Vec3{particles->radius});
 
-				objects.emplace_back(mesh.get(), material.get(), pT);
-				if (material->is_emissive()) {
-					area_lights.emplace_back(mesh.get(), material.get(), pT);
+				objects.emplace_back(mesh.get(), material, pT);
+				if (materials.is_emissive(material_id)) {
+					area_lights.emplace_back(mesh.get(), material, pT);
 				}
 			}
 		}
@@ -336,7 +470,12 @@ void Pathtracer::build_scene(Scene& scene_) {
 		point_lights = std::move(lights);
 
 		if (scene_use_bvh) {
-			scene = Aggregate(BVH<Instance>(std::move(objects)));
+			BVH<Instance> bvh(std::move(objects));
+			if (bvh_optimize_budget > 0.0f) {
+				//the instance BVH always gets a chance, even if the meshes used up the budget:
+				bvh.optimize(&thread_pool, std::max(optimize_time_left(), 0.1f * bvh_optimize_budget));
+			}
+			scene = Aggregate(std::move(bvh));
 		} else {
 			scene = Aggregate(List<Instance>(std::move(objects)));
 		}
@@ -356,12 +495,28 @@ void Pathtracer::use_bvh(bool bvh) {
 	scene_use_bvh = bvh;
 }
 
+void Pathtracer::use_bvh_optimization(float time_budget) {
+	bvh_optimize_budget = time_budget;
+}
+
+void Pathtracer::use_denoiser(bool denoise) {
+	use_denoise = denoise;
+}
+
+void Pathtracer::use_texture_format(std::optional<Tiled_Image::Format> format) {
+	texture_format = format;
+}
+
+void Pathtracer::use_light_guiding(bool guide) {
+	use_guiding = guide;
+}
+
 void Pathtracer::log_ray(const Ray& ray, float t, Spectrum color) {
 	std::lock_guard<std::mutex> lock(ray_log_mut);
 	ray_log.push_back(Ray_Log{ray, t, color});
 }
 
-void Pathtracer::accumulate(Tile const &tile, const HDR_Image& data) {
+void Pathtracer::accumulate(Tile const &tile, const HDR_Image& data, std::vector< std::array< float, 6 > > const &features) {
 
 	std::lock_guard<std::mutex> lock(accumulator_mut);
 
@@ -379,29 +534,175 @@ void Pathtracer::accumulate(Tile const &tile, const HDR_Image& data) {
 
 			//add appropriate weight:
 			samples += (tile.s_end - tile.s_begin);
+
+			if (!features.empty()) {
+				std::array< float, 6 > const &f = features[(py - tile.y_begin) * (tile.x_end - tile.x_begin) + (px - tile.x_begin)];
+				std::array< int64_t, 6 > &sums = feature_accumulator[idx];
+				for (uint32_t i = 0; i < 6; ++i) {
+					sums[i] += int64_t(f[i] * (1ll<<24ll));
+				}
+			}
 		}
 	}
 }
 
-HDR_Image Pathtracer::accumulator_to_image() const {
-	HDR_Image image(accumulator_w, accumulator_h, Spectrum(0.0f, 0.0f, 0.0f));
-	for (uint32_t i = 0; i < uint32_t(accumulator.size()); ++i) {
-		//(doing the conversion in double precision is probably overkill)
-		if (accumulator_samples[i] > 0) {
-			image.at(i) = Spectrum(
-				float(accumulator[i][0] / double(1ll<<24ll) / double(accumulator_samples[i])),
-				float(accumulator[i][1] / double(1ll<<24ll) / double(accumulator_samples[i])),
-				float(accumulator[i][2] / double(1ll<<24ll) / double(accumulator_samples[i]))
-			);
+//compute [x_begin,x_end)x[y_begin,y_end) region of image from 40.24 fixed-point sums and sample counts:
+static HDR_Image resolve_accumulator(uint32_t w, std::vector< std::array< int64_t, 3 > > const &accumulator, std::vector< uint32_t > const &accumulator_samples,
+                                     uint32_t x_begin, uint32_t x_end, uint32_t y_begin, uint32_t y_end) {
+	HDR_Image image(x_end - x_begin, y_end - y_begin, Spectrum(0.0f, 0.0f, 0.0f));
+	for (uint32_t py = y_begin; py < y_end; ++py) {
+		for (uint32_t px = x_begin; px < x_end; ++px) {
+			uint32_t i = py * w + px;
+			//(doing the conversion in double precision is probably overkill)
+			if (accumulator_samples[i] > 0) {
+				image.at(px - x_begin, py - y_begin) = Spectrum(
+					float(accumulator[i][0] / double(1ll<<24ll) / double(accumulator_samples[i])),
+					float(accumulator[i][1] / double(1ll<<24ll) / double(accumulator_samples[i])),
+					float(accumulator[i][2] / double(1ll<<24ll) / double(accumulator_samples[i]))
+				);
+			}
 		}
 	}
 	return image;
 }
 
+HDR_Image Pathtracer::accumulator_to_image() const {
+	return resolve_accumulator(accumulator_w, accumulator, accumulator_samples, 0, accumulator_w, 0, accumulator_h);
+}
+
+//average first-hit albedo and normal from 40.24 fixed-point sums and sample counts:
+static Denoise_Features resolve_features(uint32_t w, uint32_t h, std::vector< std::array< int64_t, 6 > > const &feature_accumulator, std::vector< uint32_t > const &accumulator_samples) {
+	Denoise_Features features;
+	features.w = w;
+	features.h = h;
+	features.albedo.resize(feature_accumulator.size());
+	features.normal.resize(feature_accumulator.size());
+	for (size_t i = 0; i < feature_accumulator.size(); ++i) {
+		if (accumulator_samples[i] == 0) continue;
+		double scale = 1.0 / (double(1ll<<24ll) * double(accumulator_samples[i]));
+		std::array< int64_t, 6 > const &sums = feature_accumulator[i];
+		features.albedo[i] = Spectrum(float(sums[0] * scale), float(sums[1] * scale), float(sums[2] * scale));
+		features.normal[i] = Vec3(float(sums[3] * scale), float(sums[4] * scale), float(sums[5] * scale));
+	}
+	return features;
+}
+
+void Pathtracer::stream_regions(std::function<void(Region_Report &&)>&& f) {
+	region_report_fn = std::move(f);
+}
+
+void Pathtracer::set_shard(uint32_t index, uint32_t count) {
+	assert(count > 0 && index < count);
+	shard_index = index;
+	shard_count = count;
+}
+
+Pathtracer::Shard Pathtracer::copy_shard() {
+	std::lock_guard<std::mutex> lock(accumulator_mut);
+	Shard shard;
+	shard.count = shard_count;
+	shard.seed = render_seed;
+	shard.indices = {shard_index};
+	shard.w = accumulator_w;
+	shard.h = accumulator_h;
+	shard.accumulator = accumulator;
+	shard.accumulator_samples = accumulator_samples;
+	return shard;
+}
+
+bool Pathtracer::Shard::complete() const {
+	return indices.size() == count;
+}
+
+void Pathtracer::Shard::merge(Shard const &other) {
+	if (other.count != count || other.seed != seed || other.w != w || other.h != h) {
+		throw std::runtime_error("Shard is from a different render (shard count, seed, or size differs).");
+	}
+	for (uint32_t index : other.indices) {
+		if (std::find(indices.begin(), indices.end(), index) != indices.end()) {
+			throw std::runtime_error("Shard " + std::to_string(index) + " was merged twice.");
+		}
+	}
+	indices.insert(indices.end(), other.indices.begin(), other.indices.end());
+	std::sort(indices.begin(), indices.end());
+
+	//integer addition, so the result doesn't depend on merge order:
+	for (size_t i = 0; i < accumulator.size(); ++i) {
+		for (uint32_t c = 0; c < 3; ++c) {
+			accumulator[i][c] += other.accumulator[i][c];
+		}
+		accumulator_samples[i] += other.accumulator_samples[i];
+	}
+}
+
+HDR_Image Pathtracer::Shard::to_image() const {
+	return resolve_accumulator(w, accumulator, accumulator_samples, 0, w, 0, h);
+}
+
+//shard files are a header followed by the shard indices, sums, and sample counts (all in native byte order,
+// so shards should be merged on machines with the same endianness as the ones that rendered them):
+constexpr char Shard_fourcc[4] = {'s','h','r','d'};
+constexpr uint32_t Shard_version = 1;
+struct Shard_Header {
+	char fourcc[4];
+	uint32_t version;
+	uint32_t count, seed;
+	uint32_t n_indices;
+	uint32_t w, h;
+};
+static_assert(sizeof(Shard_Header) == 7*4, "Shard_Header is packed.");
+
+void Pathtracer::Shard::save(std::ostream& out) const {
+	Shard_Header header;
+	std::memcpy(header.fourcc, Shard_fourcc, 4);
+	header.version = Shard_version;
+	header.count = count;
+	header.seed = seed;
+	header.n_indices = uint32_t(indices.size());
+	header.w = w;
+	header.h = h;
+
+	out.write(reinterpret_cast< const char * >(&header), sizeof(header));
+	out.write(reinterpret_cast< const char * >(indices.data()), sizeof(uint32_t) * indices.size());
+	out.write(reinterpret_cast< const char * >(accumulator.data()), sizeof(accumulator[0]) * accumulator.size());
+	out.write(reinterpret_cast< const char * >(accumulator_samples.data()), sizeof(uint32_t) * accumulator_samples.size());
+	if (!out) throw std::runtime_error("Failed to write shard.");
+}
+
+Pathtracer::Shard Pathtracer::Shard::load(std::istream& in) {
+	Shard_Header header;
+	if (!in.read(reinterpret_cast< char * >(&header), sizeof(header))) throw std::runtime_error("Out of bytes reading shard header.");
+	if (std::memcmp(header.fourcc, Shard_fourcc, 4) != 0) throw std::runtime_error("Not a shard file (expected '" + std::string(Shard_fourcc, 4) + "', read '" + std::string(header.fourcc, 4) + "').");
+	if (header.version != Shard_version) throw std::runtime_error("Unsupported shard version " + std::to_string(header.version) + ".");
+	if (header.count == 0 || header.n_indices > header.count) throw std::runtime_error("Shard header has invalid shard count.");
+
+	Shard shard;
+	shard.count = header.count;
+	shard.seed = header.seed;
+	shard.w = header.w;
+	shard.h = header.h;
+	shard.indices.resize(header.n_indices);
+	shard.accumulator.resize(size_t(header.w) * header.h);
+	shard.accumulator_samples.resize(size_t(header.w) * header.h);
+
+	if (!in.read(reinterpret_cast< char * >(shard.indices.data()), sizeof(uint32_t) * shard.indices.size())
+	 || !in.read(reinterpret_cast< char * >(shard.accumulator.data()), sizeof(shard.accumulator[0]) * shard.accumulator.size())
+	 || !in.read(reinterpret_cast< char * >(shard.accumulator_samples.data()), sizeof(uint32_t) * shard.accumulator_samples.size())) {
+		throw std::runtime_error("Out of bytes reading shard data.");
+	}
+	for (uint32_t index : shard.indices) {
+		if (index >= shard.count) throw std::runtime_error("Shard index " + std::to_string(index) + " is out of range.");
+	}
+	return shard;
+}
+
 void Pathtracer::do_trace(RNG &rng, Tile const &tile) {
 	//A3T1 - Step 0: understand this function!
 
 	HDR_Image sample(camera.film.width, camera.film.height, Spectrum(0.0f, 0.0f, 0.0f));
+	//per-pixel [albedo, normal] sums for the denoiser:
+	std::vector< std::array< float, 6 > > features;
+	if (denoising) features.assign((tile.x_end - tile.x_begin) * (tile.y_end - tile.y_begin), std::array< float, 6 >{});
 	for (uint32_t py = tile.y_begin; py < tile.y_end; ++py) {
 		for (uint32_t px = tile.x_begin; px < tile.x_end; ++px) {
 			for (uint32_t s = tile.s_begin; s < tile.s_end; ++s) {
@@ -426,11 +727,20 @@ void Pathtracer::do_trace(RNG &rng, Tile const &tile) {
 					sample.at(px, py) += p;
 				}
 
+				if (denoising) {
+					Spectrum albedo;
+					Vec3 normal;
+					trace_features(ray, albedo, normal);
+					std::array< float, 6 > &f = features[(py - tile.y_begin) * (tile.x_end - tile.x_begin) + (px - tile.x_begin)];
+					f[0] += albedo.r; f[1] += albedo.g; f[2] += albedo.b;
+					f[3] += normal.x; f[4] += normal.y; f[5] += normal.z;
+				}
+
 				if (cancel_flag && *cancel_flag) return;
 			}
 		}
 	}
-	accumulate(tile, sample);
+	accumulate(tile, sample, features);
 }
 
 bool Pathtracer::in_progress() const {
@@ -473,6 +783,15 @@ void Pathtracer::render(Scene& scene_, std::shared_ptr<::Instance::Camera> camer
 		accumulator.assign(accumulator_w * accumulator_h, zero);
 		accumulator_samples.assign(accumulator_w * accumulator_h, 0);
 		ray_log.clear();
+
+		denoising = use_denoise;
+		if (denoising) {
+			std::array< int64_t, 6 > zero_features;
+			zero_features.fill(0);
+			feature_accumulator.assign(accumulator_w * accumulator_h, zero_features);
+		} else {
+			feature_accumulator.clear();
+		}
 	}
 	render_timer.reset();
 
@@ -489,6 +808,17 @@ void Pathtracer::render(Scene& scene_, std::shared_ptr<::Instance::Camera> camer
 	//get a pseudo-random stream to seed the tiles with:
 	RNG seeds_rng;
 	if (RNG::fixed_seed != 0) seeds_rng.seed(RNG::fixed_seed);
+	render_seed = RNG::fixed_seed;
+
+	//light guiding is trained by the first task on the render pool (so render() doesn't block), and tiles wait for it:
+	std::shared_future< void > trained;
+	if (!add_samples) {
+		if (use_guiding && emissive_objects.n_primitives() > 1) {
+			trained = thread_pool.enqueue([this]() { train_light_grid(); }).share();
+		} else {
+			light_grid.clear();
+		}
+	}
 
 	for (uint32_t y_begin = 0; y_begin < camera.film.height; y_begin += tile_height) {
 		uint32_t y_end = std::min(y_begin + tile_height, camera.film.height);
@@ -496,7 +826,10 @@ void Pathtracer::render(Scene& scene_, std::shared_ptr<::Instance::Camera> camer
 			uint32_t x_end = std::min(x_begin + tile_width, camera.film.width);
 			for (uint32_t s_begin = 0; s_begin < camera.film.samples; s_begin += tile_samples) {
 				uint32_t s_end = std::min(s_begin + tile_samples, camera.film.samples);
-				uint32_t seed = seeds_rng.mt();
+				uint32_t seed = seeds_rng.bits();
+				//when sharding, keep only the tiles that belong to this shard:
+				// (every shard generates the same seed sequence, so this splits the tiles deterministically)
+				if (seed % shard_count != shard_index) continue;
 				tiles.emplace_back(Tile{seed, x_begin, x_end, y_begin, y_end, s_begin, s_end});
 			}
 		}
@@ -524,19 +857,45 @@ void Pathtracer::render(Scene& scene_, std::shared_ptr<::Instance::Camera> camer
 	total_tiles = uint32_t(tiles.size());
 	for (auto const &tile : tiles) {
 		//queue up a render job per-tile:
-		thread_pool.enqueue([tile, this]() {
+		thread_pool.enqueue([tile, trained, this]() {
+			if (trained.valid()) trained.wait();
 			RNG rng(tile.seed);
 			do_trace(rng, tile);
 
-			uint32_t traced = traced_tiles.fetch_add(1) + 1;
-			if (traced == total_tiles) {
-				std::lock_guard<std::mutex> lock(accumulator_mut);
+			//(tiles are counted as traced only after being reported, so in_progress() stays true until the last report is done)
+			std::unique_lock<std::mutex> lock(accumulator_mut);
+			uint32_t traced = traced_tiles.load() + 1;
+			if (traced == total_tiles && denoising) {
+				//every other tile is in the accumulator by now, so the final image is denoised as a whole:
+				// (with the accumulator unlocked, since this takes a while)
+				HDR_Image color = accumulator_to_image();
+				Denoise_Features features = resolve_features(accumulator_w, accumulator_h, feature_accumulator, accumulator_samples);
+				lock.unlock();
+				Denoise_Options opts;
+				opts.pool = &Thread_Pool::shared();
+				HDR_Image image = denoise(color, features, opts);
+				lock.lock();
 				render_timer.pause();
-				report_fn({1.0f, accumulator_to_image()});
+				if (region_report_fn) {
+					region_report_fn({0, 0, std::move(image)});
+					report_fn({1.0f, HDR_Image()});
+				} else {
+					report_fn({1.0f, std::move(image)});
+				}
+				traced_tiles.store(traced);
+				return;
+			}
+			if (traced == total_tiles) render_timer.pause();
+			float progress = (traced == total_tiles ? 1.0f : traced / float(total_tiles));
+			if (region_report_fn) {
+				//(reported with the accumulator locked, so the last report of a region includes all of its samples)
+				region_report_fn({tile.x_begin, tile.y_begin,
+					resolve_accumulator(accumulator_w, accumulator, accumulator_samples, tile.x_begin, tile.x_end, tile.y_begin, tile.y_end)});
+				report_fn({progress, HDR_Image()});
 			} else {
-				std::lock_guard<std::mutex> lock(accumulator_mut);
-				report_fn({traced / float(total_tiles), accumulator_to_image()});
+				report_fn({progress, accumulator_to_image()});
 			}
+			traced_tiles.store(traced);
 		});
 	}
 }
@@ -555,29 +914,61 @@ const std::vector<Pathtracer::Ray_Log> Pathtracer::copy_ray_log() {
 	return ray_log;
 }
 
-Vec3 Pathtracer::sample_area_lights(RNG &rng, Vec3 from) {
+void Pathtracer::train_light_grid() {
+	light_grid.reset(scene.bbox(), uint32_t(emissive_objects.n_primitives()));
+
+	//trace a sparse set of camera paths, recording each light sample's contribution:
+	// (in one task that finishes before any tile starts, so recording needs no locking; seeded from the render seed, so every shard learns the same grid)
+	constexpr uint32_t Training_Paths = 1 << 14;
+	RNG rng;
+	if (render_seed != 0) rng.seed(render_seed ^ 0x11647u);
+
+	training_light_grid = true;
+	for (uint32_t i = 0; i < Training_Paths; ++i) {
+		uint32_t px = uint32_t(rng.integer(0, int32_t(camera.film.width)));
+		uint32_t py = uint32_t(rng.integer(0, int32_t(camera.film.height)));
+		auto [ray, pdf] = camera.sample_ray(rng, px, py);
+		ray.transform(camera_to_world);
+		trace(rng, ray);
+		if (cancel_flag && *cancel_flag) break;
+	}
+	training_light_grid = false;
+
+	light_grid.finish();
+}
+
+Vec3 Pathtracer::sample_area_lights(RNG &rng, Vec3 from, uint32_t *emitter) {
 
 	size_t n_emissive = emissive_objects.n_primitives();
 	size_t n_env = env_lights.size();
 
 	auto sample_env_lights = [&]() {
+		if (emitter) *emitter = -1U;
 		int32_t n = rng.integer(0, static_cast<int32_t>(n_env));
 		auto it = env_lights.begin();
 		std::advance(it, n);
 		return it->second->sample(rng);
 	};
 
+	//(same as emissive_objects.sample(), but picks the object via light_grid and reports which it was)
+	auto sample_emissive_objects = [&]() {
+		if (n_emissive == 0) return Vec3{};
+		uint32_t n = (light_grid.trained() ? light_grid.select(rng, from) : uint32_t(rng.integer(0, static_cast<int32_t>(n_emissive))));
+		if (emitter) *emitter = n;
+		return emissive_objects.primitives()[n].sample(rng, from);
+	};
+
 	if (n_emissive > 0 && n_env > 0) {
 		if (rng.coin_flip(0.5f)) {
 			return sample_env_lights();
 		} else {
-			return emissive_objects.sample(rng, from);
+			return sample_emissive_objects();
 		}
 	}
 	if (n_env > 0) {
 		return sample_env_lights();
 	}
-	return emissive_objects.sample(rng, from);
+	return sample_emissive_objects();
 }
 
 float Pathtracer::area_lights_pdf(Vec3 from, Vec3 dir) {
@@ -593,8 +984,19 @@ float Pathtracer::area_lights_pdf(Vec3 from, Vec3 dir) {
 		return n_env ? pdf / n_env : 0.0f;
 	};
 
+	auto emissive_objects_pdf = [&]() {
+		float const *probabilities = light_grid.probabilities(from);
+		if (!probabilities) return emissive_objects.pdf(Ray(from, dir));
+		float pdf = 0.0f;
+		auto const &objects = emissive_objects.primitives();
+		for (uint32_t i = 0; i < objects.size(); ++i) {
+			if (probabilities[i] > 0.0f) pdf += probabilities[i] * objects[i].pdf(Ray(from, dir));
+		}
+		return pdf;
+	};
+
 	uint32_t n_strategies = (n_emissive > 0) + (n_env > 0);
-	float pdf = emissive_objects.pdf(Ray(from, dir)) + env_lights_pdf();
+	float pdf = emissive_objects_pdf() + env_lights_pdf();
 
 	return n_strategies ? pdf / n_strategies : 0.0f;
 }
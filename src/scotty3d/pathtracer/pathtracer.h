@@ -3,6 +3,7 @@
 
 #include <atomic>
 #include <mutex>
+#include <optional>
 #include <unordered_map>
 
 #include "../lib/mathlib.h"
@@ -13,6 +14,8 @@
 #include "../util/timer.h"
 
 #include "aggregate.h"
+#include "light_grid.h"
+#include "material_table.h"
 
 namespace PT {
 
@@ -35,6 +38,16 @@ public:
 	~Pathtracer();
 
 	void use_bvh(bool use_bvh);
+	//spend up to 'time_budget' seconds optimizing BVHs after each scene build (0 disables):
+	void use_bvh_optimization(float time_budget);
+	//gather first-hit albedo and normals and use them to denoise the final image of subsequent render() calls:
+	// (takes effect when a render starts fresh; renders that add samples keep whatever that render did)
+	void use_denoiser(bool denoise);
+	//store image textures tiled (and possibly compressed) after each scene build (nullopt keeps them as-is):
+	void use_texture_format(std::optional<Tiled_Image::Format> format);
+	//learn which area lights matter where (from a short training pass) and sample those more often:
+	// (takes effect when a render starts fresh)
+	void use_light_guiding(bool guide);
 	uint32_t visualize_bvh(GL::Lines& lines, GL::Lines& active, uint32_t level);
 	const std::vector<Ray_Log> copy_ray_log(); //copy ray log (with proper locking)
 
@@ -45,12 +58,49 @@ public:
 	bool in_progress() const;
 	std::pair<float, float> completion_time() const;
 
+	//a region of the image, reported as the tiles covering it finish:
+	struct Region_Report {
+		uint32_t x = 0, y = 0; //bottom left of region
+		HDR_Image image;
+	};
+	//report regions (instead of the whole image) after every tile of subsequent render() calls;
+	// render()'s callback then only gets progress (with an empty image).
+	// lets headless renders stream huge images to disk without another full-frame copy.
+	void stream_regions(std::function<void(Region_Report &&)>&& f);
+
+	//raw (fixed-point) accumulator contents, for splitting one render over several machines:
+	// each shard traces a deterministic subset of the tiles; because the accumulator is fixed-point,
+	// merging all shards gives exactly the same result as rendering everything on one machine.
+	struct Shard {
+		uint32_t count = 1; //number of shards the render was split into
+		uint32_t seed = 0; //RNG::fixed_seed used for the render (all shards must agree)
+		std::vector< uint32_t > indices; //which of the [0,count) shards this contains
+		uint32_t w = 0, h = 0;
+		std::vector< std::array< int64_t, 3 > > accumulator;
+		std::vector< uint32_t > accumulator_samples;
+
+		bool complete() const; //contains all 'count' shards?
+		void merge(Shard const &other); //throws if 'other' is from a different render or overlaps
+		HDR_Image to_image() const;
+
+		void save(std::ostream& out) const;
+		static Shard load(std::istream& in); //throws on error
+	};
+	//only trace shard 'index' of 'count' in subsequent render() calls (count = 1 traces everything):
+	void set_shard(uint32_t index, uint32_t count);
+	Shard copy_shard(); //copy accumulator (with proper locking)
+
 	Spectrum sample_direct_lighting_task4(RNG &rng, const Shading_Info& hit);
 	Spectrum sample_direct_lighting_task6(RNG &rng, const Shading_Info& hit);
 	Spectrum sample_indirect_lighting(RNG &rng, const Shading_Info& hit);
+	//direct + indirect lighting in one pass, combining light and BSDF samples with the power heuristic:
+	Spectrum sample_lighting_mis(RNG &rng, const Shading_Info& hit);
 
 	void build_scene(Scene& scene);
 	void set_camera(std::shared_ptr<::Instance::Camera> camera); //in its own function so test code can call it
+	//local frame and material at the first (non-emissive) surface 'ray' hits, or nullopt if there is none:
+	// (in its own function so test code can call the sample_*() functions above at real hits)
+	std::optional<Shading_Info> shading_info(const Ray& ray);
 
 private:
 	void cancel();
@@ -66,13 +116,22 @@ private:
 	//trace [x_begin,x_end)x[y_begin,y_end) region of the image, shooting rays for samples [s_begin,s_end):
 	void do_trace(RNG &rng, Tile const &tile);
 	//accumulate samples from do_trace into the accumulator:
-	void accumulate(Tile const &tile, const HDR_Image& data);
+	// (features holds [albedo rgb, normal xyz] sums for each pixel of the tile, or is empty if not denoising)
+	void accumulate(Tile const &tile, const HDR_Image& data, std::vector< std::array< float, 6 > > const &features);
 
 	bool* cancel_flag = nullptr;
 	std::function<void(Render_Report &&)> report_fn;
+	std::function<void(Region_Report &&)> region_report_fn;
 
 	Thread_Pool thread_pool;
 	bool scene_use_bvh = true;
+	uint32_t shard_index = 0, shard_count = 1;
+	uint32_t render_seed = 0;
+	float bvh_optimize_budget = 0.0f;
+	bool use_denoise = false; //denoise subsequent renders?
+	bool use_guiding = false; //train light_grid for subsequent renders?
+	std::optional<Tiled_Image::Format> texture_format;
+	bool denoising = false; //is the current render gathering features + denoising?
 	Timer render_timer, build_timer;
 
 	std::mutex accumulator_mut;
@@ -83,6 +142,8 @@ private:
 	std::vector< uint32_t > accumulator_samples;
 	//compute image (divide spectrums by sample counts):
 	HDR_Image accumulator_to_image() const;
+	//first-hit albedo and normal sums, also 40.24 fixed point (only allocated when denoising):
+	std::vector< std::array< int64_t, 6 > > feature_accumulator;
 
 	uint32_t total_tiles = 0;
 	std::atomic<uint32_t> traced_tiles = 0;
@@ -90,15 +151,25 @@ private:
 	//trace a single ray into the scene,
 	//return (emitted, reflected) light incoming along ray
 	std::pair<Spectrum, Spectrum> trace(RNG &rng, const Ray& ray);
+	//build shading info for 'ray' hitting 'result' (which has a material); flips result.normal to face the ray if the material is two-sided:
+	Shading_Info shade(const Ray& ray, Trace& result);
+	//find first-hit albedo and normal along ray for the denoiser (both zero if the ray misses):
+	void trace_features(const Ray& ray, Spectrum& albedo, Vec3& normal);
 
 	//compute the contribution of all of the delta lights in the scene:
 	// NOTE: no sampling required because delta lights are in exactly one spot!
 	Spectrum sum_delta_lights(const Shading_Info& hit);
 
 	//compute a direction to one of the area lights:
-	Vec3 sample_area_lights(RNG &rng, Vec3 from);
+	// (if emitter is not null, it is set to the index of the emissive object picked, or -1U for environment lights)
+	Vec3 sample_area_lights(RNG &rng, Vec3 from, uint32_t *emitter = nullptr);
 	float area_lights_pdf(Vec3 from, Vec3 dir);
 
+	//per-region light selection (trained by train_light_grid(); uniform if untrained):
+	Light_Grid light_grid;
+	bool training_light_grid = false; //is sample_lighting_mis() recording light samples into light_grid?
+	void train_light_grid();
+
 	std::mutex ray_log_mut;
 	std::vector<Ray_Log> ray_log;
 	void log_ray(const Ray& ray, float t, Spectrum color = Spectrum{1.0f});
@@ -112,7 +183,7 @@ private:
 
 	std::unordered_map<std::string, std::shared_ptr<Delta_Light>> delta_lights;
 	std::unordered_map<std::string, std::shared_ptr<Environment_Light>> env_lights;
-	std::unordered_map<std::string, std::shared_ptr<Material>> materials;
+	Material_Table materials;
 	std::unordered_map<std::string, std::shared_ptr<Texture>> textures;
 	std::unordered_map<std::string, std::shared_ptr<Tri_Mesh>> meshes;
 	std::unordered_map<std::string, std::shared_ptr<Shape>> shapes;
@@ -134,6 +134,11 @@ size_t Tri_Mesh::n_triangles() const {
 	return use_bvh ? triangle_bvh.n_primitives() : triangle_list.n_primitives();
 }
 
+size_t Tri_Mesh::optimize(Thread_Pool* pool, float time_budget) {
+	if (use_bvh) return triangle_bvh.optimize(pool, time_budget);
+	return 0;
+}
+
 uint32_t Tri_Mesh::visualize(GL::Lines& lines, GL::Lines& active, uint32_t level,
                              const Mat4& trans) const {
 	if (use_bvh) return triangle_bvh.visualize(lines, active, level, trans);
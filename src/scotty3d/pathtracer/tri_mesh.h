@@ -62,6 +62,9 @@ public:
 
 	size_t n_triangles() const;
 
+	//run BVH::optimize on the triangle BVH (if there is one):
+	size_t optimize(Thread_Pool* pool, float time_budget);
+
 	//sample a vector pointing to the mesh from point 'from':
 	Vec3 sample(RNG &rng, Vec3 from) const;
 	float pdf(Ray ray, const Mat4& T, const Mat4& iT) const;
@@ -2,6 +2,7 @@
 #include "gl.h"
 #include "../lib/log.h"
 
+#include <cstddef>
 #include <fstream>
 #include <unordered_set>
 
@@ -590,7 +591,7 @@ void Lines::create() {
 	glEnableVertexAttribArray(0);
 
 	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vert),
-	                      reinterpret_cast<GLvoid*>(sizeof(Vec3)));
+	                      reinterpret_cast<GLvoid*>(offsetof(Vert, color)));
 	glEnableVertexAttribArray(1);
 
 	glBindVertexArray(0);
@@ -1,9 +1,14 @@
 #include "framebuffer.h"
+#include "../lib/batch.h"
 #include "../util/hdr_image.h"
+#include "../util/thread_pool.h"
 #include "sample_pattern.h"
 
 Framebuffer::Framebuffer(uint32_t width_, uint32_t height_, SamplePattern const& sample_pattern_)
-	: width(width_), height(height_), sample_pattern(sample_pattern_) {
+	: width(width_), height(height_), sample_pattern(sample_pattern_),
+	  samples(static_cast<uint32_t>(sample_pattern_.centers_and_weights.size())),
+	  tiles_x((width_ + ResolveTileSize - 1) / ResolveTileSize),
+	  tiles_y((height_ + ResolveTileSize - 1) / ResolveTileSize) {
 
 	// check that framebuffer isn't larger than allowed:
 	if (width > MaxWidth || height > MaxHeight) {
@@ -17,12 +22,12 @@ Framebuffer::Framebuffer(uint32_t width_, uint32_t height_, SamplePattern const&
 		                         std::to_string(height) + ") is not even.");
 	}
 
-	uint32_t samples =
-		width * height * static_cast<uint32_t>(sample_pattern.centers_and_weights.size());
-
 	// allocate storage for color and depth samples:
-	colors.assign(samples, Spectrum{0.0f, 0.0f, 0.0f});
-	depths.assign(samples, 1.0f);
+	colors.assign(width * height * samples, Spectrum{0.0f, 0.0f, 0.0f});
+	depths.assign(width * height * samples, 1.0f);
+
+	// (nothing has been resolved yet)
+	touched.assign(tiles_x * tiles_y, 1);
 }
 
 HDR_Image Framebuffer::resolve_colors() const {
@@ -31,13 +36,75 @@ HDR_Image Framebuffer::resolve_colors() const {
 
 	HDR_Image image(width, height);
 
-	for (uint32_t y = 0; y < height; ++y) {
-		for (uint32_t x = 0; x < width; ++x) {
-			for (uint32_t s = 0; s < static_cast<uint32_t>(sample_pattern.centers_and_weights.size()); ++s) {
-				image.at(x, y) += color_at(x, y, s) * sample_pattern.centers_and_weights[s].z;
-			}
+	std::vector<uint32_t> tiles(tiles_x * tiles_y);
+	for (uint32_t t = 0; t < tiles.size(); ++t) tiles[t] = t;
+	resolve_tiles(tiles, &image);
+
+	return image;
+}
+
+void Framebuffer::touch(uint32_t x_begin, uint32_t y_begin, uint32_t x_end, uint32_t y_end) {
+	x_end = std::min(x_end, width);
+	y_end = std::min(y_end, height);
+	if (x_begin >= x_end || y_begin >= y_end) return;
+	for (uint32_t ty = y_begin / ResolveTileSize; ty <= (y_end - 1) / ResolveTileSize; ++ty) {
+		for (uint32_t tx = x_begin / ResolveTileSize; tx <= (x_end - 1) / ResolveTileSize; ++tx) {
+			touched[ty * tiles_x + tx] = 1;
 		}
 	}
+}
 
-	return image;
+uint32_t Framebuffer::resolve_touched(HDR_Image* image) {
+	assert(image);
+	if (image->w != width || image->h != height) {
+		*image = HDR_Image(width, height);
+		touched.assign(touched.size(), 1);
+	}
+
+	std::vector<uint32_t> tiles;
+	for (uint32_t t = 0; t < touched.size(); ++t) {
+		if (touched[t]) tiles.emplace_back(t);
+	}
+	resolve_tiles(tiles, image);
+	touched.assign(touched.size(), 0);
+
+	return static_cast<uint32_t>(tiles.size());
+}
+
+void Framebuffer::resolve_tiles(std::vector<uint32_t> const& tiles, HDR_Image* image) const {
+	assert(image->w == width && image->h == height);
+
+	// weighted sum of each pixel's samples (which index() stores next to each other):
+	std::vector<Vec3> const& weights = sample_pattern.centers_and_weights;
+	auto resolve_tile = [&](uint32_t t) {
+		uint32_t x_begin = (t % tiles_x) * ResolveTileSize, x_end = std::min(width, x_begin + ResolveTileSize);
+		uint32_t y_begin = (t / tiles_x) * ResolveTileSize, y_end = std::min(height, y_begin + ResolveTileSize);
+		for (uint32_t y = y_begin; y < y_end; ++y) {
+			Spectrum* row = image->row(y) + x_begin;
+			Spectrum const* pixels = colors.data() + index(x_begin, y, 0);
+			if (samples == 1) {
+				// (one sample per pixel, so the samples are the row)
+				Batch::scale(row, pixels, weights[0].z, x_end - x_begin);
+				continue;
+			}
+			for (uint32_t x = x_begin; x < x_end; ++x, pixels += samples) {
+				Spectrum sum{0.0f, 0.0f, 0.0f};
+				for (uint32_t s = 0; s < samples; ++s) {
+					sum += pixels[s] * weights[s].z;
+				}
+				*row++ = sum;
+			}
+		}
+	};
+
+	// tiles are resolved in parallel if there is more than one:
+	if (tiles.size() == 1) {
+		resolve_tile(tiles[0]);
+	} else if (!tiles.empty()) {
+		Thread_Pool& pool = Thread_Pool::shared();
+		uint32_t chunk = (static_cast<uint32_t>(tiles.size()) + pool.size() - 1) / pool.size();
+		pool.for_each_chunk(static_cast<uint32_t>(tiles.size()), chunk, [&](uint32_t begin, uint32_t end) {
+			for (uint32_t i = begin; i < end; ++i) resolve_tile(tiles[i]);
+		});
+	}
 }
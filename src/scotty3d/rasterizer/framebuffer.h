@@ -23,6 +23,7 @@ struct Framebuffer {
 
 	const uint32_t width, height;
 	SamplePattern const& sample_pattern;
+	const uint32_t samples; // samples per pixel (sample_pattern.centers_and_weights.size())
 
 	// storage for color and depth samples:
 	std::vector<Spectrum> colors;
@@ -31,8 +32,8 @@ struct Framebuffer {
 	// return storage index for sample s of pixel (x,y):
 	uint32_t index(uint32_t x, uint32_t y, uint32_t s) const {
 		// A1T7: index
-		// TODO: update to provide different storage locations for different samples
-		return s * width * height + (y * width + x);
+		// (a pixel's samples are stored next to each other, so the rasterizer can cover them all at once)
+		return (y * width + x) * samples + s;
 	}
 
 	// helpers that look up colors and depths for sample s of pixel (x,y):
@@ -51,4 +52,20 @@ struct Framebuffer {
 
 	// resolve_colors creates a weighted average of the color samples:
 	HDR_Image resolve_colors() const;
+
+	// colors are also resolved incrementally, in tiles of ResolveTileSize x ResolveTileSize pixels:
+	//  touch() marks the tiles overlapping pixels [x_begin,x_end) x [y_begin,y_end) as changed
+	//  (Pipeline::run marks the tiles it draws; writes through color_at() or colors are not tracked)
+	//  resolve_touched() updates 'image' to match the color samples, resolving only the tiles changed since
+	//  its last call (or everything, if 'image' is the wrong size), and returns the number of tiles resolved
+	static constexpr uint32_t ResolveTileSize = 64;
+	void touch(uint32_t x_begin, uint32_t y_begin, uint32_t x_end, uint32_t y_end);
+	uint32_t resolve_touched(HDR_Image* image);
+
+private:
+	const uint32_t tiles_x, tiles_y;
+	std::vector<uint8_t> touched; // per resolve tile, changed since the last resolve_touched()?
+
+	// resolve the given tiles into image (which must be width x height), in parallel:
+	void resolve_tiles(std::vector<uint32_t> const& tiles, HDR_Image* image) const;
 };
@@ -0,0 +1,181 @@
+#include "mesh_cache.h"
+
+#include "../geometry/halfedge.h"
+#include "../geometry/indexed.h"
+#include "../geometry/util.h"
+#include "../scene/skeleton.h"
+
+#include <cstring>
+
+namespace {
+
+//running 64-bit hash of float bit patterns (FNV-1a style, one word at a time):
+struct Hasher {
+	uint64_t h = 0xcbf29ce484222325ull;
+	void add(uint32_t bits) {
+		h = (h ^ bits) * 0x100000001b3ull;
+	}
+	void add(float f) {
+		uint32_t bits;
+		std::memcpy(&bits, &f, sizeof(bits));
+		add(bits);
+	}
+	void add(Vec2 v) {
+		add(v.x), add(v.y);
+	}
+	void add(Vec3 v) {
+		add(v.x), add(v.y), add(v.z);
+	}
+};
+
+using Attributes = std::array< float, Programs::Lambertian::VA >;
+
+struct Attributes_Hash {
+	size_t operator()(Attributes const &a) const {
+		Hasher hasher;
+		for (float f : a) hasher.add(f);
+		return size_t(hasher.h);
+	}
+};
+
+//welding compares bit patterns, like the hash does (so -0 and 0 stay apart, and identical NaNs weld):
+struct Attributes_Equal {
+	bool operator()(Attributes const &a, Attributes const &b) const {
+		return std::memcmp(a.data(), b.data(), sizeof(Attributes)) == 0;
+	}
+};
+
+} // namespace
+
+Raster_Mesh Raster_Mesh::from_halfedge_mesh(Halfedge_Mesh const &mesh) {
+	Indexed_Mesh indexed = Indexed_Mesh::from_halfedge_mesh(mesh, Indexed_Mesh::SplitEdges);
+	std::vector< Indexed_Mesh::Vert > const &vertices = indexed.vertices();
+	std::vector< Indexed_Mesh::Index > const &indices = indexed.indices();
+
+	Raster_Mesh ret;
+
+	std::unordered_map< Attributes, uint32_t, Attributes_Hash, Attributes_Equal > welded;
+	std::vector< uint32_t > remap(vertices.size());
+	for (uint32_t i = 0; i < vertices.size(); ++i) {
+		Indexed_Mesh::Vert const &iv = vertices[i];
+		Vertex v;
+		v.attributes[Programs::Lambertian::VA_PositionX] = iv.pos.x;
+		v.attributes[Programs::Lambertian::VA_PositionY] = iv.pos.y;
+		v.attributes[Programs::Lambertian::VA_PositionZ] = iv.pos.z;
+		v.attributes[Programs::Lambertian::VA_NormalX] = iv.norm.x;
+		v.attributes[Programs::Lambertian::VA_NormalY] = iv.norm.y;
+		v.attributes[Programs::Lambertian::VA_NormalZ] = iv.norm.z;
+		v.attributes[Programs::Lambertian::VA_TexCoordU] = iv.uv.x;
+		v.attributes[Programs::Lambertian::VA_TexCoordV] = iv.uv.y;
+		auto [at, added] = welded.emplace(v.attributes, static_cast< uint32_t >(ret.vertices.size()));
+		if (added) ret.vertices.emplace_back(v);
+		remap[i] = at->second;
+	}
+
+	ret.triangles.reserve(indices.size());
+	for (auto i : indices) {
+		ret.triangles.emplace_back(remap[i]);
+	}
+
+	ret.edges.reserve(ret.triangles.size() * 2);
+	for (uint32_t i = 0; i + 2 < ret.triangles.size(); i += 3) {
+		ret.edges.insert(ret.edges.end(), {
+			ret.triangles[i + 0], ret.triangles[i + 1],
+			ret.triangles[i + 1], ret.triangles[i + 2],
+			ret.triangles[i + 2], ret.triangles[i + 0]
+		});
+	}
+
+	return ret;
+}
+
+Raster_Mesh_Cache &Raster_Mesh_Cache::get() {
+	static Raster_Mesh_Cache cache;
+	return cache;
+}
+
+uint64_t Raster_Mesh_Cache::fingerprint(Halfedge_Mesh const &mesh) {
+	//same walk as Indexed_Mesh::from_halfedge_mesh(..., SplitEdges):
+	Hasher hasher;
+	for (auto const &f : mesh.faces) {
+		if (f.boundary) continue;
+		uint32_t corners = 0;
+		Halfedge_Mesh::HalfedgeCRef h = f.halfedge;
+		do {
+			hasher.add(h->vertex->position);
+			hasher.add(h->corner_normal);
+			hasher.add(h->corner_uv);
+			++corners;
+			h = h->next;
+		} while (h != f.halfedge);
+		hasher.add(corners);
+	}
+	return hasher.h;
+}
+
+uint64_t Raster_Mesh_Cache::fingerprint(Indexed_Mesh const &mesh) {
+	Hasher hasher;
+	for (auto const &v : mesh.vertices()) {
+		hasher.add(v.pos);
+		hasher.add(v.norm);
+		hasher.add(v.uv);
+	}
+	for (auto i : mesh.indices()) hasher.add(i);
+	return hasher.h;
+}
+
+template< typename Convert >
+std::shared_ptr< Raster_Mesh const > Raster_Mesh_Cache::lookup(std::shared_ptr< void const > const &owner, uint64_t fingerprint, Convert const &convert) {
+	{
+		std::unique_lock< std::mutex > lock(mut);
+		//let go of meshes whose source is gone (their address may be reused by a new mesh):
+		for (auto e = entries.begin(); e != entries.end(); ) {
+			if (e->second.owner.expired()) e = entries.erase(e);
+			else ++e;
+		}
+		auto f = entries.find(owner.get());
+		if (f != entries.end() && f->second.fingerprint == fingerprint) return f->second.mesh;
+	}
+
+	//convert without holding the lock (other renders may be starting with other meshes):
+	auto mesh = std::make_shared< Raster_Mesh const >(convert());
+
+	std::unique_lock< std::mutex > lock(mut);
+	Entry &entry = entries[owner.get()];
+	entry.owner = owner;
+	entry.fingerprint = fingerprint;
+	entry.mesh = mesh;
+	return mesh;
+}
+
+std::shared_ptr< Raster_Mesh const > Raster_Mesh_Cache::load(std::shared_ptr< Halfedge_Mesh const > const &mesh) {
+	assert(mesh);
+	return lookup(mesh, fingerprint(*mesh), [&]() {
+		return Raster_Mesh::from_halfedge_mesh(*mesh);
+	});
+}
+
+std::shared_ptr< Raster_Mesh const > Raster_Mesh_Cache::load(std::shared_ptr< Skinned_Mesh const > const &mesh) {
+	assert(mesh);
+	Indexed_Mesh posed = mesh->posed_mesh();
+	return lookup(mesh, fingerprint(posed), [&]() {
+		return Raster_Mesh::from_halfedge_mesh(Halfedge_Mesh::from_indexed_mesh(posed));
+	});
+}
+
+std::shared_ptr< Raster_Mesh const > Raster_Mesh_Cache::sphere() {
+	static std::shared_ptr< Raster_Mesh const > sphere = std::make_shared< Raster_Mesh const >(
+		Raster_Mesh::from_halfedge_mesh(Halfedge_Mesh::from_indexed_mesh(Util::closed_sphere_mesh(1.0f, 2)))
+	);
+	return sphere;
+}
+
+size_t Raster_Mesh_Cache::size() const {
+	std::unique_lock< std::mutex > lock(mut);
+	return entries.size();
+}
+
+void Raster_Mesh_Cache::clear() {
+	std::unique_lock< std::mutex > lock(mut);
+	entries.clear();
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "pipeline.h"
+#include "programs.h"
+
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+class Halfedge_Mesh;
+class Indexed_Mesh;
+class Skinned_Mesh;
+
+//a mesh converted for drawing with Programs::Lambertian:
+struct Raster_Mesh {
+	using Vertex = ::Vertex< Programs::Lambertian::VA >;
+	std::vector< Vertex > vertices;
+	std::vector< uint32_t > triangles; //indices into vertices, three per triangle
+	std::vector< uint32_t > edges; //indices into vertices, two per line (the sides of every triangle)
+
+	//corners with exactly the same attributes (e.g., across smooth, seamless faces) share a vertex,
+	// so the pipeline only shades it once:
+	static Raster_Mesh from_halfedge_mesh(Halfedge_Mesh const &mesh);
+};
+
+/*
+ *
+ * Raster_Mesh_Cache keeps the conversions of scene meshes the rasterizer last drew,
+ * so later renders (e.g., frames of an animation that only moves transforms) can reuse them.
+ *
+ * Meshes are looked up by identity and their conversion is reused as long as a fingerprint
+ * of the data it was made from still matches (so edits in place are noticed).
+ * Entries are dropped once their mesh has been deleted.
+ *
+ */
+class Raster_Mesh_Cache {
+public:
+	static Raster_Mesh_Cache &get();
+
+	//converted 'mesh', reusing an earlier conversion if the mesh hasn't changed since (thread-safe):
+	std::shared_ptr< Raster_Mesh const > load(std::shared_ptr< Halfedge_Mesh const > const &mesh);
+	//(skinned meshes are posed first, so this only skips the conversion if the pose hasn't changed either)
+	std::shared_ptr< Raster_Mesh const > load(std::shared_ptr< Skinned_Mesh const > const &mesh);
+
+	//unit sphere used to draw sphere shapes:
+	std::shared_ptr< Raster_Mesh const > sphere();
+
+	//number of meshes the cache holds on to:
+	size_t size() const;
+
+	//let go of all cached meshes:
+	void clear();
+
+	//hash of all the data Raster_Mesh::from_halfedge_mesh reads:
+	static uint64_t fingerprint(Halfedge_Mesh const &mesh);
+	static uint64_t fingerprint(Indexed_Mesh const &mesh);
+
+private:
+	struct Entry {
+		std::weak_ptr< void const > owner; //the mesh this was converted from (to notice when it is deleted)
+		uint64_t fingerprint = 0;
+		std::shared_ptr< Raster_Mesh const > mesh;
+	};
+
+	//entry for 'key', if it is still current; otherwise makes one with convert():
+	template< typename Convert >
+	std::shared_ptr< Raster_Mesh const > lookup(std::shared_ptr< void const > const &owner, uint64_t fingerprint, Convert const &convert);
+
+	mutable std::mutex mut;
+	std::unordered_map< void const *, Entry > entries;
+};
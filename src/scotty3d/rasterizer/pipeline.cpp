@@ -1,42 +1,75 @@
 // clang-format off
 #include "pipeline.h"
 
+#include <algorithm>
+#include <atomic>
 #include <iostream>
 #include <limits>
+#include <type_traits>
 
+#include "lib/batch.h"
 #include "lib/log.h"
 #include "lib/mathlib.h"
+#include "lib/simd.h"
 #include "lib/vec3.h"
 #include "rasterizer/framebuffer.h"
 #include "rasterizer/sample_pattern.h"
 #include "geometry/util.h"
+#include "util/thread_pool.h"
+
+//does Program provide shade_vertices (shading a whole array of vertices, e.g., in SIMD batches)?
+template< typename Program, typename Vertex, typename ShadedVertex, typename = void >
+struct Batched_Vertex_Shading : std::false_type { };
+template< typename Program, typename Vertex, typename ShadedVertex >
+struct Batched_Vertex_Shading< Program, Vertex, ShadedVertex, std::void_t< decltype(Program::shade_vertices(
+	std::declval< typename Program::Parameters const& >(), std::declval< std::vector< Vertex > const& >(), std::declval< std::vector< ShadedVertex >* >())) > >
+	: std::true_type { };
+
+template<PrimitiveType primitive_type, class Program, uint32_t flags>
+void Pipeline<primitive_type, Program, flags>::run(std::vector<Vertex> const& vertices,
+                                                   typename Program::Parameters const& parameters,
+                                                   Framebuffer* framebuffer) {
+	// every vertex is its own corner:
+	run_corners(vertices, static_cast<uint32_t>(vertices.size()), [](uint32_t i) { return i; }, parameters, framebuffer);
+}
 
 template<PrimitiveType primitive_type, class Program, uint32_t flags>
 void Pipeline<primitive_type, Program, flags>::run(std::vector<Vertex> const& vertices,
+                                                   std::vector<uint32_t> const& indices,
                                                    typename Program::Parameters const& parameters,
-                                                   Framebuffer* framebuffer_) {
+                                                   Framebuffer* framebuffer) {
+	for (uint32_t index : indices) {
+		if (index >= vertices.size()) {
+			throw std::runtime_error("Index " + std::to_string(index) + " is past the end of " + std::to_string(vertices.size()) + " vertices.");
+		}
+	}
+	run_corners(vertices, static_cast<uint32_t>(indices.size()), [&indices](uint32_t i) { return indices[i]; }, parameters, framebuffer);
+}
+
+template<PrimitiveType primitive_type, class Program, uint32_t flags>
+template<typename CornerVertex>
+void Pipeline<primitive_type, Program, flags>::run_corners(std::vector<Vertex> const& vertices,
+                                                           uint32_t corners, CornerVertex const& corner_vertex,
+                                                           typename Program::Parameters const& parameters,
+                                                           Framebuffer* framebuffer_) {
   // Framebuffer must be non-null:
   assert(framebuffer_);
 	auto& framebuffer = *framebuffer_;
 
   // A1T7: sample loop
-	// TODO: update this function to rasterize to *all* sample locations in the framebuffer.
-  //  	 This will probably involve inserting a loop of the form:
-	// 		 	std::vector< Vec3 > const &samples = framebuffer.sample_pattern.centers_and_weights;
-  //      	for (uint32_t s = 0; s < samples.size(); ++s) { ... }
-  //   	 around some subset of the code.
-	// 		 You will also need to transform the input and output of the rasterize_* functions to
-	// 	     account for the fact they deal with pixels centered at (0.5,0.5).
-
-  std::vector<ShadedVertex> shaded_vertices;
-  shaded_vertices.reserve(vertices.size());
+  // (every sample location is rasterized when tiles are drawn, below)
 
   //--------------------------
-  // shade vertices:
-	for (auto const& v : vertices) {
-    ShadedVertex sv;
-		Program::shade_vertex(parameters, v.attributes, &sv.clip_position, &sv.attributes);
-    shaded_vertices.emplace_back(sv);
+  // shade vertices (with Program::shade_vertices, if the program can shade whole arrays at once):
+  // (each vertex is shaded once, no matter how many corners share it)
+  std::vector<ShadedVertex> shaded_vertices;
+  if constexpr (Batched_Vertex_Shading< Program, Vertex, ShadedVertex >::value) {
+    Program::shade_vertices(parameters, vertices, &shaded_vertices);
+  } else {
+    shaded_vertices.resize(vertices.size());
+    for (size_t i = 0; i < vertices.size(); ++i) {
+      Program::shade_vertex(parameters, vertices[i].attributes, &shaded_vertices[i].clip_position, &shaded_vertices[i].attributes);
+    }
   }
 
   //--------------------------
@@ -46,10 +79,11 @@ void Pipeline<primitive_type, Program, flags>::run(std::vector<Vertex> const& ve
   // reserve some space to avoid reallocations later:
   if constexpr (primitive_type == PrimitiveType::Lines) {
     // clipping lines can never produce more than one vertex per input vertex:
-    clipped_vertices.reserve(shaded_vertices.size());
+    clipped_vertices.reserve(corners);
   } else if constexpr (primitive_type == PrimitiveType::Triangles) {
-    // clipping triangles can produce up to 8 vertices per input vertex:
-    clipped_vertices.reserve(shaded_vertices.size() * 8);
+    // clipping triangles can produce up to 7 triangles per input triangle, but most aren't clipped at all
+    // (so reserve for the common case, rather than holding on to 8x the memory):
+    clipped_vertices.reserve(corners);
   }
   // clang-format off
 
@@ -78,107 +112,195 @@ void Pipeline<primitive_type, Program, flags>::run(std::vector<Vertex> const& ve
 		clipped_vertices.emplace_back(cv);
 	};
 
-	// actually do clipping:
+	// actually do clipping (into a small buffer, then on to clipped_vertices):
 	if constexpr (primitive_type == PrimitiveType::Lines) {
-		for (uint32_t i = 0; i + 1 < shaded_vertices.size(); i += 2) {
-			clip_line(shaded_vertices[i], shaded_vertices[i + 1], emit_vertex);
+		ShadedVertex clipped[MaxClippedLineVertices];
+		for (uint32_t i = 0; i + 1 < corners; i += 2) {
+			uint32_t count = clip_line(shaded_vertices[corner_vertex(i)], shaded_vertices[corner_vertex(i + 1)], clipped);
+			for (uint32_t c = 0; c < count; ++c) emit_vertex(clipped[c]);
 		}
 	} else if constexpr (primitive_type == PrimitiveType::Triangles) {
-		for (uint32_t i = 0; i + 2 < shaded_vertices.size(); i += 3) {
-			clip_triangle(shaded_vertices[i], shaded_vertices[i + 1], shaded_vertices[i + 2], emit_vertex);
+		// outcodes for all vertices at once, so triangles entirely inside (most of them) skip clip_triangle,
+		// and triangles entirely outside one plane are dropped:
+		// (same tolerance as clip_triangle uses)
+		std::vector< uint8_t > outcodes(shaded_vertices.size());
+		static_assert(sizeof(ShadedVertex) % sizeof(float) == 0, "shaded vertices are packed floats");
+		if (!shaded_vertices.empty()) {
+			Batch::clip_outcodes(shaded_vertices[0].clip_position.data, sizeof(ShadedVertex) / sizeof(float), outcodes.data(), shaded_vertices.size(), 1e-6f);
+		}
+
+		ShadedVertex clipped[MaxClippedTriangleVertices];
+		for (uint32_t i = 0; i + 2 < corners; i += 3) {
+			uint32_t ia = corner_vertex(i), ib = corner_vertex(i + 1), ic = corner_vertex(i + 2);
+			uint8_t a = outcodes[ia], b = outcodes[ib], c = outcodes[ic];
+			if ((a | b | c) == 0) {
+				emit_vertex(shaded_vertices[ia]);
+				emit_vertex(shaded_vertices[ib]);
+				emit_vertex(shaded_vertices[ic]);
+			} else if ((a & b & c) == 0) {
+				uint32_t count = clip_triangle(shaded_vertices[ia], shaded_vertices[ib], shaded_vertices[ic], clipped);
+				for (uint32_t v = 0; v < count; ++v) emit_vertex(clipped[v]);
+			}
 		}
 	} else {
 		static_assert(primitive_type == PrimitiveType::Lines, "Unsupported primitive type.");
 	}
 
-	// TODO: we offset the vertices instead of transform the rasterize_* functions
-	size_t samples = framebuffer.sample_pattern.centers_and_weights.size();
-	for (uint32_t s = 0;s < samples; ++s) { 
-	// helper used to put output of rasterization functions into fragments:
-	
-	Vec2 offset = Vec2{0.5f,0.5f} - framebuffer.sample_pattern.centers_and_weights[s].xy();
-
-	
-	auto offset_vertex = [&](ClippedVertex const & v) {
-		ClippedVertex cv;
-		cv.fb_position = Vec3{ v.fb_position.x + offset.x, v.fb_position.y + offset.y, v.fb_position.z };
-		cv.inv_w = v.inv_w;
-		cv.attributes = v.attributes;
-		return cv; 
-	};
-	
 	//--------------------------
-	// rasterize primitives:
-
-	std::vector<Fragment> fragments;
+	// bin primitives into the screen tiles they might cover:
+	constexpr uint32_t Corners = (primitive_type == PrimitiveType::Lines ? 2 : 3);
+	uint32_t primitives = static_cast<uint32_t>(clipped_vertices.size() / Corners);
+	uint32_t tiles_x = std::max(1u, (framebuffer.width + TileSize - 1) / TileSize);
+	uint32_t tiles_y = std::max(1u, (framebuffer.height + TileSize - 1) / TileSize);
+
+	// tile containing framebuffer coordinate f (tiles on the edges also take everything past the edge):
+	auto tile = [](float f, uint32_t tiles) -> uint32_t {
+		float t = std::floor(f / TileSize);
+		if (!(t > 0.0f)) return 0;
+		return std::min(tiles - 1, static_cast<uint32_t>(std::min(t, float(tiles))));
+	};
 
-	// helper used to put output of rasterization functions into fragments:
-	auto emit_fragment = [&](Fragment const& f) { fragments.emplace_back(f); };
-	
-	// actually do rasterization:
-	if constexpr (primitive_type == PrimitiveType::Lines) {
-		for (uint32_t i = 0; i + 1 < clipped_vertices.size(); i += 2) {
-			rasterize_line(offset_vertex(clipped_vertices[i]), offset_vertex(clipped_vertices[i + 1]), emit_fragment);
+	std::vector< std::vector< uint32_t > > bins(tiles_x * tiles_y);
+	for (uint32_t p = 0; p < primitives; ++p) {
+		ClippedVertex const *corners = &clipped_vertices[p * Corners];
+		Vec2 lo = corners[0].fb_position.xy(), hi = lo;
+		for (uint32_t c = 1; c < Corners; ++c) {
+			lo = hmin(lo, corners[c].fb_position.xy());
+			hi = hmax(hi, corners[c].fb_position.xy());
 		}
-	} else if constexpr (primitive_type == PrimitiveType::Triangles) {
-		for (uint32_t i = 0; i + 2 < clipped_vertices.size(); i += 3) {
-			rasterize_triangle(offset_vertex(clipped_vertices[i]), offset_vertex(clipped_vertices[i + 1]), offset_vertex(clipped_vertices[i + 2]), emit_fragment);
+		// (fragments may land up to a pixel past the bounds, because of sample offsets and 2x2 quads)
+		uint32_t x_begin = tile(lo.x - 1.0f, tiles_x), x_end = tile(hi.x + 1.0f, tiles_x) + 1;
+		uint32_t y_begin = tile(lo.y - 1.0f, tiles_y), y_end = tile(hi.y + 1.0f, tiles_y) + 1;
+		for (uint32_t ty = y_begin; ty < y_end; ++ty) {
+			for (uint32_t tx = x_begin; tx < x_end; ++tx) {
+				bins[ty * tiles_x + tx].emplace_back(p);
+			}
+		}
+	}
+
+	// tiles with anything to draw are the only ones whose colors might change:
+	if constexpr (!(flags & Pipeline_ColorWriteDisableBit)) {
+		for (uint32_t t = 0; t < bins.size(); ++t) {
+			if (bins[t].empty()) continue;
+			uint32_t tx = t % tiles_x, ty = t / tiles_x;
+			framebuffer.touch(tx * TileSize, ty * TileSize, (tx + 1) * TileSize, (ty + 1) * TileSize);
 		}
-	} else {
-		static_assert(primitive_type == PrimitiveType::Lines, "Unsupported primitive type.");
 	}
 
 	//--------------------------
-	// depth test + shade + blend fragments:
-	uint32_t out_of_range = 0; // check if rasterization produced fragments outside framebuffer 
-							   // (indicates something is wrong with clipping)
-	for (auto const& f : fragments) {
-
-		// fragment location (in pixels):
-		int32_t x = (int32_t)std::floor(f.fb_position.x);
-		int32_t y = (int32_t)std::floor(f.fb_position.y);
-
-		// if clipping is working properly, this condition shouldn't be needed;
-		// however, it prevents crashes while you are working on your clipping functions,
-		// so we suggest leaving it in place:
-		if (x < 0 || (uint32_t)x >= framebuffer.width || 
-		    y < 0 || (uint32_t)y >= framebuffer.height) {
-			++out_of_range;
-			continue;
-		}
-
-		// local names that refer to destination sample in framebuffer:
-		float& fb_depth = framebuffer.depth_at(x, y, s);
-		Spectrum& fb_color = framebuffer.color_at(x, y, s);
-
-
-		// depth test:
-		if constexpr ((flags & PipelineMask_Depth) == Pipeline_Depth_Always) {
-			// "Always" means the depth test always passes.
-		} else if constexpr ((flags & PipelineMask_Depth) == Pipeline_Depth_Never) {
-			// "Never" means the depth test never passes.
-			continue; //discard this fragment
-		} else if constexpr ((flags & PipelineMask_Depth) == Pipeline_Depth_Less) {
-			// "Less" means the depth test passes when the new fragment has depth less than the stored depth.
-			// A1T4: Depth_Less
-			// TODO: implement depth test! We want to only emit fragments that have a depth less than the stored depth, hence "Depth_Less".
-			if(fb_depth < f.fb_position.z) {
-				continue;
+	// rasterize + depth test + shade + blend one tile:
+	std::vector< Vec3 > const &samples = framebuffer.sample_pattern.centers_and_weights;
+	std::atomic< uint32_t > out_of_range = 0; // check if rasterization produced fragments outside framebuffer
+	                                          // (indicates something is wrong with clipping)
+
+	// samples are rasterized in groups of up to MaxSamples at once (so, with the provided patterns, all at once),
+	// as offsets from the pixel center on the subpixel grid:
+	std::vector< Samples > groups;
+	for (uint32_t begin = 0; begin < samples.size(); begin += MaxSamples) {
+		Samples group;
+		group.count = std::min(uint32_t(MaxSamples), uint32_t(samples.size()) - begin);
+		for (uint32_t s = 0; s < group.count; ++s) {
+			group.x[s] = int32_t(std::lround((samples[begin + s].x - 0.5f) * float(SubpixelSteps)));
+			group.y[s] = int32_t(std::lround((samples[begin + s].y - 0.5f) * float(SubpixelSteps)));
+		}
+		groups.emplace_back(group);
+	}
+
+	// depth testing for one group of samples of one tile, including the farthest depth of each block of the tile
+	// (found when first needed, and only ever moving nearer, since depths only get nearer during a Depth_Less run):
+	constexpr uint32_t TileBlocks = TileSize / BlockSize;
+	struct TileDepth {
+		Framebuffer &framebuffer;
+		uint32_t s_begin, s_count; // samples in the group
+		int32_t x0, y0; // tile origin
+		bool depth_only = false; // test (and write) depth, but emit nothing
+		bool shade_front = false; // (after a depth_only pass) pass only fragments exactly at the stored depth
+		std::array< float, TileBlocks * TileBlocks > farthest = {};
+		uint64_t known = 0; // bit i is set once farthest[i] has been computed
+		static_assert(TileBlocks * TileBlocks <= 64, "known has a bit per block");
+
+		// block of the tile at (x,y), or -1U if it isn't a whole block inside the framebuffer:
+		uint32_t block(int32_t x, int32_t y) const {
+			if (x < 0 || y < 0 || uint32_t(x) + BlockSize > framebuffer.width || uint32_t(y) + BlockSize > framebuffer.height) return -1U;
+			return uint32_t(y - y0) / BlockSize * TileBlocks + uint32_t(x - x0) / BlockSize;
+		}
+		void measure(uint32_t b, int32_t x, int32_t y) {
+			float f = -std::numeric_limits< float >::infinity();
+			for (uint32_t py = uint32_t(y); py < uint32_t(y) + BlockSize; ++py) {
+				for (uint32_t px = uint32_t(x); px < uint32_t(x) + BlockSize; ++px) {
+					// (a pixel's samples are next to each other)
+					float const *depths = &framebuffer.depth_at(px, py, s_begin);
+					for (uint32_t s = 0; s < s_count; ++s) f = std::max(f, depths[s]);
+				}
 			}
-		} else {
-			static_assert((flags & PipelineMask_Depth) <= Pipeline_Depth_Always, "Unknown depth test flag.");
+			farthest[b] = f;
+			known |= uint64_t(1) << b;
+		}
+
+		bool hidden(int32_t x, int32_t y, float z) {
+			if constexpr ((flags & PipelineMask_Depth) == Pipeline_Depth_Never) return true;
+			if constexpr ((flags & PipelineMask_Depth) != Pipeline_Depth_Less) return false;
+			uint32_t b = block(x, y);
+			if (b == -1U) return false;
+			if (!(known & (uint64_t(1) << b))) measure(b, x, y);
+			return farthest[b] < z;
 		}
+		void tested(int32_t x, int32_t y) {
+			if constexpr ((flags & PipelineMask_Depth) != Pipeline_Depth_Less || (flags & Pipeline_DepthWriteDisableBit)) return;
+			if (shade_front) return;
+			uint32_t b = block(x, y);
+			if (b != -1U) measure(b, x, y);
+		}
+		bool test(int32_t x, int32_t y, uint32_t s, float z) {
+			// (fragments outside the framebuffer are counted by emit_fragment)
+			if (x < 0 || (uint32_t)x >= framebuffer.width || y < 0 || (uint32_t)y >= framebuffer.height) return true;
+
+			// local name that refers to destination sample in framebuffer:
+			float& fb_depth = framebuffer.depth_at(x, y, s_begin + s);
+
+			if (shade_front) return fb_depth == z;
+
+			// depth test:
+			if constexpr ((flags & PipelineMask_Depth) == Pipeline_Depth_Always) {
+				// "Always" means the depth test always passes.
+			} else if constexpr ((flags & PipelineMask_Depth) == Pipeline_Depth_Never) {
+				// "Never" means the depth test never passes.
+				return false; //discard this fragment
+			} else if constexpr ((flags & PipelineMask_Depth) == Pipeline_Depth_Less) {
+				// "Less" means the depth test passes when the new fragment has depth less than the stored depth.
+				// A1T4: Depth_Less
+				// TODO: implement depth test! We want to only emit fragments that have a depth less than the stored depth, hence "Depth_Less".
+				if(fb_depth < z) {
+					return false;
+				}
+			} else {
+				static_assert((flags & PipelineMask_Depth) <= Pipeline_Depth_Always, "Unknown depth test flag.");
+			}
 
-		// if depth test passes, and depth writes aren't disabled, write depth to depth buffer:
-		if constexpr (!(flags & Pipeline_DepthWriteDisableBit)) {
-			fb_depth = f.fb_position.z;
+			// if depth test passes, and depth writes aren't disabled, write depth to depth buffer:
+			if constexpr (!(flags & Pipeline_DepthWriteDisableBit)) {
+				fb_depth = z;
+			}
+			return true;
 		}
+	};
+
+	// opaque triangles are drawn in a depth-only pass and then a shading pass, so hidden fragments are never shaded:
+	constexpr bool depth_prepass = primitive_type == PrimitiveType::Triangles
+		&& (flags & PipelineMask_Blend) == Pipeline_Blend_Replace
+		&& (flags & PipelineMask_Depth) == Pipeline_Depth_Less
+		&& !(flags & Pipeline_DepthWriteDisableBit);
 
-		// shade fragment:
+	// shade a fragment:
+	auto shade = [&](Fragment const& f) {
 		ShadedFragment sf;
 		sf.fb_position = f.fb_position;
 		Program::shade_fragment(parameters, f.attributes, f.derivatives, &sf.color, &sf.opacity);
+		return sf;
+	};
 
+	// write a shaded fragment's color to one sample in the framebuffer:
+	auto blend = [&](Spectrum& fb_color, ShadedFragment const& sf) {
 		// write color to framebuffer if color writes aren't disabled:
 		if constexpr (!(flags & Pipeline_ColorWriteDisableBit)) {
 			// blend fragment:
@@ -197,19 +319,146 @@ void Pipeline<primitive_type, Program, flags>::run(std::vector<Vertex> const& ve
 				static_assert((flags & PipelineMask_Blend) <= Pipeline_Blend_Over, "Unknown blending flag.");
 			}
 		}
+	};
+
+	auto draw_tile = [&](uint32_t t) {
+		std::vector< uint32_t > const &bin = bins[t];
+		if (bin.empty()) return;
+
+		uint32_t tx = t % tiles_x, ty = t / tiles_x;
+		Scissor scissor = Scissor::everything();
+		if (tx > 0) scissor.x_begin = int32_t(tx * TileSize);
+		if (tx + 1 < tiles_x) scissor.x_end = int32_t((tx + 1) * TileSize);
+		if (ty > 0) scissor.y_begin = int32_t(ty * TileSize);
+		if (ty + 1 < tiles_y) scissor.y_end = int32_t((ty + 1) * TileSize);
+
+		uint32_t tile_out_of_range = 0;
+
+		// fragment location (in pixels), if it is inside the framebuffer:
+		auto pixel = [&](Fragment const& f, int32_t& x, int32_t& y) {
+			x = (int32_t)std::floor(f.fb_position.x);
+			y = (int32_t)std::floor(f.fb_position.y);
+
+			// if clipping is working properly, this condition shouldn't be needed;
+			// however, it prevents crashes while you are working on your clipping functions,
+			// so we suggest leaving it in place:
+			if (x < 0 || (uint32_t)x >= framebuffer.width ||
+			    y < 0 || (uint32_t)y >= framebuffer.height) {
+				++tile_out_of_range;
+				return false;
+			}
+			return true;
+		};
+
+		for (uint32_t g = 0; g < groups.size(); ++g) {
+			uint32_t s_begin = g * MaxSamples;
+			TileDepth depth{framebuffer, s_begin, groups[g].count, int32_t(tx * TileSize), int32_t(ty * TileSize)};
+
+			if constexpr (primitive_type == PrimitiveType::Lines) {
+				// lines are rasterized once per sample, offsetting the vertices instead of transforming rasterize_line.
+				// (offsets can move properly clipped lines past the framebuffer edge, so edge tiles stop at the edge)
+				Scissor line_scissor = scissor;
+				line_scissor.x_begin = std::max(line_scissor.x_begin, 0);
+				line_scissor.y_begin = std::max(line_scissor.y_begin, 0);
+				line_scissor.x_end = std::min(line_scissor.x_end, int32_t(framebuffer.width));
+				line_scissor.y_end = std::min(line_scissor.y_end, int32_t(framebuffer.height));
+				for (uint32_t s = 0; s < groups[g].count; ++s) {
+					Vec2 offset = Vec2{0.5f, 0.5f} - samples[s_begin + s].xy();
+					auto offset_vertex = [&](ClippedVertex const &v) {
+						ClippedVertex cv;
+						cv.fb_position = Vec3{ v.fb_position.x + offset.x, v.fb_position.y + offset.y, v.fb_position.z };
+						cv.inv_w = v.inv_w;
+						cv.attributes = v.attributes;
+						return cv;
+					};
+
+					// fragments are shaded and blended as soon as they are rasterized
+					// (so no fragments are stored, and memory use doesn't depend on resolution or overdraw):
+					auto emit_fragment = [&](Fragment const& f) {
+						int32_t x, y;
+						if (!pixel(f, x, y)) return;
+						if (!depth.test(x, y, s, f.fb_position.z)) return;
+						if constexpr (!(flags & Pipeline_ColorWriteDisableBit)) {
+							blend(framebuffer.color_at(x, y, s_begin + s), shade(f));
+						}
+					};
+
+					for (uint32_t p : bin) {
+						ClippedVertex const *corners = &clipped_vertices[p * Corners];
+						rasterize_line(offset_vertex(corners[0]), offset_vertex(corners[1]), emit_fragment, line_scissor);
+					}
+				}
+			} else if constexpr (primitive_type == PrimitiveType::Triangles) {
+				// triangles cover all samples of the group at once, and (already depth tested) fragments are
+				// shaded once and blended into the samples in their mask:
+				auto emit_fragment = [&](Fragment const& f, uint64_t mask) {
+					int32_t x, y;
+					if (!pixel(f, x, y)) return;
+					ShadedFragment sf = shade(f);
+					Spectrum* fb_colors = &framebuffer.color_at(x, y, s_begin);
+					for (uint32_t s = 0; mask; ++s, mask >>= 1) {
+						if (mask & 1) blend(fb_colors[s], sf);
+					}
+				};
+
+				// actually do rasterization (in primitive order):
+				auto rasterize_bin = [&]() {
+					for (uint32_t p : bin) {
+						ClippedVertex const *corners = &clipped_vertices[p * Corners];
+						rasterize_triangle(corners[0], corners[1], corners[2], emit_fragment, scissor, groups[g], depth);
+					}
+				};
+				if constexpr (flags & Pipeline_ColorWriteDisableBit) {
+					// (shading would be thrown away, so only depth is needed)
+					depth.depth_only = true;
+				} else if constexpr (depth_prepass) {
+					depth.depth_only = true;
+					rasterize_bin();
+					depth.depth_only = false;
+					depth.shade_front = true;
+				}
+				rasterize_bin();
+			} else {
+				static_assert(primitive_type == PrimitiveType::Lines, "Unsupported primitive type.");
+			}
+		}
+		out_of_range += tile_out_of_range;
+	};
+
+	//--------------------------
+	// draw tiles, in parallel if there is more than one:
+	// (workers take the next undrawn tile until none are left, so uneven tiles balance out)
+	if (bins.size() == 1) {
+		draw_tile(0);
+	} else {
+		std::atomic< uint32_t > next_tile = 0;
+		Thread_Pool &pool = Thread_Pool::shared();
+		pool.for_each_chunk(std::min(pool.size(), static_cast<uint32_t>(bins.size())), 1, [&](uint32_t, uint32_t) {
+			for (uint32_t t = next_tile++; t < bins.size(); t = next_tile++) {
+				draw_tile(t);
+			}
+		});
 	}
+
 	if (out_of_range > 0) {
 		if constexpr (primitive_type == PrimitiveType::Lines) {
 			warn("Produced %d fragments outside framebuffer; this indicates something is likely "
 			     "wrong with the clip_line function.",
-			     out_of_range);
+			     out_of_range.load());
 		} else if constexpr (primitive_type == PrimitiveType::Triangles) {
 			warn("Produced %d fragments outside framebuffer; this indicates something is likely "
 			     "wrong with the clip_triangle function.",
-			     out_of_range);
+			     out_of_range.load());
 		}
 	}
-	}
+}
+
+template<PrimitiveType p, class P, uint32_t flags>
+auto Pipeline<p, P, flags>::Scissor::everything() -> Scissor {
+	return Scissor{
+		std::numeric_limits<int32_t>::min(), std::numeric_limits<int32_t>::min(),
+		std::numeric_limits<int32_t>::max(), std::numeric_limits<int32_t>::max()
+	};
 }
 
 // -------------------------------------------------------------------------
@@ -240,6 +489,19 @@ auto Pipeline<p, P, F>::lerp(ShadedVertex const& a, ShadedVertex const& b, float
 template<PrimitiveType p, class P, uint32_t flags>
 void Pipeline<p, P, flags>::clip_line(ShadedVertex const& va, ShadedVertex const& vb,
                                       std::function<void(ShadedVertex const&)> const& emit_vertex) {
+	ShadedVertex clipped[MaxClippedLineVertices];
+	uint32_t count = clip_line(va, vb, clipped);
+	for (uint32_t i = 0; i < count; ++i) {
+		emit_vertex(clipped[i]);
+	}
+}
+
+// (the clipping itself, with vertices written to out_ instead of emitted:)
+template<PrimitiveType p, class P, uint32_t flags>
+uint32_t Pipeline<p, P, flags>::clip_line(ShadedVertex const& va, ShadedVertex const& vb, ShadedVertex* out_) {
+	uint32_t count = 0;
+	auto emit_vertex = [&](ShadedVertex const& v) { out_[count++] = v; };
+
 	// Determine portion of line over which:
 	// 		pt = (b-a) * t + a
 	//  	-pt.w <= pt.x <= pt.w
@@ -313,6 +575,7 @@ void Pipeline<p, P, flags>::clip_line(ShadedVertex const& va, ShadedVertex const
 			emit_vertex(out);
 		}
 	}
+	return count;
 }
 
 /*
@@ -330,6 +593,20 @@ template<PrimitiveType p, class P, uint32_t flags>
 void Pipeline<p, P, flags>::clip_triangle(
 	ShadedVertex const& va, ShadedVertex const& vb, ShadedVertex const& vc,
 	std::function<void(ShadedVertex const&)> const& emit_vertex) {
+	ShadedVertex clipped[MaxClippedTriangleVertices];
+	uint32_t count = clip_triangle(va, vb, vc, clipped);
+	for (uint32_t i = 0; i < count; ++i) {
+		emit_vertex(clipped[i]);
+	}
+}
+
+// (the clipping itself, with vertices written to out_ instead of emitted:)
+template<PrimitiveType p, class P, uint32_t flags>
+uint32_t Pipeline<p, P, flags>::clip_triangle(
+	ShadedVertex const& va, ShadedVertex const& vb, ShadedVertex const& vc, ShadedVertex* out_) {
+	uint32_t count = 0;
+	auto emit_vertex = [&](ShadedVertex const& v) { out_[count++] = v; };
+
 	// A1EC: clip_triangle
 	// TODO: correct code!
 	// emit_vertex(va);
@@ -337,7 +614,14 @@ void Pipeline<p, P, flags>::clip_triangle(
 	// emit_vertex(vc);
 	// return;
 
-	std::vector<ShadedVertex> curr_vertices{va, vb, vc};
+	// the polygon being clipped lives in one of two fixed-size buffers (clipping by a plane adds at most one vertex):
+	constexpr uint32_t MaxPolygon = 9;
+	std::array<std::array<ShadedVertex, MaxPolygon>, 2> buffers;
+	uint32_t curr = 0;
+	uint32_t curr_size = 3;
+	buffers[curr][0] = va;
+	buffers[curr][1] = vb;
+	buffers[curr][2] = vc;
   static std::array<Vec4, 6> planes{
       // -w <= x -> 0 <= x + w;
       Vec4{1.0f, 0.0f, 0.0f, 1.0f},
@@ -353,7 +637,7 @@ void Pipeline<p, P, flags>::clip_triangle(
       Vec4{0.0f, 0.0f, -1.0f, 1.0f},
   };
 
-  auto plane_intersection = [](ShadedVertex v0, ShadedVertex v1, Vec4 plane,
+  auto plane_intersection = [](ShadedVertex const &v0, ShadedVertex const &v1, Vec4 plane,
                                ShadedVertex &out) -> int {
     float d0 = dot(v0.clip_position, plane);
     float d1 = dot(v1.clip_position, plane);
@@ -381,11 +665,31 @@ void Pipeline<p, P, flags>::clip_triangle(
     return intersection_case;
   };
 
+  // most triangles are entirely inside, and come through clipping unchanged:
+  auto inside = [](ShadedVertex const &v) -> bool {
+    for (const Vec4 &plane : planes) {
+      if (!(dot(v.clip_position, plane) >= -1e-6f)) return false;
+    }
+    return true;
+  };
+  if (inside(va) && inside(vb) && inside(vc)) {
+    emit_vertex(va);
+    emit_vertex(vb);
+    emit_vertex(vc);
+    return count;
+  }
+
   for (const Vec4 &plane : planes) {
-    std::vector<ShadedVertex> next_vertices{};
-    for (int i = 0; i < curr_vertices.size(); i++) {
+    std::array<ShadedVertex, MaxPolygon> const &curr_vertices = buffers[curr];
+    std::array<ShadedVertex, MaxPolygon> &next_vertices = buffers[curr ^ 1];
+    uint32_t next_size = 0;
+    // (the bound only matters for nearly-degenerate polygons, where rounding can make the inside test inconsistent)
+    auto add_vertex = [&](ShadedVertex const &v) {
+      if (next_size < MaxPolygon) next_vertices[next_size++] = v;
+    };
+    for (uint32_t i = 0; i < curr_size; i++) {
       // vn,vn+1
-      int j = (i + 1) % curr_vertices.size();
+      uint32_t j = (i + 1) % curr_size;
       ShadedVertex curr_vertex{};
       int intersection_case = plane_intersection(
           curr_vertices[i], curr_vertices[j], plane, curr_vertex);
@@ -397,30 +701,33 @@ void Pipeline<p, P, flags>::clip_triangle(
       case 0b01: {
         // here we should add both new vertex and end point, as this point is
         // also a valid point here
-        next_vertices.emplace_back(std::move(curr_vertex));
-        next_vertices.emplace_back(curr_vertices[j]);
+        add_vertex(curr_vertex);
+        add_vertex(curr_vertices[j]);
         break;
       }
       case 0b10:
         [[fallthrough]];
       case 0b11: {
-        next_vertices.emplace_back(std::move(curr_vertex));
+        add_vertex(curr_vertex);
         break;
       }
       }
     }
-    curr_vertices = std::move(next_vertices);
-    if (curr_vertices.size() < 3) {
-      return;
+    curr ^= 1;
+    curr_size = next_size;
+    if (curr_size < 3) {
+      return 0;
     }
   }
 
   // then we can triangulate polygon here
-  for (int i = 2; i < curr_vertices.size(); i++) {
+  std::array<ShadedVertex, MaxPolygon> const &curr_vertices = buffers[curr];
+  for (uint32_t i = 2; i < curr_size; i++) {
     emit_vertex(curr_vertices[0]);
     emit_vertex(curr_vertices[i - 1]);
     emit_vertex(curr_vertices[i]);
   }
+  return count;
 }
 
 // -------------------------------------------------------------------------
@@ -462,6 +769,15 @@ template<PrimitiveType p, class P, uint32_t flags>
 void Pipeline<p, P, flags>::rasterize_line(
 	ClippedVertex const& va, ClippedVertex const& vb,
 	std::function<void(Fragment const&)> const& emit_fragment) {
+	rasterize_line(va, vb, emit_fragment, Scissor::everything());
+}
+
+template<PrimitiveType p, class P, uint32_t flags>
+template<typename EmitFragment>
+void Pipeline<p, P, flags>::rasterize_line(
+	ClippedVertex const& va, ClippedVertex const& vb,
+	EmitFragment const& emit_fragment,
+	Scissor const& scissor) {
 	if constexpr ((flags & PipelineMask_Interp) != Pipeline_Interp_Flat) {
 		assert(0 && "rasterize_line should only be invoked in flat interpolation mode.");
 	}
@@ -471,7 +787,8 @@ void Pipeline<p, P, flags>::rasterize_line(
 	// this function!
 	// The OpenGL specification section 3.5 may also come in handy.
 
-	auto gen_fragment = [&emit_fragment,&va,&vb](float x,float y) -> void {
+	auto gen_fragment = [&emit_fragment,&va,&vb,&scissor](float x,float y) -> void {
+		if (!scissor.contains(static_cast<int32_t>(std::floor(x)), static_cast<int32_t>(std::floor(y)))) return;
 		// // check intersection here
 		// float t_min{}, t_max{};
 		// if(!Util::line_diamond_intersection(start.fb_position.xy(), end.fb_position.xy(), Vec2{x,y}, t_min, t_max)) {
@@ -733,148 +1050,375 @@ template<PrimitiveType p, class P, uint32_t flags>
 void Pipeline<p, P, flags>::rasterize_triangle(
 	ClippedVertex const& va, ClippedVertex const& vb, ClippedVertex const& vc,
 	std::function<void(Fragment const&)> const& emit_fragment) {
-	// NOTE: it is okay to restructure this function to allow these tasks to use the
-	//  same code paths. Be aware, however, that all of them need to remain working!
-	//  (e.g., if you break Flat while implementing Correct, you won't get points
-	//   for Flat.)
-/*
-	if constexpr ((flags & PipelineMask_Interp) == Pipeline_Interp_Flat) {
-*/
-		// A1T3: flat triangles
-		// TODO: rasterize triangle (see block comment above this function).
-		// calculate bbox of va,vb and vc
-		auto min_vec2 = [](Vec2 a, Vec2 b) -> Vec2 {
-			return Vec2{ std::min(a.x,b.x), std::min(a.y,b.y) };
-		};
-		auto max_vec2 = [](Vec2 a, Vec2 b) -> Vec2 {
-			return Vec2{ std::max(a.x,b.x), std::max(a.y,b.y) }; 
-		};
+	NoDepth depth;
+	auto emit = [&](Fragment const& f, uint64_t) { emit_fragment(f); };
+	rasterize_triangle(va, vb, vc, emit, Scissor::everything(), Samples(), depth);
+}
+
+template<PrimitiveType p, class P, uint32_t flags>
+template<typename EmitFragment, typename Depth>
+void Pipeline<p, P, flags>::rasterize_triangle(
+	ClippedVertex const& va, ClippedVertex const& vb, ClippedVertex const& vc,
+	EmitFragment const& emit_fragment,
+	Scissor const& scissor,
+	Samples const& samples,
+	Depth& depth) {
+	// Coverage comes from integer edge functions over vertex positions snapped to 1/Steps of a pixel,
+	//  so it is exact and the fill rule below can't double-cover or crack shared edges.
+	// Pixels are visited in blocks (rejected or accepted whole when the edges or depths allow) and then 2x2 quads,
+	//  every sample of a quad is tested against the edges at once (sample offsets are on the same grid, so this is
+	//  exact too), and attributes are only interpolated for covered pixels with samples that pass the depth test.
+	constexpr int64_t Steps = SubpixelSteps; //subpixel steps per pixel
+	constexpr int32_t Block = int32_t(BlockSize);
+	uint32_t const S = samples.count;
+	assert(S >= 1 && S <= MaxSamples);
+	uint64_t const all_samples = (S == 64 ? ~uint64_t(0) : (uint64_t(1) << S) - 1);
+
+	//framebuffers are at most 4096 pixels across (and clipped vertices lie in or just around them), so
+	// snapped coordinates need ~21 bits and edge functions ~43 bits; refuse anything wild (or NaN):
+	constexpr float Limit = float(1 << 16);
+	for (ClippedVertex const* v : {&va, &vb, &vc}) {
+		if (!(std::abs(v->fb_position.x) < Limit && std::abs(v->fb_position.y) < Limit)) return;
+	}
+
+	//vertices in counter-clockwise order (Flat interpolation always uses va, which stays first):
+	std::array< ClippedVertex const*, 3 > v{&va, &vb, &vc};
+	std::array< int64_t, 3 > X, Y;
+	for (uint32_t i = 0; i < 3; ++i) {
+		X[i] = std::llround(v[i]->fb_position.x * float(Steps));
+		Y[i] = std::llround(v[i]->fb_position.y * float(Steps));
+	}
+	int64_t area = (X[1] - X[0]) * (Y[2] - Y[0]) - (Y[1] - Y[0]) * (X[2] - X[0]);
+	if (area == 0) return; //degenerate triangles cover nothing
+	if (area < 0) {
+		std::swap(v[1], v[2]);
+		std::swap(X[1], X[2]);
+		std::swap(Y[1], Y[2]);
+		area = -area;
+	}
 
-		Vec2 p0 = va.fb_position.xy();
-		Vec2 p1 = vb.fb_position.xy();
-		Vec2 p2 = vc.fb_position.xy();
+	//edge k runs between the two vertices other than k, so edge k / area is the barycentric weight of vertex k:
+	// E_k(x,y) = E[k] + A[k] * x + B[k] * y at the center of pixel (x,y), positive inside,
+	// and sample s of the pixel is D[k][s] away from that.
+	//A sample exactly on an edge belongs to the triangle only if the edge is a left edge or a horizontal
+	// bottom edge (the usual top-left rule, with y pointing up), which the -1 bias on other edges implements:
+	std::array< int64_t, 3 > A, B, E;
+	std::array< std::array< int64_t, MaxSamples >, 3 > D;
+	std::array< int64_t, 3 > D_lo, D_hi; //range of D[k] over the samples
+	for (uint32_t k = 0; k < 3; ++k) {
+		uint32_t i = (k + 1) % 3, j = (k + 2) % 3;
+		int64_t dx = X[j] - X[i], dy = Y[j] - Y[i];
+		A[k] = -dy * Steps;
+		B[k] = dx * Steps;
+		bool owned = dy < 0 || (dy == 0 && dx > 0);
+		E[k] = dx * (Steps / 2 - Y[i]) - dy * (Steps / 2 - X[i]) - (owned ? 0 : 1);
+		D_lo[k] = std::numeric_limits< int64_t >::max();
+		D_hi[k] = std::numeric_limits< int64_t >::min();
+		for (uint32_t s = 0; s < S; ++s) {
+			D[k][s] = dx * samples.y[s] - dy * samples.x[s];
+			D_lo[k] = std::min(D_lo[k], D[k][s]);
+			D_hi[k] = std::max(D_hi[k], D[k][s]);
+		}
+		//(a single sample's offset is moved into the edges, so only several samples need D)
+		if (S == 1) {
+			E[k] += D[k][0];
+			D[k][0] = D_lo[k] = D_hi[k] = 0;
+		}
+	}
+	auto edge_at = [&](uint32_t k, int32_t x, int32_t y) {
+		return E[k] + A[k] * x + B[k] * y;
+	};
 
-		Vec2 p_min = min_vec2(p0,min_vec2(p1,p2));
-		Vec2 p_max = max_vec2(p0,max_vec2(p1,p2));
+	//pixels that might have a sample covered, limited to the scissor:
+	int32_t sx_lo = *std::min_element(samples.x.begin(), samples.x.begin() + S);
+	int32_t sx_hi = *std::max_element(samples.x.begin(), samples.x.begin() + S);
+	int32_t sy_lo = *std::min_element(samples.y.begin(), samples.y.begin() + S);
+	int32_t sy_hi = *std::max_element(samples.y.begin(), samples.y.begin() + S);
+	int64_t x_begin = std::max< int64_t >(scissor.x_begin, (std::min({X[0], X[1], X[2]}) - Steps / 2 - sx_hi + Steps - 1) >> 8);
+	int64_t y_begin = std::max< int64_t >(scissor.y_begin, (std::min({Y[0], Y[1], Y[2]}) - Steps / 2 - sy_hi + Steps - 1) >> 8);
+	int64_t x_end = std::min< int64_t >(scissor.x_end, ((std::max({X[0], X[1], X[2]}) - Steps / 2 - sx_lo) >> 8) + 1);
+	int64_t y_end = std::min< int64_t >(scissor.y_end, ((std::max({Y[0], Y[1], Y[2]}) - Steps / 2 - sy_lo) >> 8) + 1);
+	static_assert(Steps == (1 << 8), "bounds above shift by log2(Steps)");
+	if (x_begin >= x_end || y_begin >= y_end) return;
+
+	//blocks (and so quads) are aligned to multiples of Block, so every pixel lands in the same quad whatever the scissor:
+	int32_t bx_begin = int32_t(x_begin) & ~(Block - 1);
+	int32_t by_begin = int32_t(y_begin) & ~(Block - 1);
+
+	//the nearest the triangle gets (interpolated depths stay between the vertices' depths, give or take rounding):
+	float z_near = std::min({va.fb_position.z, vb.fb_position.z, vc.fb_position.z}) - 1e-6f;
+	auto visible = [&]() {
+		for (int32_t by = by_begin; by < y_end; by += Block) {
+			for (int32_t bx = bx_begin; bx < x_end; bx += Block) {
+				if (!depth.hidden(bx, by, z_near)) return true;
+			}
+		}
+		return false;
+	};
+	if (!visible()) return;
+
+	//interpolation, from the barycentric weights of v[1] and v[2]:
+	float inv_area = 1.0f / float(area);
+	std::array< float, FA > delta1{}, delta2{}; //attribute differences from v[0] (Smooth)
+	std::array< float, FA > weighted0{}, weighted1{}, weighted2{}; //attributes * inv_w (Correct)
+	for (uint32_t i = 0; i < FA; ++i) {
+		delta1[i] = v[1]->attributes[i] - v[0]->attributes[i];
+		delta2[i] = v[2]->attributes[i] - v[0]->attributes[i];
+		weighted0[i] = v[0]->attributes[i] * v[0]->inv_w;
+		weighted1[i] = v[1]->attributes[i] * v[1]->inv_w;
+		weighted2[i] = v[2]->attributes[i] * v[2]->inv_w;
+	}
+	std::array< float, 3 > z_w{
+		v[0]->fb_position.z * v[0]->inv_w, v[1]->fb_position.z * v[1]->inv_w, v[2]->fb_position.z * v[2]->inv_w
+	};
 
-		int x_start = static_cast<int>(std::floor(p_min.x));
-		int x_end = static_cast<int>(std::ceil(p_max.x));
-		int y_start = static_cast<int>(std::floor(p_min.y));
-		int y_end = static_cast<int>(std::ceil(p_max.y));
+	//derivatives are the same everywhere for Flat (zero) and Smooth (the attribute plane's slope):
+	std::array< Vec2, FD > derivatives{};
+	if constexpr ((flags & PipelineMask_Interp) == Pipeline_Interp_Smooth) {
+		Vec2 d1 = Vec2{float(A[1]), float(B[1])} * inv_area;
+		Vec2 d2 = Vec2{float(A[2]), float(B[2])} * inv_area;
+		for (uint32_t i = 0; i < FD; ++i) {
+			derivatives[i] = delta1[i] * d1 + delta2[i] * d2;
+		}
+	}
 
-		auto inside_triangle = [](Vec2 p0, Vec2 p1, Vec2 p2, Vec2 pp) -> bool {
-			Vec2 a = p1 - p0;
-			Vec2 a1 = pp - p0;
-			Vec2 b = p2 - p1;
-			Vec2 b1 = pp - p1;
-			Vec2 c = p0 - p2;
-			Vec2 c1 = pp - p2;
+	auto interpolate_depth = [&](float w1, float w2) {
+		float w0 = 1.0f - w1 - w2;
+		float inv_w = w0 * v[0]->inv_w + w1 * v[1]->inv_w + w2 * v[2]->inv_w;
+		return (w0 * z_w[0] + w1 * z_w[1] + w2 * z_w[2]) / inv_w;
+	};
+	auto interpolate_attributes = [&](float w1, float w2, Fragment& f) {
+		float w0 = 1.0f - w1 - w2;
+		if constexpr ((flags & PipelineMask_Interp) == Pipeline_Interp_Flat) {
+			f.attributes = va.attributes;
+		} else if constexpr ((flags & PipelineMask_Interp) == Pipeline_Interp_Smooth) {
+			for (uint32_t i = 0; i < FA; ++i) {
+				f.attributes[i] = v[0]->attributes[i] + w1 * delta1[i] + w2 * delta2[i];
+			}
+		} else if constexpr ((flags & PipelineMask_Interp) == Pipeline_Interp_Correct) {
+			float w = 1.0f / (w0 * v[0]->inv_w + w1 * v[1]->inv_w + w2 * v[2]->inv_w);
+			for (uint32_t i = 0; i < FA; ++i) {
+				f.attributes[i] = (w0 * weighted0[i] + w1 * weighted1[i] + w2 * weighted2[i]) * w;
+			}
+		}
+	};
 
-			auto cross = [](Vec2 a, Vec2 b) -> float {
-				return (a.x * b.y - a.y * b.x);
+	//which pixels of the quad at (x,y) the edges cover at one sample, as bits (dy * 2 + dx), from the edges there:
+#ifdef SCOTTY3D_SSE
+	//(two 64-bit lanes per row of the quad; a lane is outside when its sign bit is set)
+	__m128i row0[3], row1[3];
+	for (uint32_t k = 0; k < 3; ++k) {
+		row0[k] = _mm_set_epi64x(A[k], 0);
+		row1[k] = _mm_set_epi64x(A[k] + B[k], B[k]);
+	}
+	auto quad_coverage = [&](std::array< int64_t, 3 > const& e) -> uint32_t {
+		int outside = 0;
+		for (uint32_t k = 0; k < 3; ++k) {
+			__m128i at = _mm_set1_epi64x(e[k]);
+			outside |= _mm_movemask_pd(_mm_castsi128_pd(_mm_add_epi64(at, row0[k])));
+			outside |= _mm_movemask_pd(_mm_castsi128_pd(_mm_add_epi64(at, row1[k]))) << 2;
+		}
+		return ~uint32_t(outside) & 0xf;
+	};
+	//which samples of one pixel the edges cover, as bits, from the edges at its center (two samples per lane pair):
+	__m128i D_pairs[3][MaxSamples / 2];
+	if (S > 1) {
+		for (uint32_t k = 0; k < 3; ++k) {
+			for (uint32_t s = 0; s < S; s += 2) {
+				D_pairs[k][s / 2] = _mm_set_epi64x(s + 1 < S ? D[k][s + 1] : 0, D[k][s]);
+			}
+		}
+	}
+	auto sample_coverage = [&](std::array< int64_t, 3 > const& e) -> uint64_t {
+		uint64_t outside = 0;
+		for (uint32_t k = 0; k < 3; ++k) {
+			__m128i at = _mm_set1_epi64x(e[k]);
+			for (uint32_t s = 0; s < S; s += 2) {
+				outside |= uint64_t(_mm_movemask_pd(_mm_castsi128_pd(_mm_add_epi64(at, D_pairs[k][s / 2])))) << s;
+			}
+		}
+		return ~outside & all_samples;
+	};
+#else
+	auto quad_coverage = [&](std::array< int64_t, 3 > const& e) -> uint32_t {
+		uint32_t covered = 0xf;
+		for (uint32_t k = 0; k < 3; ++k) {
+			if (e[k] < 0) covered &= ~0x1u;
+			if (e[k] + A[k] < 0) covered &= ~0x2u;
+			if (e[k] + B[k] < 0) covered &= ~0x4u;
+			if (e[k] + A[k] + B[k] < 0) covered &= ~0x8u;
+		}
+		return covered;
+	};
+	auto sample_coverage = [&](std::array< int64_t, 3 > const& e) -> uint64_t {
+		uint64_t covered = all_samples;
+		for (uint32_t k = 0; k < 3; ++k) {
+			for (uint32_t s = 0; s < S; ++s) {
+				if (e[k] + D[k][s] < 0) covered &= ~(uint64_t(1) << s);
+			}
+		}
+		return covered;
+	};
+#endif
+
+	//the rest is compiled separately for one sample (by far the most common case) and for several:
+	auto rasterize_blocks = [&](auto single) {
+		constexpr bool Single = decltype(single)::value;
+
+		//emit the covered pixels (or samples) of the quad at (x,y), given the edges there, the covered pixels
+		// (as bits dy * 2 + dx), and, for several samples, the covered samples of each pixel:
+		auto draw_quad = [&](int32_t x, int32_t y, std::array< int64_t, 3 > const& e, uint32_t covered, std::array< uint64_t, 4 > masks) {
+			//barycentric weights of pixel q at sample s (or at its center, for s = -1U):
+			std::array< std::array< int64_t, 3 >, 4 > centers;
+			for (uint32_t q = 0; q < 4; ++q) {
+				int64_t dx = q & 1, dy = q >> 1;
+				for (uint32_t k = 0; k < 3; ++k) centers[q][k] = e[k] + A[k] * dx + B[k] * dy;
+			}
+			auto weights = [&](uint32_t q, uint32_t s, float& w1, float& w2) {
+				w1 = float(centers[q][1] + (s == -1U ? 0 : D[1][s])) * inv_area;
+				w2 = float(centers[q][2] + (s == -1U ? 0 : D[2][s])) * inv_area;
 			};
 
-			float e0 = cross(a,a1);
-			float e1 = cross(b,b1);
-			float e2 = cross(c,c1);
-			// for both CCW and CW
-			return (e0 >= 0.0f && e1 >= 0.0f && e2 >= 0.0f) || (e0 <= 0.0f && e1 <= 0.0f && e2 <= 0.0f);
-		};
+			//fragments of the quad, interpolated at (weights) w1, w2:
+			std::array< Fragment, 4 > frags;
+			std::array< float, 4 > w1, w2;
+			for (uint32_t q = 0; q < 4; ++q) {
+				weights(q, -1U, w1[q], w2[q]);
+				frags[q].fb_position = Vec3{float(x + int32_t(q & 1)) + 0.5f, float(y + int32_t(q >> 1)) + 0.5f, 0.0f};
+			}
 
-		auto gen_fragment = [&va,&vb,&vc,p0,p1,p2,&inside_triangle](Vec2 pp, Fragment& f) -> bool {
-			// calculate barycentric coordinate of pp inside triangle p0,p1,p2 (as 2D triangle)
-			float gamma = ((p0.y - p1.y) * pp.x + (p1.x - p0.x) * pp.y + p0.x * p1.y - p1.x * p0.y) / ((p0.y - p1.y) * p2.x + (p1.x - p0.x) * p2.y + p0.x * p1.y - p1.x * p0.y);
-			float beta = ((p0.y - p2.y) * pp.x + (p2.x - p0.x) * pp.y + p0.x * p2.y - p2.x * p0.y) / ((p0.y - p2.y) * p1.x + (p2.x - p0.x) * p1.y + p0.x * p2.y - p2.x * p0.y);
-			float alpha = 1.0f - beta - gamma;
-			float z_w_div = alpha * va.fb_position.z * va.inv_w + beta * vb.fb_position.z * vb.inv_w + gamma * vc.fb_position.z * vc.inv_w;
-			float inv_w = alpha * va.inv_w + beta * vb.inv_w + gamma * vc.inv_w;
-			float z = z_w_div / inv_w;
-			f.fb_position = Vec3{ pp.x,pp.y,z };
-			f.derivatives.fill(Vec2{0.0f,0.0f});
-			if constexpr ((flags & PipelineMask_Interp) == Pipeline_Interp_Flat) {
-				f.attributes = va.attributes;
-			} else if constexpr ((flags & PipelineMask_Interp) == Pipeline_Interp_Smooth) {					
-				for(int i=0;i<FA;i++) {
-					float a = alpha * va.attributes[i] + beta * vb.attributes[i] + gamma * vc.attributes[i];
-					f.attributes[i] = a;
+			//depth test before interpolating anything else:
+			if constexpr (Single) {
+				for (uint32_t q = 0; q < 4; ++q) {
+					if (!((covered >> q) & 1)) continue;
+					frags[q].fb_position.z = interpolate_depth(w1[q], w2[q]);
+					if (!depth.test(x + int32_t(q & 1), y + int32_t(q >> 1), 0, frags[q].fb_position.z)) covered &= ~(1u << q);
 				}
-			} else if constexpr ((flags & PipelineMask_Interp) == Pipeline_Interp_Correct) {
-				for(int i=0;i<FA;i++) {
-					float a = alpha * va.attributes[i] * va.inv_w + beta * vb.attributes[i] * vb.inv_w + gamma * vc.attributes[i] * vc.inv_w;
-					f.attributes[i] = a / inv_w;
+			} else {
+				for (uint32_t q = 0; q < 4; ++q) {
+					for (uint32_t s = 0; s < S; ++s) {
+						if (!((masks[q] >> s) & 1)) continue;
+						float sw1, sw2;
+						weights(q, s, sw1, sw2);
+						if (!depth.test(x + int32_t(q & 1), y + int32_t(q >> 1), s, interpolate_depth(sw1, sw2))) masks[q] &= ~(uint64_t(1) << s);
+					}
+					if (!masks[q]) covered &= ~(1u << q);
 				}
 			}
-			if(inside_triangle(p0,p1,p2,pp)) {
-				return true;
-			}
-			return false;
-		};
-		
-		// here we should rasterize this triangle with 2x2 tile once
-		for(int i=x_start;i<=x_end;i+=2) {
-			for(int j=y_start;j<=y_end;j+=2) {
-				std::array<Fragment, 4> frags{};
-				std::array<bool,4> emit_flags{};
-				std::array<Vec2, 4> points {
-					// 0b00
-					Vec2{static_cast<float>(i) + 0.5f,static_cast<float>(j) + 0.5f  },
-					// 0b01
-					Vec2{static_cast<float>(i) + 0.5f,static_cast<float>(j + 1) + 0.5f  },
-					// 0b10
-					Vec2{static_cast<float>(i + 1) + 0.5f,static_cast<float>(j) + 0.5f  },
-					// 0b11
-					Vec2{static_cast<float>(i + 1) + 0.5f,static_cast<float>(j + 1) + 0.5f  }
-				};
-				emit_flags[0] = gen_fragment(points[0],frags[0]);
-				emit_flags[1] = gen_fragment(points[1],frags[1]);
-				emit_flags[2] = gen_fragment(points[2],frags[2]);
-				emit_flags[3] = gen_fragment(points[3],frags[3]);
-				std::array<Vec2, FD> derivatives{};
-				for(int d_i=0;d_i<FD;d_i++) {
-					derivatives[d_i].x = frags[0b10].attributes[d_i] - frags[0b00].attributes[d_i];
-					derivatives[d_i].y = frags[0b01].attributes[d_i] - frags[0b00].attributes[d_i];
+			if (covered == 0 || depth.depth_only) return;
+
+			auto interpolate_quad = [&](uint32_t pixels) {
+				for (uint32_t q = 0; q < 4; ++q) {
+					//(Correct derivatives are differences across the quad, so need the pixels at dx = 1 and dy = 1 even when not covered)
+					bool needed = (pixels >> q) & 1;
+					if constexpr ((flags & PipelineMask_Interp) == Pipeline_Interp_Correct) needed = needed || q != 3;
+					if (needed) interpolate_attributes(w1[q], w2[q], frags[q]);
 				}
-				if (emit_flags[0b00]) {
-					frags[0b00].derivatives = derivatives;
-					emit_fragment(frags[0b00]);	
+				if constexpr ((flags & PipelineMask_Interp) == Pipeline_Interp_Correct) {
+					for (uint32_t i = 0; i < FD; ++i) {
+						derivatives[i].x = frags[1].attributes[i] - frags[0].attributes[i];
+						derivatives[i].y = frags[2].attributes[i] - frags[0].attributes[i];
+					}
 				}
-				if (emit_flags[0b01]) {
-					frags[0b01].derivatives = derivatives;
-					emit_fragment(frags[0b01]);	
+			};
+
+			if constexpr (Single) {
+				interpolate_quad(covered);
+				for (uint32_t q = 0; q < 4; ++q) {
+					if (!((covered >> q) & 1)) continue;
+					frags[q].derivatives = derivatives;
+					emit_fragment(frags[q], 1);
 				}
-				if (emit_flags[0b10]) {
-					frags[0b10].derivatives = derivatives;
-					emit_fragment(frags[0b10]);	
+			} else if constexpr ((flags & Pipeline_SampleShadingBit) != 0) {
+				//every covered sample, interpolated there:
+				for (uint32_t s = 0; s < S; ++s) {
+					uint32_t pixels = 0;
+					for (uint32_t q = 0; q < 4; ++q) {
+						if ((masks[q] >> s) & 1) pixels |= 1u << q;
+					}
+					if (pixels == 0) continue;
+					for (uint32_t q = 0; q < 4; ++q) {
+						weights(q, s, w1[q], w2[q]);
+						frags[q].fb_position.z = interpolate_depth(w1[q], w2[q]);
+					}
+					interpolate_quad(pixels);
+					for (uint32_t q = 0; q < 4; ++q) {
+						if (!((pixels >> q) & 1)) continue;
+						frags[q].derivatives = derivatives;
+						emit_fragment(frags[q], uint64_t(1) << s);
+					}
 				}
-				if (emit_flags[0b11]) {
-					frags[0b11].derivatives = derivatives;
-					emit_fragment(frags[0b11]);	
+			} else {
+				//once per pixel, at the center:
+				interpolate_quad(covered);
+				for (uint32_t q = 0; q < 4; ++q) {
+					if (!((covered >> q) & 1)) continue;
+					//a center outside the triangle could be far outside its attributes' range, so use a covered sample instead:
+					if (std::min({centers[q][0], centers[q][1], centers[q][2]}) < 0) {
+						uint32_t s = 0;
+						while (!((masks[q] >> s) & 1)) ++s;
+						weights(q, s, w1[q], w2[q]);
+						interpolate_attributes(w1[q], w2[q], frags[q]);
+					}
+					frags[q].fb_position.z = interpolate_depth(w1[q], w2[q]);
+					frags[q].derivatives = derivatives;
+					emit_fragment(frags[q], masks[q]);
 				}
 			}
-		}
+		};
 
-/*
-		// As a placeholder, here's code that draws some lines:
-		//(remove this and replace it with a real solution)
-		// Pipeline<PrimitiveType::Lines, P, flags>::rasterize_line(va, vb, emit_fragment);
-		// Pipeline<PrimitiveType::Lines, P, flags>::rasterize_line(vb, vc, emit_fragment);
-		// Pipeline<PrimitiveType::Lines, P, flags>::rasterize_line(vc, va, emit_fragment);
-	} else if constexpr ((flags & PipelineMask_Interp) == Pipeline_Interp_Smooth) {
-		// A1T5: screen-space smooth triangles
-		// TODO: rasterize triangle (see block comment above this function).
-
-		// As a placeholder, here's code that calls the Flat interpolation version of the function:
-		//(remove this and replace it with a real solution)
-		Pipeline<PrimitiveType::Lines, P, (flags & ~PipelineMask_Interp) | Pipeline_Interp_Flat>::rasterize_triangle(va, vb, vc, emit_fragment);
-	} else if constexpr ((flags & PipelineMask_Interp) == Pipeline_Interp_Correct) {
-		// A1T5: perspective correct triangles
-		// TODO: rasterize triangle (block comment above this function).
-
-		// As a placeholder, here's code that calls the Screen-space interpolation function:
-		//(remove this and replace it with a real solution)
-		Pipeline<PrimitiveType::Lines, P, (flags & ~PipelineMask_Interp) | Pipeline_Interp_Smooth>::rasterize_triangle(va, vb, vc, emit_fragment);
-	}
-*/
+		for (int32_t by = by_begin; by < y_end; by += Block) {
+			for (int32_t bx = bx_begin; bx < x_end; bx += Block) {
+				//edges at the block's corner pixels (and the samples' range around them) give the edges' range over the whole block:
+				bool accept = true;
+				bool reject = false;
+				std::array< int64_t, 3 > e;
+				for (uint32_t k = 0; k < 3; ++k) {
+					e[k] = edge_at(k, bx, by);
+					int64_t step_x = A[k] * (Block - 1), step_y = B[k] * (Block - 1);
+					int64_t lo = e[k] + std::min< int64_t >(step_x, 0) + std::min< int64_t >(step_y, 0) + D_lo[k];
+					int64_t hi = e[k] + std::max< int64_t >(step_x, 0) + std::max< int64_t >(step_y, 0) + D_hi[k];
+					accept = accept && lo >= 0;
+					reject = reject || hi < 0;
+				}
+				if (reject || depth.hidden(bx, by, z_near)) continue;
+
+				//pixels of the block inside the bounds, as quad coverage bits:
+				bool clipped = bx < x_begin || by < y_begin || bx + Block > x_end || by + Block > y_end;
+				auto bounds_mask = [&](int32_t x, int32_t y) -> uint32_t {
+					uint32_t mask = 0;
+					for (uint32_t q = 0; q < 4; ++q) {
+						int32_t px = x + int32_t(q & 1), py = y + int32_t(q >> 1);
+						if (px >= x_begin && px < x_end && py >= y_begin && py < y_end) mask |= 1u << q;
+					}
+					return mask;
+				};
+
+				for (int32_t y = by; y < by + Block; y += 2) {
+					std::array< int64_t, 3 > row{edge_at(0, bx, y), edge_at(1, bx, y), edge_at(2, bx, y)};
+					for (int32_t x = bx; x < bx + Block; x += 2) {
+						uint32_t covered = (accept ? 0xfu : 0u);
+						std::array< uint64_t, 4 > masks{};
+						if constexpr (Single) {
+							if (!accept) covered = quad_coverage(row);
+						} else {
+							for (uint32_t q = 0; q < 4; ++q) {
+								int64_t dx = q & 1, dy = q >> 1;
+								masks[q] = (accept ? all_samples : sample_coverage({row[0] + A[0] * dx + B[0] * dy, row[1] + A[1] * dx + B[1] * dy, row[2] + A[2] * dx + B[2] * dy}));
+								if (masks[q]) covered |= 1u << q;
+							}
+						}
+						if (clipped) covered &= bounds_mask(x, y);
+						if (covered) draw_quad(x, y, row, covered, masks);
+						for (uint32_t k = 0; k < 3; ++k) row[k] += 2 * A[k];
+					}
+				}
+				if (accept && !clipped) depth.tested(bx, by);
+			}
+		}
+	};
+	if (S == 1) rasterize_blocks(std::true_type());
+	else rasterize_blocks(std::false_type());
 }
 
 //-------------------------------------------------------------------------
@@ -26,6 +26,8 @@ enum PipelineFlags : uint32_t {
 
 	Pipeline_ColorWriteDisableBit = 0x4000, //if 1, color buffer writes are disabled
 
+	Pipeline_SampleShadingBit     = 0x2000, //if 1, triangles are shaded at every covered sample (not once per pixel)
+
 	Pipeline_Blend_Replace  = 0x0, //incoming fragment color replaces framebuffer color
 	Pipeline_Blend_Add      = 0x1, //incoming fragment color sums with framebuffer color
 	Pipeline_Blend_Over     = 0x2, //incoming fragment color is 'over blended' using opacity
@@ -104,7 +106,8 @@ struct Pipeline {
 	//(1) starts with an array of Vertices:
 	using Vertex = ::Vertex<VA>;
 
-	//(2) transforms these vertices via Program::shade_vertex to produce ShadedVertices:
+	//(2) transforms these vertices via Program::shade_vertex to produce ShadedVertices
+	//    (programs may also provide shade_vertices, to shade the whole array at once -- e.g., in SIMD batches):
 	using ShadedVertex = ::ShadedVertex<FA>;
 
 	// helper for clip functions:
@@ -122,6 +125,14 @@ struct Pipeline {
 		ShadedVertex const &a, ShadedVertex const &b, ShadedVertex const &c, //input triangle (a,b,c)
 		std::function< void(ShadedVertex const &) > const &emit_vertex //called with vertices of clipped triangle(s)
 	);
+	//run() uses these versions, which write the vertices to 'out' and return how many there are
+	// (so clipping involves no calls through std::function):
+	enum : uint32_t {
+		MaxClippedLineVertices = 2,
+		MaxClippedTriangleVertices = 21, //(clipping to six planes leaves at most a 9-gon, i.e., 7 triangles)
+	};
+	static uint32_t clip_line(ShadedVertex const &a, ShadedVertex const &b, ShadedVertex *out);
+	static uint32_t clip_triangle(ShadedVertex const &a, ShadedVertex const &b, ShadedVertex const &c, ShadedVertex *out);
 
 	//(5) divides by w and scales to compute positions in the framebuffer:
 	using ClippedVertex = ::ClippedVertex<FA>;
@@ -139,7 +150,64 @@ struct Pipeline {
 		std::function< void(Fragment const &) > const &emit_fragment //call with every fragment covered by the triangle
 	);
 
+	//run() rasterizes one screen tile at a time, so the helpers can also be limited to a rectangle of pixels:
+	struct Scissor {
+		int32_t x_begin, y_begin; //first pixel inside
+		int32_t x_end, y_end; //one past the last pixel inside
+		bool contains(int32_t x, int32_t y) const {
+			return x_begin <= x && x < x_end && y_begin <= y && y < y_end;
+		}
+		static Scissor everything();
+	};
+	//(same fragments as above, except that only those whose pixel is inside the scissor are emitted)
+	// these take emit_fragment as any callable, so run() can have fragment processing inlined into rasterization:
+	template< typename EmitFragment >
+	static void rasterize_line(
+		ClippedVertex const &a, ClippedVertex const &b,
+		EmitFragment const &emit_fragment,
+		Scissor const &scissor
+	);
+	//rasterize_triangle covers all of a pixel's samples at once (multisampling by coverage masks):
+	//  samples are offsets from the pixel center, in the 1/SubpixelSteps of a pixel that vertices are snapped to,
+	//  and at most MaxSamples are covered in one call, so each pixel's coverage fits in a uint64_t mask
+	//  (the default is one sample, at the center)
+	enum : uint32_t { SubpixelSteps = 256, MaxSamples = 64 };
+	struct Samples {
+		uint32_t count = 1;
+		std::array< int32_t, MaxSamples > x{}, y{};
+	};
+	//emit_fragment(frag, mask) is called once per pixel with some samples covered, with bit s of mask set if
+	// sample s is covered and passed the depth test; fragments are interpolated at the pixel center (or at a covered
+	// sample, if the center is outside the triangle), so each pixel is shaded once however many samples it has.
+	// (with Pipeline_SampleShadingBit, it is instead called for every covered sample, interpolated there, with one bit set)
+	//rasterize_triangle also visits pixels in BlockSize x BlockSize blocks, and uses 'depth' to skip hidden work:
+	//  depth.hidden(x, y, z) says whether every sample of the block at (x,y) is already nearer than depth z
+	//  depth.test(x, y, s, z) depth tests (and writes) sample s of pixel (x,y) before attributes are interpolated
+	//  depth.tested(x, y) is called after every sample of the block at (x,y) has been tested
+	//  if depth.depth_only is set, fragments are only depth tested (nothing is emitted)
+	enum : uint32_t { BlockSize = 8 };
+	struct NoDepth { //(hides nothing and passes everything; used by the std::function versions)
+		bool depth_only = false;
+		bool hidden(int32_t, int32_t, float) const { return false; }
+		bool test(int32_t, int32_t, uint32_t, float) const { return true; }
+		void tested(int32_t, int32_t) const { }
+	};
+	template< typename EmitFragment, typename Depth >
+	static void rasterize_triangle(
+		ClippedVertex const &a, ClippedVertex const &b, ClippedVertex const &c,
+		EmitFragment const &emit_fragment,
+		Scissor const &scissor,
+		Samples const &samples,
+		Depth &depth
+	);
+
 	//(7) tests fragment depths vs depth buffer (based on flags)
+	//    as each fragment is rasterized (fragments are processed as they stream out of
+	//    rasterization and never stored, so (7)-(9) need no memory per fragment)
+	//    Programs never change depth, so triangles are depth tested before their attributes are interpolated,
+	//    and whole blocks are skipped using the farthest depth in each block ("hierarchical z");
+	//    with Blend_Replace and Depth_Less, each tile is drawn in two passes -- depth only, then shading just
+	//    the fragments that ended up in front -- so every pixel is shaded about once, whatever the overdraw.
 
 	//(8) transforms fragments via Program::shade_fragment() to produce a color and opacity, stored
 	//	  in a ShadedFragment:
@@ -147,10 +215,28 @@ struct Pipeline {
 
 	//(9) writes color and/or depth to framebuffer (based on flags)
 
+	// Steps (6)-(9) are done per screen tile of TileSize x TileSize pixels, in parallel:
+	//  primitives are binned into the tiles they overlap (in order), so each pixel still sees
+	//  its fragments in primitive order, and Blend_Add / Blend_Over give the same results.
+	enum : uint32_t { TileSize = 64 };
+	static_assert(TileSize % BlockSize == 0, "tiles are made of whole blocks");
+
 	// The "run" function wraps the above steps:
 	// 		vertices: list of vertices to rasterize
 	//  	parameters: global parameters for vertex and fragment programs
 	//  	framebuffer (must not be null): framebuffer to write results into
 	static void run(std::vector<Vertex> const& vertices,
 	                typename Program::Parameters const& parameters, Framebuffer* framebuffer);
+
+	// Indexed version, for meshes whose primitives share vertices:
+	//		indices: corners of each primitive, as indices into vertices (throws if any is out of range)
+	// Each vertex is shaded once, however many primitives use it.
+	static void run(std::vector<Vertex> const& vertices, std::vector<uint32_t> const& indices,
+	                typename Program::Parameters const& parameters, Framebuffer* framebuffer);
+
+private:
+	// both versions of run() share this, with corner_vertex(i) giving the vertex at corner i:
+	template<typename CornerVertex>
+	static void run_corners(std::vector<Vertex> const& vertices, uint32_t corners, CornerVertex const& corner_vertex,
+	                        typename Program::Parameters const& parameters, Framebuffer* framebuffer);
 };
@@ -5,9 +5,12 @@
  *
  */
 
+#include "../lib/batch.h"
 #include "../lib/mathlib.h"
 #include "../scene/texture.h"
 
+#include <vector>
+
 namespace Programs {
 
 struct Lambertian {
@@ -93,6 +96,29 @@ struct Lambertian {
 		fa[FA_NormalZ] = fa_normal.z;
 	}
 
+	// shade_vertex for a whole array of vertices at once
+	//  (same results, but positions and normals are transformed in batches):
+	template< typename Vertex, typename ShadedVertex >
+	static void shade_vertices(Parameters const& parameters, std::vector< Vertex > const& vertices, std::vector< ShadedVertex >* shaded_) {
+		auto& shaded = *shaded_;
+		shaded.resize(vertices.size());
+		if (vertices.empty()) return;
+
+		// vertices and shaded vertices are packed floats, so attributes can be read and written with a stride:
+		static_assert(sizeof(Vertex) % sizeof(float) == 0 && sizeof(ShadedVertex) % sizeof(float) == 0);
+		constexpr size_t in_stride = sizeof(Vertex) / sizeof(float);
+		constexpr size_t out_stride = sizeof(ShadedVertex) / sizeof(float);
+		float const* va = vertices[0].attributes.data();
+		float* fa = shaded[0].attributes.data();
+
+		Batch::transform< Batch::Op::Homogeneous >(parameters.local_to_clip, va + VA_PositionX, in_stride, shaded[0].clip_position.data, out_stride, vertices.size());
+		Batch::transform< Batch::Op::Point >(parameters.normal_to_world, va + VA_NormalX, in_stride, fa + FA_NormalX, out_stride, vertices.size());
+		for (size_t i = 0; i < vertices.size(); ++i) {
+			shaded[i].attributes[FA_TexCoordU] = vertices[i].attributes[VA_TexCoordU];
+			shaded[i].attributes[FA_TexCoordV] = vertices[i].attributes[VA_TexCoordV];
+		}
+	}
+
 	static void shade_fragment(Parameters const& parameters,
 	                           std::array<float, FA> const& fa, // interpolated fragment attributes
 	                           std::array<Vec2, FD> const& fd,  // fragment attribute derivatives
@@ -112,7 +138,7 @@ struct Lambertian {
 
 		// size of texture image:
 		[[maybe_unused]] Vec2 wh =
-			Vec2(float(parameters.image->image.w), float(parameters.image->image.h));
+			Vec2(float(parameters.image->base().w), float(parameters.image->base().h));
 
 		//-----
 		// A1T6: lod
@@ -4,6 +4,7 @@
 #include "../scene/scene.h"
 #include "../util/timer.h"
 #include "framebuffer.h"
+#include "mesh_cache.h"
 #include "pipeline.h"
 #include "programs.h"
 #include "sample_pattern.h"
@@ -136,20 +137,13 @@ struct RasterJob {
 	using Lambertian_Lines_Over_Less_Pipeline =
 		Pipeline<PrimitiveType::Lines, Programs::Lambertian,
 	             Pipeline_Blend_Over | Pipeline_Depth_Less | Pipeline_Interp_Flat>;
-	// Lambertian Vertex used for mesh manipulations
-	using Lambertian_Replace_Less_Correct_Vertex =
-		Lambertian_Triangles_Replace_Less_Correct_Pipeline::Vertex;
-
-	struct Mesh {
-		Halfedge_Mesh source;
-		std::vector<Lambertian_Replace_Less_Correct_Vertex> lamb_triangles;
-		std::vector<Lambertian_Replace_Less_Correct_Vertex> lamb_edges;
-	};
-	std::vector<Mesh> meshes;
+	// meshes converted for Programs::Lambertian (shared with Raster_Mesh_Cache and other jobs):
+	using Mesh = Raster_Mesh;
+	std::vector<std::shared_ptr<Mesh const>> meshes;
 	struct Instance {
 		std::string name; // for DEBUG output
 		Mat4 local_to_world;
-		Mesh* mesh; // pointer into 'meshes' vector, above
+		Mesh const* mesh; // points into a mesh held by the 'meshes' vector, above
 		Material* material; // pointer into 'materials' vector, above
 		DrawStyle draw_style; // draw style (Lines / Flat Triangles / Smooth Triangles / Correct Triangles)
 		BlendStyle blend_style; // blend style (Blend Replace / Blend Add / Blend Over)
@@ -197,6 +191,7 @@ struct RasterJob {
 			if (!local) {
 				if (Textures::Image const* image = std::get_if<Textures::Image>(&to_add.texture)) {
 					images.emplace_back(image->copy());
+					images.back().load();
 					local = &images.back();
 				} else if (Textures::Constant const* constant =
 				               std::get_if<Textures::Constant>(&to_add.texture)) {
@@ -252,35 +247,34 @@ struct RasterJob {
 			return local;
 		};
 
-		// Scene Meshes, Skinned_Meshes, and Shapes get converted to Mesh structs:
+		// Scene Meshes, Skinned_Meshes, and Shapes get converted to Mesh structs
+		// (via Raster_Mesh_Cache, which reuses conversions from earlier renders of unchanged meshes):
+		Raster_Mesh_Cache& mesh_cache = Raster_Mesh_Cache::get();
 		meshes.reserve(1 + scene.meshes.size() + scene.skinned_meshes.size());
-		std::unordered_map<Halfedge_Mesh const*, Mesh*> mesh_to_local;
-		auto add_mesh = [&](Halfedge_Mesh const& to_add) -> Mesh* {
-			Mesh*& local = mesh_to_local.emplace(&to_add, nullptr).first->second;
+		std::unordered_map<Halfedge_Mesh const*, Mesh const*> mesh_to_local;
+		auto add_mesh = [&](std::shared_ptr<Halfedge_Mesh const> const& to_add) -> Mesh const* {
+			Mesh const*& local = mesh_to_local.emplace(to_add.get(), nullptr).first->second;
 			if (!local) {
-				meshes.emplace_back();
-				meshes.back().source = to_add.copy();
-				local = &meshes.back();
+				meshes.emplace_back(mesh_cache.load(to_add));
+				local = meshes.back().get();
 			}
 			return local;
 		};
-		std::unordered_map<Skinned_Mesh const*, Mesh*> skinned_mesh_to_local;
-		auto add_skinned_mesh = [&](Skinned_Mesh const& to_add) -> Mesh* {
-			Mesh*& local = skinned_mesh_to_local.emplace(&to_add, nullptr).first->second;
+		std::unordered_map<Skinned_Mesh const*, Mesh const*> skinned_mesh_to_local;
+		auto add_skinned_mesh = [&](std::shared_ptr<Skinned_Mesh const> const& to_add) -> Mesh const* {
+			Mesh const*& local = skinned_mesh_to_local.emplace(to_add.get(), nullptr).first->second;
 			if (!local) {
-				meshes.emplace_back();
-				meshes.back().source = Halfedge_Mesh::from_indexed_mesh(to_add.posed_mesh());
-				local = &meshes.back();
+				meshes.emplace_back(mesh_cache.load(to_add));
+				local = meshes.back().get();
 			}
 			return local;
 		};
 
-		Mesh* sphere_mesh = nullptr; // will get set if shapes need it
-		auto add_sphere = [&]() -> Mesh* {
+		Mesh const* sphere_mesh = nullptr; // will get set if shapes need it
+		auto add_sphere = [&]() -> Mesh const* {
 			if (!sphere_mesh) {
-				meshes.emplace_back();
-				meshes.back().source = Halfedge_Mesh::from_indexed_mesh(Util::closed_sphere_mesh(1.0f, 2));
-				sphere_mesh = &meshes.back();
+				meshes.emplace_back(mesh_cache.sphere());
+				sphere_mesh = meshes.back().get();
 			}
 			return sphere_mesh;
 		};
@@ -293,7 +287,7 @@ struct RasterJob {
 			instances.emplace_back();
 			instances.back().name = name;
 			instances.back().local_to_world = to_add->transform.lock()->local_to_world();
-			instances.back().mesh = add_mesh(*to_add->mesh.lock());
+			instances.back().mesh = add_mesh(to_add->mesh.lock());
 			instances.back().material = add_material(*to_add->material.lock());
 			instances.back().draw_style = to_add->settings.draw_style;
 			instances.back().blend_style = to_add->settings.blend_style;
@@ -304,7 +298,7 @@ struct RasterJob {
 			instances.emplace_back();
 			instances.back().name = name;
 			instances.back().local_to_world = to_add->transform.lock()->local_to_world();
-			instances.back().mesh = add_skinned_mesh(*to_add->mesh.lock());
+			instances.back().mesh = add_skinned_mesh(to_add->mesh.lock());
 			instances.back().material = add_material(*to_add->material.lock());
 			instances.back().draw_style = to_add->settings.draw_style;
 			instances.back().blend_style = to_add->settings.blend_style;
@@ -361,48 +355,6 @@ struct RasterJob {
 	// actually run the raster job:
 	void run() {
 
-		// helper function that caches triangle attributes for using Programs::Lambertian to draw a
-		// mesh's triangles:
-		auto make_lamb_triangles = [](Mesh* mesh) {
-			if (!mesh->lamb_triangles.empty()) return;
-			Indexed_Mesh indexed =
-				Indexed_Mesh::from_halfedge_mesh(mesh->source, Indexed_Mesh::SplitEdges);
-			std::vector<Indexed_Mesh::Vert> const& vertices = indexed.vertices();
-			std::vector<Indexed_Mesh::Index> const& indices = indexed.indices();
-
-			mesh->lamb_triangles.reserve(indices.size());
-			for (auto i : indices) {
-				Indexed_Mesh::Vert const& iv = vertices[i];
-				Lambertian_Replace_Less_Correct_Vertex v;
-				v.attributes[Programs::Lambertian::VA_PositionX] = iv.pos.x;
-				v.attributes[Programs::Lambertian::VA_PositionY] = iv.pos.y;
-				v.attributes[Programs::Lambertian::VA_PositionZ] = iv.pos.z;
-				v.attributes[Programs::Lambertian::VA_NormalX] = iv.norm.x;
-				v.attributes[Programs::Lambertian::VA_NormalY] = iv.norm.y;
-				v.attributes[Programs::Lambertian::VA_NormalZ] = iv.norm.z;
-				v.attributes[Programs::Lambertian::VA_TexCoordU] = iv.uv.x;
-				v.attributes[Programs::Lambertian::VA_TexCoordV] = iv.uv.y;
-				mesh->lamb_triangles.emplace_back(v);
-			}
-		};
-
-		// helper function that caches triangle attributes for using Programs::Lambertian to draw
-		// lines from a given mesh:
-		auto make_lamb_edges = [&make_lamb_triangles](Mesh* mesh) {
-			if (!mesh->lamb_edges.empty()) return;
-			make_lamb_triangles(mesh);
-			// add all the edges of the triangles:
-			mesh->lamb_edges.reserve(mesh->lamb_triangles.size() * 2);
-			for (uint32_t i = 0; i + 2 < mesh->lamb_triangles.size(); i += 3) {
-				mesh->lamb_edges.emplace_back(mesh->lamb_triangles[i + 0]);
-				mesh->lamb_edges.emplace_back(mesh->lamb_triangles[i + 1]);
-				mesh->lamb_edges.emplace_back(mesh->lamb_triangles[i + 1]);
-				mesh->lamb_edges.emplace_back(mesh->lamb_triangles[i + 2]);
-				mesh->lamb_edges.emplace_back(mesh->lamb_triangles[i + 2]);
-				mesh->lamb_edges.emplace_back(mesh->lamb_triangles[i + 0]);
-			}
-		};
-
 		// helper that pulls out the inverse transpose of the upper-left 3x3 of a Mat4:
 		auto normal_to_world = [](Mat4 const& l2w) {
 			return Mat4(l2w[0][0], l2w[0][1], l2w[0][2], 0.0f, l2w[1][0], l2w[1][1], l2w[1][2],
@@ -425,6 +377,12 @@ struct RasterJob {
 		uint32_t done = 0;
 		uint32_t count = static_cast<uint32_t>(instances.size());
 
+		// progress is reported at most every ReportInterval milliseconds (and once at the end),
+		// with an image kept up to date by resolving only the tiles drawn since the last report:
+		constexpr float ReportInterval = 100.0f;
+		HDR_Image resolved;
+		Timer since_report;
+
 		for (auto const& instance : instances) {
 			if (quit) break;
 			if (instance.material->type == Material::Type::Lambertian) {
@@ -434,49 +392,48 @@ struct RasterJob {
 				parameters.image = instance.material->image;
 				// std::string desc = "Rasterizing instance '" + instance.name + "'"; //DEBUG
 				if (instance.draw_style == DrawStyle::Wireframe) {
-					make_lamb_edges(instance.mesh);
 					// desc += " as wireframe (" +
-					// std::to_string(instance.mesh->source.faces.size()) + " faces converted to " +
-					// std::to_string(instance.mesh->lamb_edges.size()/2) + " lines)"; //DEBUG
+					// std::to_string(instance.mesh->triangles.size()/3) + " triangles converted to " +
+					// std::to_string(instance.mesh->edges.size()/2) + " lines)"; //DEBUG
 					// info("%s",desc.c_str()); //DEBUG
 					if (instance.blend_style == BlendStyle::Replace) {
 						if (instance.depth_style == DepthStyle::Always) {
-							Lambertian_Lines_Replace_Always_Pipeline::run(instance.mesh->lamb_edges,
-							                                              parameters, &framebuffer);
+							Lambertian_Lines_Replace_Always_Pipeline::run(
+									instance.mesh->vertices, instance.mesh->edges, parameters, &framebuffer);
 						} else if (instance.depth_style == DepthStyle::Never) {
-							Lambertian_Lines_Replace_Never_Pipeline::run(instance.mesh->lamb_edges,
-							                                             parameters, &framebuffer);
+							Lambertian_Lines_Replace_Never_Pipeline::run(
+									instance.mesh->vertices, instance.mesh->edges, parameters, &framebuffer);
 						} else if (instance.depth_style == DepthStyle::Less) {
-							Lambertian_Lines_Replace_Less_Pipeline::run(instance.mesh->lamb_edges,
-							                                            parameters, &framebuffer);
+							Lambertian_Lines_Replace_Less_Pipeline::run(
+									instance.mesh->vertices, instance.mesh->edges, parameters, &framebuffer);
 						} else {
 							// desc = "!!!SKIPPING!!! instance '" + instance.name + "' (unknown
 							// depth style)"; //DEBUG
 						}
 					} else if (instance.blend_style == BlendStyle::Add) {
 						if (instance.depth_style == DepthStyle::Always) {
-							Lambertian_Lines_Add_Always_Pipeline::run(instance.mesh->lamb_edges,
-							                                          parameters, &framebuffer);
+							Lambertian_Lines_Add_Always_Pipeline::run(
+									instance.mesh->vertices, instance.mesh->edges, parameters, &framebuffer);
 						} else if (instance.depth_style == DepthStyle::Never) {
-							Lambertian_Lines_Add_Never_Pipeline::run(instance.mesh->lamb_edges,
-							                                         parameters, &framebuffer);
+							Lambertian_Lines_Add_Never_Pipeline::run(
+									instance.mesh->vertices, instance.mesh->edges, parameters, &framebuffer);
 						} else if (instance.depth_style == DepthStyle::Less) {
-							Lambertian_Lines_Add_Less_Pipeline::run(instance.mesh->lamb_edges,
-							                                        parameters, &framebuffer);
+							Lambertian_Lines_Add_Less_Pipeline::run(
+									instance.mesh->vertices, instance.mesh->edges, parameters, &framebuffer);
 						} else {
 							// desc = "!!!SKIPPING!!! instance '" + instance.name + "' (unknown
 							// depth style)"; //DEBUG
 						}
 					} else if (instance.blend_style == BlendStyle::Over) {
 						if (instance.depth_style == DepthStyle::Always) {
-							Lambertian_Lines_Over_Always_Pipeline::run(instance.mesh->lamb_edges,
-							                                           parameters, &framebuffer);
+							Lambertian_Lines_Over_Always_Pipeline::run(
+									instance.mesh->vertices, instance.mesh->edges, parameters, &framebuffer);
 						} else if (instance.depth_style == DepthStyle::Never) {
-							Lambertian_Lines_Over_Never_Pipeline::run(instance.mesh->lamb_edges,
-							                                          parameters, &framebuffer);
+							Lambertian_Lines_Over_Never_Pipeline::run(
+									instance.mesh->vertices, instance.mesh->edges, parameters, &framebuffer);
 						} else if (instance.depth_style == DepthStyle::Less) {
-							Lambertian_Lines_Over_Less_Pipeline::run(instance.mesh->lamb_edges,
-							                                         parameters, &framebuffer);
+							Lambertian_Lines_Over_Less_Pipeline::run(
+									instance.mesh->vertices, instance.mesh->edges, parameters, &framebuffer);
 						} else {
 							// desc = "!!!SKIPPING!!! instance '" + instance.name + "' (unknown
 							// depth style)"; //DEBUG
@@ -486,21 +443,20 @@ struct RasterJob {
 						// style)"; //DEBUG
 					}
 				} else if (instance.draw_style == DrawStyle::Flat) {
-					make_lamb_triangles(instance.mesh);
 					// desc += " as wireframe (" +
-					// std::to_string(instance.mesh->source.faces.size()) + " faces converted to " +
-					// std::to_string(instance.mesh->lamb_edges.size()/2) + " lines)"; //DEBUG
+					// std::to_string(instance.mesh->triangles.size()/3) + " triangles converted to " +
+					// std::to_string(instance.mesh->edges.size()/2) + " lines)"; //DEBUG
 					// info("%s",desc.c_str()); //DEBUG
 					if (instance.blend_style == BlendStyle::Replace) {
 						if (instance.depth_style == DepthStyle::Always) {
 							Lambertian_Triangles_Replace_Always_Flat_Pipeline::run(
-								instance.mesh->lamb_triangles, parameters, &framebuffer);
+								instance.mesh->vertices, instance.mesh->triangles, parameters, &framebuffer);
 						} else if (instance.depth_style == DepthStyle::Never) {
 							Lambertian_Triangles_Replace_Never_Flat_Pipeline::run(
-								instance.mesh->lamb_triangles, parameters, &framebuffer);
+								instance.mesh->vertices, instance.mesh->triangles, parameters, &framebuffer);
 						} else if (instance.depth_style == DepthStyle::Less) {
 							Lambertian_Triangles_Replace_Less_Flat_Pipeline::run(
-								instance.mesh->lamb_triangles, parameters, &framebuffer);
+								instance.mesh->vertices, instance.mesh->triangles, parameters, &framebuffer);
 						} else {
 							// desc = "!!!SKIPPING!!! instance '" + instance.name + "' (unknown
 							// depth style)"; //DEBUG
@@ -508,13 +464,13 @@ struct RasterJob {
 					} else if (instance.blend_style == BlendStyle::Add) {
 						if (instance.depth_style == DepthStyle::Always) {
 							Lambertian_Triangles_Add_Always_Flat_Pipeline::run(
-								instance.mesh->lamb_triangles, parameters, &framebuffer);
+								instance.mesh->vertices, instance.mesh->triangles, parameters, &framebuffer);
 						} else if (instance.depth_style == DepthStyle::Never) {
 							Lambertian_Triangles_Add_Never_Flat_Pipeline::run(
-								instance.mesh->lamb_triangles, parameters, &framebuffer);
+								instance.mesh->vertices, instance.mesh->triangles, parameters, &framebuffer);
 						} else if (instance.depth_style == DepthStyle::Less) {
 							Lambertian_Triangles_Add_Less_Flat_Pipeline::run(
-								instance.mesh->lamb_triangles, parameters, &framebuffer);
+								instance.mesh->vertices, instance.mesh->triangles, parameters, &framebuffer);
 						} else {
 							// desc = "!!!SKIPPING!!! instance '" + instance.name + "' (unknown
 							// depth style)"; //DEBUG
@@ -522,13 +478,13 @@ struct RasterJob {
 					} else if (instance.blend_style == BlendStyle::Over) {
 						if (instance.depth_style == DepthStyle::Always) {
 							Lambertian_Triangles_Over_Always_Flat_Pipeline::run(
-								instance.mesh->lamb_triangles, parameters, &framebuffer);
+								instance.mesh->vertices, instance.mesh->triangles, parameters, &framebuffer);
 						} else if (instance.depth_style == DepthStyle::Never) {
 							Lambertian_Triangles_Over_Never_Flat_Pipeline::run(
-								instance.mesh->lamb_triangles, parameters, &framebuffer);
+								instance.mesh->vertices, instance.mesh->triangles, parameters, &framebuffer);
 						} else if (instance.depth_style == DepthStyle::Less) {
 							Lambertian_Triangles_Over_Less_Flat_Pipeline::run(
-								instance.mesh->lamb_triangles, parameters, &framebuffer);
+								instance.mesh->vertices, instance.mesh->triangles, parameters, &framebuffer);
 						} else {
 							// desc = "!!!SKIPPING!!! instance '" + instance.name + "' (unknown
 							// depth style)"; //DEBUG
@@ -538,21 +494,20 @@ struct RasterJob {
 						// style)"; //DEBUG
 					}
 				} else if (instance.draw_style == DrawStyle::Smooth) {
-					make_lamb_triangles(instance.mesh);
 					// desc += " as wireframe (" +
-					// std::to_string(instance.mesh->source.faces.size()) + " faces converted to " +
-					// std::to_string(instance.mesh->lamb_edges.size()/2) + " lines)"; //DEBUG
+					// std::to_string(instance.mesh->triangles.size()/3) + " triangles converted to " +
+					// std::to_string(instance.mesh->edges.size()/2) + " lines)"; //DEBUG
 					// info("%s",desc.c_str()); //DEBUG
 					if (instance.blend_style == BlendStyle::Replace) {
 						if (instance.depth_style == DepthStyle::Always) {
 							Lambertian_Triangles_Replace_Always_Smooth_Pipeline::run(
-								instance.mesh->lamb_triangles, parameters, &framebuffer);
+								instance.mesh->vertices, instance.mesh->triangles, parameters, &framebuffer);
 						} else if (instance.depth_style == DepthStyle::Never) {
 							Lambertian_Triangles_Replace_Never_Smooth_Pipeline::run(
-								instance.mesh->lamb_triangles, parameters, &framebuffer);
+								instance.mesh->vertices, instance.mesh->triangles, parameters, &framebuffer);
 						} else if (instance.depth_style == DepthStyle::Less) {
 							Lambertian_Triangles_Replace_Less_Smooth_Pipeline::run(
-								instance.mesh->lamb_triangles, parameters, &framebuffer);
+								instance.mesh->vertices, instance.mesh->triangles, parameters, &framebuffer);
 						} else {
 							// desc = "!!!SKIPPING!!! instance '" + instance.name + "' (unknown
 							// depth style)"; //DEBUG
@@ -560,13 +515,13 @@ struct RasterJob {
 					} else if (instance.blend_style == BlendStyle::Add) {
 						if (instance.depth_style == DepthStyle::Always) {
 							Lambertian_Triangles_Add_Always_Smooth_Pipeline::run(
-								instance.mesh->lamb_triangles, parameters, &framebuffer);
+								instance.mesh->vertices, instance.mesh->triangles, parameters, &framebuffer);
 						} else if (instance.depth_style == DepthStyle::Never) {
 							Lambertian_Triangles_Add_Never_Smooth_Pipeline::run(
-								instance.mesh->lamb_triangles, parameters, &framebuffer);
+								instance.mesh->vertices, instance.mesh->triangles, parameters, &framebuffer);
 						} else if (instance.depth_style == DepthStyle::Less) {
 							Lambertian_Triangles_Add_Less_Smooth_Pipeline::run(
-								instance.mesh->lamb_triangles, parameters, &framebuffer);
+								instance.mesh->vertices, instance.mesh->triangles, parameters, &framebuffer);
 						} else {
 							// desc = "!!!SKIPPING!!! instance '" + instance.name + "' (unknown
 							// depth style)"; //DEBUG
@@ -574,13 +529,13 @@ struct RasterJob {
 					} else if (instance.blend_style == BlendStyle::Over) {
 						if (instance.depth_style == DepthStyle::Always) {
 							Lambertian_Triangles_Over_Always_Smooth_Pipeline::run(
-								instance.mesh->lamb_triangles, parameters, &framebuffer);
+								instance.mesh->vertices, instance.mesh->triangles, parameters, &framebuffer);
 						} else if (instance.depth_style == DepthStyle::Never) {
 							Lambertian_Triangles_Over_Never_Smooth_Pipeline::run(
-								instance.mesh->lamb_triangles, parameters, &framebuffer);
+								instance.mesh->vertices, instance.mesh->triangles, parameters, &framebuffer);
 						} else if (instance.depth_style == DepthStyle::Less) {
 							Lambertian_Triangles_Over_Less_Smooth_Pipeline::run(
-								instance.mesh->lamb_triangles, parameters, &framebuffer);
+								instance.mesh->vertices, instance.mesh->triangles, parameters, &framebuffer);
 						} else {
 							// desc = "!!!SKIPPING!!! instance '" + instance.name + "' (unknown
 							// depth style)"; //DEBUG
@@ -590,21 +545,20 @@ struct RasterJob {
 						// style)"; //DEBUG
 					}
 				} else if (instance.draw_style == DrawStyle::Correct) {
-					make_lamb_triangles(instance.mesh);
 					// desc += " as wireframe (" +
-					// std::to_string(instance.mesh->source.faces.size()) + " faces converted to " +
-					// std::to_string(instance.mesh->lamb_edges.size()/2) + " lines)"; //DEBUG
+					// std::to_string(instance.mesh->triangles.size()/3) + " triangles converted to " +
+					// std::to_string(instance.mesh->edges.size()/2) + " lines)"; //DEBUG
 					// info("%s",desc.c_str()); //DEBUG
 					if (instance.blend_style == BlendStyle::Replace) {
 						if (instance.depth_style == DepthStyle::Always) {
 							Lambertian_Triangles_Replace_Always_Correct_Pipeline::run(
-								instance.mesh->lamb_triangles, parameters, &framebuffer);
+								instance.mesh->vertices, instance.mesh->triangles, parameters, &framebuffer);
 						} else if (instance.depth_style == DepthStyle::Never) {
 							Lambertian_Triangles_Replace_Never_Correct_Pipeline::run(
-								instance.mesh->lamb_triangles, parameters, &framebuffer);
+								instance.mesh->vertices, instance.mesh->triangles, parameters, &framebuffer);
 						} else if (instance.depth_style == DepthStyle::Less) {
 							Lambertian_Triangles_Replace_Less_Correct_Pipeline::run(
-								instance.mesh->lamb_triangles, parameters, &framebuffer);
+								instance.mesh->vertices, instance.mesh->triangles, parameters, &framebuffer);
 						} else {
 							// desc = "!!!SKIPPING!!! instance '" + instance.name + "' (unknown
 							// depth style)"; //DEBUG
@@ -612,13 +566,13 @@ struct RasterJob {
 					} else if (instance.blend_style == BlendStyle::Add) {
 						if (instance.depth_style == DepthStyle::Always) {
 							Lambertian_Triangles_Add_Always_Correct_Pipeline::run(
-								instance.mesh->lamb_triangles, parameters, &framebuffer);
+								instance.mesh->vertices, instance.mesh->triangles, parameters, &framebuffer);
 						} else if (instance.depth_style == DepthStyle::Never) {
 							Lambertian_Triangles_Add_Never_Correct_Pipeline::run(
-								instance.mesh->lamb_triangles, parameters, &framebuffer);
+								instance.mesh->vertices, instance.mesh->triangles, parameters, &framebuffer);
 						} else if (instance.depth_style == DepthStyle::Less) {
 							Lambertian_Triangles_Add_Less_Correct_Pipeline::run(
-								instance.mesh->lamb_triangles, parameters, &framebuffer);
+								instance.mesh->vertices, instance.mesh->triangles, parameters, &framebuffer);
 						} else {
 							// desc = "!!!SKIPPING!!! instance '" + instance.name + "' (unknown
 							// depth style)"; //DEBUG
@@ -626,13 +580,13 @@ struct RasterJob {
 					} else if (instance.blend_style == BlendStyle::Over) {
 						if (instance.depth_style == DepthStyle::Always) {
 							Lambertian_Triangles_Over_Always_Correct_Pipeline::run(
-								instance.mesh->lamb_triangles, parameters, &framebuffer);
+								instance.mesh->vertices, instance.mesh->triangles, parameters, &framebuffer);
 						} else if (instance.depth_style == DepthStyle::Never) {
 							Lambertian_Triangles_Over_Never_Correct_Pipeline::run(
-								instance.mesh->lamb_triangles, parameters, &framebuffer);
+								instance.mesh->vertices, instance.mesh->triangles, parameters, &framebuffer);
 						} else if (instance.depth_style == DepthStyle::Less) {
 							Lambertian_Triangles_Over_Less_Correct_Pipeline::run(
-								instance.mesh->lamb_triangles, parameters, &framebuffer);
+								instance.mesh->vertices, instance.mesh->triangles, parameters, &framebuffer);
 						} else {
 							// desc = "!!!SKIPPING!!! instance '" + instance.name + "' (unknown
 							// depth style)"; //DEBUG
@@ -649,9 +603,14 @@ struct RasterJob {
 				// TODO: other material types!
 			}
 			done += 1;
-			report_fn(std::make_pair(done / float(count), framebuffer.resolve_colors()));
+			if (since_report.ms() >= ReportInterval) {
+				framebuffer.resolve_touched(&resolved);
+				report_fn(std::make_pair(done / float(count), resolved.copy()));
+				since_report.reset();
+			}
 		}
-		report_fn(std::make_pair(1.0f, framebuffer.resolve_colors()));
+		framebuffer.resolve_touched(&resolved);
+		report_fn(std::make_pair(1.0f, std::move(resolved)));
 	}
 };
 
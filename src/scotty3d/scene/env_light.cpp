@@ -38,8 +38,9 @@ float Sphere::pdf(Vec3 dir) const {
 Sphere Sphere::make_image(std::weak_ptr<Texture> image_texture) {
 	Sphere ret;
 	ret.radiance = image_texture;
-	ret.importance =
-		Samplers::Sphere::Image{std::get<Textures::Image>(image_texture.lock()->texture).image};
+	auto &image = std::get<Textures::Image>(image_texture.lock()->texture);
+	image.load();
+	ret.importance = Samplers::Sphere::Image{image.base()};
 	return ret;
 }
 
@@ -80,6 +80,10 @@ namespace s3ds {
 		//^^ this is a "RIFF"-style header, and is designed to make it easy to skip chunks a reader doesn't understand
 		uint32_t version; //version is here instead of in fourcc so that it easier to check if a file is an s3d file by looking at the first four bytes.
 	};
+	//version written by this code (older versions can still be read):
+	// 0 - original format
+	// 1 - adds 'm' (image with stored mipmap levels) textures
+	constexpr uint32_t Version = 1;
 
 	//next is the "strings table": an array of characters with fourcc 'str0':
 	constexpr char Strings_fourcc[4] = {'s','t','r','0'};
@@ -97,6 +101,7 @@ namespace s3ds {
 		enum : char {
 			Constant = 'c', //data is a 16-byte TextureConstantData (see below)
 			Image = 'i', //data is TextureImageData (see below) followed by bytes to be passed to HDR_Image::decode()
+			ImageMipmap = 'm', //data is TextureImageData followed by, for the image and then each mipmap level, a uint32_t byte count and that many bytes to be passed to HDR_Image::decode()
 		} type;
 	} END_PACK;
 	static_assert(sizeof(Texture) == 4*4+1, "Texture is packed.");
@@ -482,6 +487,61 @@ namespace s3da {
 //helper:
 
 
+//decode the pixels of an image texture stored with 'type' ('i' or 'm'):
+// (this happens when the texture is first used, so problems are warnings and result in a placeholder image)
+static Textures::Pixels decode_texture_pixels(std::string const &name, char type, Textures::Image::Sampler sampler, uint8_t const *data, size_t size) {
+	Textures::Pixels pixels;
+	try {
+		if (type == s3ds::Texture::Image) {
+			pixels.image = HDR_Image::decode(data, size);
+		} else { assert(type == s3ds::Texture::ImageMipmap);
+			//image followed by its stored mipmap levels:
+			std::vector< HDR_Image > images;
+			size_t at = 0;
+			while (at < size) {
+				uint32_t bytes;
+				if (at + sizeof(bytes) > size) throw std::runtime_error("Mipmap has a truncated level size.");
+				memcpy(&bytes, data + at, sizeof(bytes));
+				at += sizeof(bytes);
+				if (bytes > size - at) throw std::runtime_error("Mipmap has a level of " + std::to_string(bytes) + " bytes, but only " + std::to_string(size - at) + " remain.");
+				images.emplace_back(HDR_Image::decode(data + at, bytes));
+				at += bytes;
+			}
+			if (images.empty()) throw std::runtime_error("Mipmap has no image data.");
+
+			pixels.image = std::move(images[0]);
+			for (uint32_t i = 1; i < images.size(); ++i) {
+				pixels.levels.emplace_back(std::move(images[i]));
+			}
+		}
+	} catch (std::exception const &e) {
+		warn("Texture '%s' failed to decode (%s); using a placeholder.", name.c_str(), e.what());
+		pixels.image = HDR_Image::missing_image();
+		pixels.levels.clear();
+	}
+
+	//only trust stored levels that form the chain generate_mipmap() would have made:
+	bool valid = (sampler == Textures::Image::Sampler::trilinear || pixels.levels.empty());
+	uint32_t w = pixels.image.w, h = pixels.image.h;
+	for (auto const &level : pixels.levels) {
+		if (w == 1 && h == 1) valid = false;
+		w = std::max(1u, w / 2u);
+		h = std::max(1u, h / 2u);
+		if (level.w != w || level.h != h) valid = false;
+	}
+	if (sampler == Textures::Image::Sampler::trilinear && !(w == 1 && h == 1)) valid = false;
+
+	if (!valid) {
+		if (type == s3ds::Texture::ImageMipmap) warn("Texture '%s' has stored mipmap levels that don't match its image; regenerating.", name.c_str());
+		if (sampler == Textures::Image::Sampler::trilinear) {
+			Textures::generate_mipmap(pixels.image, &pixels.levels);
+		} else {
+			pixels.levels.clear();
+		}
+	}
+	return pixels;
+}
+
 Scene Scene::load(std::istream& from) {
 
 	//keep track of the # of bytes read:
@@ -499,7 +559,7 @@ Scene Scene::load(std::istream& from) {
 
 	if (std::memcmp(s3ds::Header_fourcc, header.fourcc, 4) != 0) throw std::runtime_error(file_info() + "Got fourcc '" + std::string(header.fourcc, 4) + "', expected '" + std::string(s3ds::Header_fourcc, 4) + "'.");
 
-	if (header.version > 0) throw std::runtime_error(file_info() + "Version " + std::to_string(header.version) + " is newer than latest supported (0).");
+	if (header.version > s3ds::Version) throw std::runtime_error(file_info() + "Version " + std::to_string(header.version) + " is newer than latest supported (" + std::to_string(s3ds::Version) + ").");
 
 	//keep track of the names used:
 	std::unordered_set< std::string > names;
@@ -523,31 +583,33 @@ Scene Scene::load(std::istream& from) {
 	std::vector< std::shared_ptr< Texture > > index_to_texture;
 	{ //load textures:
 		//texture data chunk:
-		std::vector< uint8_t > texture_data;
-		read(from, s3ds::Texture_Data_fourcc, &texture_data);
+		//(shared with the textures, which decode from it lazily)
+		std::vector< uint8_t > texture_bytes;
+		read(from, s3ds::Texture_Data_fourcc, &texture_bytes);
+		auto texture_data = std::make_shared< std::vector< uint8_t > const >(std::move(texture_bytes));
 		//actual texture structures:
 		std::vector< s3ds::Texture > textures;
 		read(from, s3ds::Textures_fourcc, &textures);
 		for (auto const &loaded : textures) {
 			std::string name = get_string("Texture name", loaded.name_begin, loaded.name_end);
 			check_name("Texture", name);
-			CHECK_RANGE("Texture", texture_data, loaded.data_begin, loaded.data_end);
+			CHECK_RANGE("Texture", (*texture_data), loaded.data_begin, loaded.data_end);
 
 			std::shared_ptr< Texture > texture;
 			if (loaded.type == s3ds::Texture::Constant) {
 				s3ds::TextureConstantData tcd;
 				if (loaded.data_end - loaded.data_begin != sizeof(tcd)) throw std::runtime_error(file_info() + "Texture with constant color has " + std::to_string(loaded.data_end-loaded.data_begin) + " bytes of data; expected " + std::to_string(sizeof(tcd)) + ".");
-				memcpy(&tcd, &texture_data[loaded.data_begin], loaded.data_end - loaded.data_begin);
+				memcpy(&tcd, &(*texture_data)[loaded.data_begin], loaded.data_end - loaded.data_begin);
 				Textures::Constant constant;
 				constant.color.r = tcd.r;
 				constant.color.g = tcd.g;
 				constant.color.b = tcd.b;
 				constant.scale = tcd.scale;
 				texture = std::make_shared< Texture >(constant);
-			} else if (loaded.type == s3ds::Texture::Image) {
+			} else if (loaded.type == s3ds::Texture::Image || loaded.type == s3ds::Texture::ImageMipmap) {
 				s3ds::TextureImageData tid;
 				if (loaded.data_begin + sizeof(tid) > loaded.data_end) throw std::runtime_error(file_info() + "Texture with image has " + std::to_string(loaded.data_end-loaded.data_begin) + " bytes of data; expected at least " + std::to_string(sizeof(tid)) + ".");
-				memcpy(&tid, &texture_data[loaded.data_begin], sizeof(tid));
+				memcpy(&tid, &(*texture_data)[loaded.data_begin], sizeof(tid));
 
 				Textures::Image image;
 
@@ -562,15 +624,16 @@ Scene Scene::load(std::istream& from) {
 					throw std::runtime_error(file_info() + "Texture with image has unknown interpolation type '" + std::to_string(uint32_t(tid.interpolation)) + "'.");
 				}
 
-				//image data:
-				try {
-					image.image = HDR_Image::decode(&texture_data[loaded.data_begin + sizeof(tid)], loaded.data_end - (loaded.data_begin + sizeof(tid)));
-				} catch (std::exception const &e) {
-					throw std::runtime_error(file_info() + "Texture with image data that failed to decode: " + std::string(e.what()));
-				}
-
-				//generate mipmap if required by sampler:
-				image.update_mipmap();
+				//image data is decoded when first used:
+				auto source = std::make_shared< Textures::Source >();
+				source->data = texture_data;
+				source->begin = static_cast< uint32_t >(loaded.data_begin + sizeof(tid));
+				source->end = loaded.data_end;
+				source->type = loaded.type;
+				source->decode = [name, type=loaded.type, sampler=image.sampler](uint8_t const *data, size_t size) {
+					return decode_texture_pixels(name, type, sampler, data, size);
+				};
+				image.source = std::move(source);
 
 				texture = std::make_shared< Texture >(std::move(image));
 			} else {
@@ -1321,7 +1384,7 @@ void Scene::save(std::ostream& to) const {
 	//---- fill in the data: ----
 	memcpy(header.fourcc, s3ds::Header_fourcc, 4);
 	//header.bytes: filled in later
-	header.version = 0;
+	header.version = s3ds::Version;
 
 	std::unordered_map<Texture const*, uint32_t> texture_to_index;
 	// save textures
@@ -1347,7 +1410,10 @@ void Scene::save(std::ostream& to) const {
 				load.data_end = static_cast<uint32_t>(f_texture_data.size());
 			} else if (Textures::Image const *iptr = std::get_if< Textures::Image >(&texture->texture)) {
 				auto &val = *iptr;
-				load.type = s3ds::Texture::Image;
+				//trilinear textures store their mipmap so it doesn't need to be rebuilt on load:
+				load.type = (val.sampler == Textures::Image::Sampler::trilinear && !val.mipmap().empty() ? s3ds::Texture::ImageMipmap : s3ds::Texture::Image);
+				//(textures that haven't been decoded are saved as they were loaded)
+				if (val.source) load.type = decltype(load.type)(val.source->type);
 				s3ds::TextureImageData tid;
 
 				if (val.sampler == Textures::Image::Sampler::nearest) {
@@ -1362,8 +1428,22 @@ void Scene::save(std::ostream& to) const {
 
 				load.data_begin = static_cast<uint32_t>(f_texture_data.size());
 				f_texture_data.insert(f_texture_data.end(), reinterpret_cast<const char*>(&tid), reinterpret_cast<const char*>(&tid) + sizeof(tid));
-				std::vector<uint8_t> encoded = val.image.encode();
-				f_texture_data.insert(f_texture_data.end(), encoded.begin(), encoded.end());
+				if (val.source) {
+					auto const &data = *val.source->data;
+					f_texture_data.insert(f_texture_data.end(), data.begin() + val.source->begin, data.begin() + val.source->end);
+				} else if (load.type == s3ds::Texture::Image) {
+					std::vector<uint8_t> encoded = val.base().encode();
+					f_texture_data.insert(f_texture_data.end(), encoded.begin(), encoded.end());
+				} else {
+					auto append = [&](HDR_Image const &level) {
+						std::vector<uint8_t> encoded = level.encode();
+						uint32_t bytes = static_cast<uint32_t>(encoded.size());
+						f_texture_data.insert(f_texture_data.end(), reinterpret_cast<const char*>(&bytes), reinterpret_cast<const char*>(&bytes) + sizeof(bytes));
+						f_texture_data.insert(f_texture_data.end(), encoded.begin(), encoded.end());
+					};
+					append(val.base());
+					for (auto const &level : val.mipmap()) append(level);
+				}
 				load.data_end = static_cast<uint32_t>(f_texture_data.size());
 			} else {
 				throw std::runtime_error("Texture of unknown type.");
@@ -205,6 +205,11 @@ public:
 	std::weak_ptr<Texture> display() const {
 		return std::visit([&](auto&& m) { return m.display(); }, material);
 	}
+	//color of the surface at uv, ignoring lighting (used as a guide by the denoiser):
+	Spectrum albedo(Vec2 uv) const {
+		auto texture = display().lock();
+		return texture ? texture->evaluate(uv) : Spectrum{};
+	}
 	void for_each(const std::function<void(std::weak_ptr<Texture>&)>& f) {
 		std::visit([&](auto&& m) { m.for_each(f); }, material);
 	}
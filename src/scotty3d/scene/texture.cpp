@@ -1,5 +1,6 @@
 
 #include "texture.h"
+#include "../util/thread_pool.h"
 
 #include <iostream>
 
@@ -70,6 +71,24 @@ Spectrum sample_trilinear(HDR_Image const &base, std::vector< HDR_Image > const
 	// return sample_nearest(base, uv); //placeholder so image doesn't look blank
 }
 
+//the (up to) three source pixels covered by pixel i of a level with 'dst' pixels along an axis of 'src' pixels:
+// (when src is odd, each dst pixel covers 2 + 1/dst src pixels, so the end pixels get fractional weights)
+struct Box_Taps {
+	uint32_t index[3];
+	float weight[3];
+};
+static Box_Taps box_taps(uint32_t src, uint32_t dst, uint32_t i) {
+	if (src == 1) {
+		return Box_Taps{{0, 0, 0}, {1.0f, 0.0f, 0.0f}};
+	} else if (src % 2 == 0) {
+		return Box_Taps{{2 * i, 2 * i + 1, 2 * i + 1}, {0.5f, 0.5f, 0.0f}};
+	} else {
+		assert(src == 2 * dst + 1);
+		float inv = 1.0f / float(src);
+		return Box_Taps{{2 * i, 2 * i + 1, 2 * i + 2}, {(dst - i) * inv, dst * inv, (i + 1) * inv}};
+	}
+}
+
 /*
  * generate_mipmap- generate mipmap levels from a base image.
  *  base: the base image
@@ -121,31 +140,41 @@ void generate_mipmap(HDR_Image const &base, std::vector< HDR_Image > *levels_) {
 		assert(std::max(1u, src.w / 2u) == dst.w);
 		assert(std::max(1u, src.h / 2u) == dst.h);
 
-		// A1T6: generate
-		//TODO: Write code to fill the levels of the mipmap hierarchy by downsampling
-		float scale_u = 1.0f / static_cast<float>(dst.w);
-		float scale_v = 1.0f / static_cast<float>(dst.h);
-		for (int i = 0; i < dst.w; i++) {
-			for (int j = 0; j < dst.h; j++) {
-				Vec2 uv{ (i + 0.5f) * scale_u, (j + 0.5f) * scale_v };
-				dst.at(i, j) = sample_bilinear(src, uv);
+		//box filter over the area of src covered by each dst pixel, done separably:
+		// (rows are combined first, into a scratch row, so the inner loops are plain streams of Spectrum ops)
+		auto fill_rows = [&](uint32_t y_begin, uint32_t y_end) {
+			std::vector< Spectrum > combined(src.w);
+			for (uint32_t y = y_begin; y < y_end; ++y) {
+				Box_Taps ty = box_taps(src.h, dst.h, y);
+				Spectrum const *r0 = src.row(ty.index[0]);
+				Spectrum const *r1 = src.row(ty.index[1]);
+				Spectrum const *r2 = src.row(ty.index[2]);
+				for (size_t i = 0; i < combined.size(); ++i) {
+					combined[i] = ty.weight[0] * r0[i] + ty.weight[1] * r1[i] + ty.weight[2] * r2[i];
+				}
+
+				Spectrum *out = dst.row(y);
+				for (uint32_t x = 0; x < dst.w; ++x) {
+					Box_Taps tx = box_taps(src.w, dst.w, x);
+					out[x] = tx.weight[0] * combined[tx.index[0]] + tx.weight[1] * combined[tx.index[1]] + tx.weight[2] * combined[tx.index[2]];
+				}
 			}
+		};
+
+		//big levels get split into bands of rows, done in parallel:
+		constexpr uint32_t Band_Pixels = 1 << 16;
+		if (size_t(dst.w) * dst.h <= Band_Pixels) {
+			fill_rows(0, dst.h);
+		} else {
+			Thread_Pool::shared().for_each_chunk(dst.h, std::max(1u, Band_Pixels / dst.w), fill_rows);
 		}
-		//Be aware that the alignment of the samples in dst and src will be different depending on whether the image is even or odd.
-
 	};
 
-	std::cout << "Regenerating mipmap (" << levels.size() << " levels): [" << base.w << "x" << base.h << "]";
-	std::cout.flush();
 	for (uint32_t i = 0; i < levels.size(); ++i) {
 		HDR_Image const &src = (i == 0 ? base : levels[i-1]);
 		HDR_Image &dst = levels[i];
-		std::cout << " -> [" << dst.w << "x" << dst.h << "]"; std::cout.flush();
-
 		downsample(src, dst);
 	}
-	std::cout << std::endl;
-	
 }
 
 Image::Image(Sampler sampler_, HDR_Image const &image_) {
@@ -154,18 +183,53 @@ Image::Image(Sampler sampler_, HDR_Image const &image_) {
 	update_mipmap();
 }
 
-Spectrum Image::evaluate(Vec2 uv, float lod) const {
+Image Image::copy() const {
+	if (!tiled.empty()) return compacted_copy();
+	Image ret;
+	ret.sampler = sampler;
+	ret.shared = shared;
+	ret.source = source;
+	ret.image = image.copy();
+	ret.levels.reserve(levels.size());
+	for (auto const &level : levels) {
+		ret.levels.emplace_back(level.copy());
+	}
+	return ret;
+}
+
+//sample with 'sampler' from 'image' and its mipmap 'levels':
+static Spectrum sample(Image::Sampler sampler, HDR_Image const &image, std::vector< HDR_Image > const &levels, Vec2 uv, float lod) {
 	if (image.w == 0 && image.h == 0) return Spectrum();
-	if (sampler == Sampler::nearest) {
+	if (sampler == Image::Sampler::nearest) {
 		return sample_nearest(image, uv);
-	} else if (sampler == Sampler::bilinear) {
+	} else if (sampler == Image::Sampler::bilinear) {
 		return sample_bilinear(image, uv);
 	} else {
 		return sample_trilinear(image, levels, uv, lod);
 	}
 }
 
+Spectrum Image::evaluate(Vec2 uv, float lod) const {
+	if (!tiled.empty()) {
+		//compacted: same sampling strategies, on the tiled copies:
+		if (sampler == Sampler::nearest) {
+			return tiled[0].sample_nearest(uv);
+		} else if (sampler == Sampler::bilinear || tiled.size() == 1) {
+			return tiled[0].sample_bilinear(uv);
+		} else {
+			lod = std::clamp(lod, 0.0f, float(tiled.size() - 1));
+			uint32_t l0 = uint32_t(std::floor(lod));
+			uint32_t l1 = std::min(l0 + 1, uint32_t(tiled.size() - 1));
+			return lerp(tiled[l0].sample_bilinear(uv), tiled[l1].sample_bilinear(uv), lod - l0);
+		}
+	}
+	//(images with a source are decoded by load() before they are sampled, so sampling doesn't go through the cache)
+	assert(shared || !source);
+	return sample(sampler, base(), mipmap(), uv, lod);
+}
+
 void Image::update_mipmap() {
+	unshare();
 	if (sampler == Sampler::trilinear) {
 		generate_mipmap(image, &levels);
 	} else {
@@ -173,12 +237,81 @@ void Image::update_mipmap() {
 	}
 }
 
+void Image::share() {
+	if (shared || source) return;
+	auto pixels = std::make_shared< Pixels >();
+	pixels->image = std::move(image);
+	pixels->levels = std::move(levels);
+	image = HDR_Image();
+	levels.clear();
+	shared = std::move(pixels);
+}
+
+void Image::unshare() {
+	if (!shared && !source) return;
+	//(unless new pixels have been written to 'image')
+	if (image.w == 0 && image.h == 0) {
+		auto held = pixels();
+		image = held->image.copy();
+		levels.clear();
+		for (auto const &level : held->levels) {
+			levels.emplace_back(level.copy());
+		}
+	}
+	shared.reset();
+	source.reset();
+}
+
+void Image::load() {
+	if (!shared && source) shared = Texture_Cache::get().load(source);
+}
+
+void Image::release() {
+	if (source) shared.reset();
+}
+
+std::shared_ptr< Pixels const > Image::pixels() const {
+	if (shared) return shared;
+	if (source) return Texture_Cache::get().load(source);
+	return nullptr;
+}
+
+void Image::compact(Tiled_Image::Format format) {
+	if (!tiled.empty()) return;
+	//(textures that were never loaded are not sampled, so are left alone)
+	if (source && !shared) return;
+	tiled.reserve(1 + mipmap().size());
+	tiled.emplace_back(base(), format);
+	for (auto const &level : mipmap()) {
+		tiled.emplace_back(level, format);
+	}
+	image = HDR_Image();
+	levels.clear();
+	levels.shrink_to_fit();
+	shared.reset();
+	source.reset();
+}
+
+Image Image::compacted_copy() const {
+	Image ret;
+	ret.sampler = sampler;
+	ret.tiled = tiled;
+	return ret;
+}
+
 GL::Tex2D Image::to_gl() const {
-	return image.to_gl(1.0f);
+	auto held = pixels();
+	return (held ? held->image : image).to_gl(1.0f);
 }
 
 void Image::make_valid() {
+	//pixels newly written to 'image' replace any shared ones:
+	if (image.w != 0 || image.h != 0) {
+		shared.reset();
+		source.reset();
+	}
 	update_mipmap();
+	share();
 }
 
 Spectrum Constant::evaluate(Vec2 uv, float lod) const {
@@ -191,7 +324,11 @@ bool operator!=(const Textures::Constant& a, const Textures::Constant& b) {
 }
 
 bool operator!=(const Textures::Image& a, const Textures::Image& b) {
-	return a.image != b.image;
+	//(copies that still share their pixels are the same)
+	if ((a.shared || a.source) && a.shared == b.shared && a.source == b.source) return false;
+	auto held_a = a.pixels();
+	auto held_b = b.pixels();
+	return (held_a ? held_a->image : a.image) != (held_b ? held_b->image : b.image);
 }
 
 bool operator!=(const Texture& a, const Texture& b) {
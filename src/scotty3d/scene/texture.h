@@ -4,6 +4,8 @@
 
 #include "../lib/mathlib.h"
 #include "../util/hdr_image.h"
+#include "../util/tiled_image.h"
+#include "texture_cache.h"
 
 #include <memory>
 #include <variant>
@@ -22,9 +24,8 @@ public:
 	Image() = default;
 	Image(Sampler sampler_, HDR_Image const &image_);
 	
-	Image copy() const {
-		return Image{sampler, image};
-	}
+	//copies share any shared pixels (and source) rather than duplicating them:
+	Image copy() const;
 
 	//Read value from the image.
 	//  uv of [0,1]x[0,1] corresponds to the [0,w]x[0,h] of the contained image.
@@ -36,10 +37,41 @@ public:
 	Sampler sampler;
 	HDR_Image image;
 
-	//updates 'levels' for current sampler and image:
+	//updates 'levels' for current sampler and image (unsharing the pixels first):
 	void update_mipmap();
 	std::vector<HDR_Image> levels; //mipmap levels (if needed)
 
+	//instead of being held in 'image' and 'levels', pixels may be shared (read-only) between copies,
+	// and textures loaded from s3d files are only decoded from 'source' (via Texture_Cache) when needed:
+	std::shared_ptr< Textures::Pixels const > shared;
+	std::shared_ptr< Textures::Source > source;
+
+	//move 'image' and 'levels' into 'shared':
+	void share();
+	//copy shared pixels back into 'image' and 'levels' (so they can be edited):
+	void unshare();
+	//decode (if needed) and hold on to pixels from source:
+	void load();
+	//let go of pixels that can be decoded again from source:
+	void release();
+
+	//image and mipmap levels that are sampled (empty for textures with a source that haven't been loaded):
+	HDR_Image const &base() const {
+		return shared ? shared->image : image;
+	}
+	std::vector<HDR_Image> const &mipmap() const {
+		return shared ? shared->levels : levels;
+	}
+	//shared pixels, decoded from source if not loaded (null if pixels are in 'image' and 'levels'):
+	std::shared_ptr< Textures::Pixels const > pixels() const;
+
+	//replace image and levels with tiled copies in 'format', which are then used for sampling.
+	// frees the originals, so only for textures that won't be edited or saved (e.g., the pathtracer's copies).
+	void compact(Tiled_Image::Format format);
+	//copy of a compacted image (just its sampler and tiled copies):
+	Image compacted_copy() const;
+	std::vector<Tiled_Image> tiled; //tiled copies of [image, levels...] (if compacted)
+
 	GL::Tex2D to_gl() const;
 
 	//- - - - - - - - - - - -
@@ -47,7 +79,12 @@ public:
 	template< Intent I, typename F, typename T >
 	static void introspect(F&& f, T&& t) {
 		if constexpr (I != Intent::Animate) introspect_enum< I >(f, "sampler", t.sampler, std::vector< std::pair< const char *, Sampler> >{{"nearest", Sampler::nearest},{"bilinear", Sampler::bilinear},{"trilinear", Sampler::trilinear}});
-		if constexpr (I != Intent::Animate) f("image", t.image);
+		if constexpr (I == Intent::Read) {
+			auto held = t.pixels();
+			f("image", held ? held->image : t.image);
+		} else if constexpr (I != Intent::Animate) {
+			f("image", t.image);
+		}
 		if constexpr (I == Intent::Write) {
 			t.make_valid();
 		}
@@ -55,6 +92,9 @@ public:
 	static inline const char *TYPE = "Image"; //used by introspect_variant<>
 };
 
+//fill 'levels' with successively half-sized, filtered copies of 'base' (down to 1x1):
+void generate_mipmap(HDR_Image const &base, std::vector< HDR_Image > *levels);
+
 class Constant {
 public:
 	Constant() = default;
@@ -0,0 +1,77 @@
+
+#include "texture_cache.h"
+
+namespace Textures {
+
+size_t Pixels::bytes() const {
+	size_t ret = image.data().size() * sizeof(Spectrum);
+	for (auto const &level : levels) ret += level.data().size() * sizeof(Spectrum);
+	return ret;
+}
+
+} // namespace Textures
+
+Texture_Cache &Texture_Cache::get() {
+	static Texture_Cache cache;
+	return cache;
+}
+
+std::shared_ptr< Textures::Pixels const > Texture_Cache::load(std::shared_ptr< Textures::Source > const &source) {
+	assert(source);
+
+	//one thread decodes each source; others wait for it:
+	std::unique_lock< std::mutex > decode_lock(source->decode_mut);
+
+	std::shared_ptr< Textures::Pixels const > pixels = source->decoded.lock();
+	if (pixels) {
+		//move to front if still cached:
+		std::unique_lock< std::mutex > lock(mut);
+		auto f = entries.find(pixels.get());
+		if (f != entries.end()) {
+			recent.splice(recent.begin(), recent, f->second);
+			return pixels;
+		}
+	} else {
+		assert(source->data && source->begin <= source->end && source->end <= source->data->size());
+		pixels = std::make_shared< Textures::Pixels const >(source->decode(source->data->data() + source->begin, source->end - source->begin));
+		source->decoded = pixels;
+	}
+
+	std::unique_lock< std::mutex > lock(mut);
+	recent.emplace_front(pixels);
+	entries.emplace(pixels.get(), recent.begin());
+	held_bytes += pixels->bytes();
+	trim();
+	return pixels;
+}
+
+void Texture_Cache::set_budget(size_t bytes) {
+	std::unique_lock< std::mutex > lock(mut);
+	budget_bytes = bytes;
+	trim();
+}
+
+size_t Texture_Cache::budget() const {
+	std::unique_lock< std::mutex > lock(mut);
+	return budget_bytes;
+}
+
+size_t Texture_Cache::bytes() const {
+	std::unique_lock< std::mutex > lock(mut);
+	return held_bytes;
+}
+
+void Texture_Cache::clear() {
+	std::unique_lock< std::mutex > lock(mut);
+	recent.clear();
+	entries.clear();
+	held_bytes = 0;
+}
+
+void Texture_Cache::trim() {
+	while (held_bytes > budget_bytes && !recent.empty()) {
+		held_bytes -= recent.back()->bytes();
+		entries.erase(recent.back().get());
+		recent.pop_back();
+	}
+}
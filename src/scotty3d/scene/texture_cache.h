@@ -0,0 +1,66 @@
+#pragma once
+
+#include "../util/hdr_image.h"
+
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace Textures {
+
+//pixels of an image texture, shared read-only between copies of the texture:
+struct Pixels {
+	HDR_Image image;
+	std::vector< HDR_Image > levels; //mipmap levels (if needed)
+
+	size_t bytes() const;
+};
+
+//encoded pixels of an image texture, decoded (via Texture_Cache) when first used:
+struct Source {
+	std::shared_ptr< std::vector< uint8_t > const > data; //encoded bytes (may be shared with other sources, e.g., all of an s3d file's texture data)
+	uint32_t begin = 0, end = 0; //range of data holding this texture
+	char type = 0; //how the range is encoded (s3ds::Texture::type, so it can be saved again as-is)
+	std::function< Pixels(uint8_t const *, size_t) > decode; //should not throw
+
+	//managed by Texture_Cache:
+	std::mutex decode_mut;
+	std::weak_ptr< Pixels const > decoded;
+};
+
+} // namespace Textures
+
+/*
+ *
+ * Texture_Cache keeps recently used decoded textures in memory, up to a budget in bytes.
+ *
+ * Decoded pixels are handed out as shared pointers, so pixels evicted from the cache stay
+ * alive as long as someone (e.g., the pathtracer's copy of a texture) is still using them.
+ *
+ */
+class Texture_Cache {
+public:
+	static Texture_Cache &get();
+
+	//pixels of 'source', decoding them if they aren't in memory (thread-safe):
+	std::shared_ptr< Textures::Pixels const > load(std::shared_ptr< Textures::Source > const &source);
+
+	//bytes of decoded pixels the cache holds on to (least recently used are let go first):
+	void set_budget(size_t bytes);
+	size_t budget() const;
+	size_t bytes() const;
+
+	//let go of all cached pixels:
+	void clear();
+
+private:
+	void trim(); //(call with mut held)
+
+	mutable std::mutex mut;
+	size_t budget_bytes = size_t(2) << 30;
+	size_t held_bytes = 0;
+	std::list< std::shared_ptr< Textures::Pixels const > > recent; //most recently used first
+	std::unordered_map< Textures::Pixels const *, decltype(recent)::iterator > entries;
+};
@@ -0,0 +1,181 @@
+#include "test.h"
+
+#include "lib/mathlib.h"
+#include "lib/batch.h"
+#include "rasterizer/pipeline.h"
+#include "rasterizer/programs.h"
+#include "util/hdr_image.h"
+
+#include <cstring>
+#include <limits>
+#include <vector>
+
+static std::vector< Mat4 > test_matrices() {
+	return {
+		Mat4::I,
+		Mat4::translate(Vec3{1.0f, -2.0f, 3.0f}) * Mat4::euler(Vec3{30.0f, -45.0f, 60.0f}) * Mat4::scale(Vec3{2.0f, 0.5f, 1.5f}),
+		Mat4::perspective(60.0f, 1.5f, 0.1f) * Mat4::look_at(Vec3{3.0f, 2.0f, 1.0f}, Vec3{0.0f}, Vec3{0.0f, 1.0f, 0.0f}),
+		Mat4{Vec4{2.0f, 1.0f, 0.0f, 1.0f}, Vec4{-1.0f, 3.0f, 1.0f, 0.5f}, Vec4{0.5f, 0.0f, 4.0f, -1.0f}, Vec4{1.0f, 2.0f, -3.0f, 2.0f}},
+	};
+}
+
+Test test_a1_math_simd_mat4("a1.math_simd.mat4", []() {
+	for (Mat4 const &a : test_matrices()) {
+		for (Mat4 const &b : test_matrices()) {
+			if (Test::differs(a * b, Mat4::multiply_scalar(a, b))) {
+				throw Test::error("Mat4 product differs from the scalar product.");
+			}
+		}
+		if (Test::differs(Mat4::inverse(a), Mat4::inverse_scalar(a))) {
+			throw Test::error("Mat4 inverse differs from the scalar inverse.");
+		}
+		if (Test::differs(a * Mat4::inverse(a), Mat4::I)) {
+			throw Test::error("Mat4 times its inverse is not the identity.");
+		}
+	}
+});
+
+Test test_a1_math_simd_batch("a1.math_simd.batch", []() {
+	//(odd count, so batches are followed by leftovers)
+	std::vector< Vec3 > points;
+	std::vector< BBox > boxes;
+	for (uint32_t i = 0; i < 11; i++) {
+		Vec3 p{float(i) - 5.0f, 0.5f * float(i * i % 7), 1.0f - 0.25f * float(i)};
+		points.emplace_back(p);
+		boxes.emplace_back(p, p + Vec3{1.0f, float(i % 3), 0.5f});
+	}
+
+	for (Mat4 const &T : test_matrices()) {
+		std::vector< Vec3 > out(points.size()), expected(points.size());
+		Batch::transform_points(T, points.data(), out.data(), points.size());
+		Batch::Scalar::transform_points(T, points.data(), expected.data(), points.size());
+		if (Test::differs(out, expected)) throw Test::error("Batched point transform differs from Mat4 * Vec3.");
+
+		Batch::transform_vectors(T, points.data(), out.data(), points.size());
+		Batch::Scalar::transform_vectors(T, points.data(), expected.data(), points.size());
+		if (Test::differs(out, expected)) throw Test::error("Batched vector transform differs from Mat4::rotate.");
+
+		Mat4 N = T.inverse().T();
+		Batch::transform_normals(N, points.data(), out.data(), points.size());
+		Batch::Scalar::transform_normals(N, points.data(), expected.data(), points.size());
+		if (Test::differs(out, expected)) throw Test::error("Batched normal transform differs from Mat4::rotate + unit.");
+
+		//in place:
+		out = points;
+		Batch::transform_points(T, out.data(), out.data(), out.size());
+		Batch::Scalar::transform_points(T, points.data(), expected.data(), points.size());
+		if (Test::differs(out, expected)) throw Test::error("In-place batched point transform differs from Mat4 * Vec3.");
+
+		std::vector< BBox > out_boxes(boxes.size());
+		Batch::transform_bboxes(T, boxes.data(), out_boxes.data(), boxes.size());
+		for (size_t i = 0; i < boxes.size(); i++) {
+			BBox expected_box = BBox(boxes[i]).transform_scalar(T);
+			BBox single_box = BBox(boxes[i]).transform(T);
+			if (Test::differs(out_boxes[i].min, expected_box.min) || Test::differs(out_boxes[i].max, expected_box.max)
+			 || Test::differs(single_box.min, expected_box.min) || Test::differs(single_box.max, expected_box.max)) {
+				throw Test::error("Transformed BBox differs from the scalar transform.");
+			}
+		}
+	}
+});
+
+Test test_a1_math_simd_shade_vertices("a1.math_simd.shade_vertices", []() {
+	using Lambertian = Programs::Lambertian;
+	Lambertian::Parameters parameters;
+	parameters.local_to_clip = test_matrices()[2];
+	parameters.normal_to_world = test_matrices()[1].inverse().T();
+
+	std::vector< Vertex< Lambertian::VA > > vertices(7);
+	for (uint32_t i = 0; i < vertices.size(); i++) {
+		for (uint32_t a = 0; a < Lambertian::VA; a++) {
+			vertices[i].attributes[a] = float(i) * 0.5f - float(a) * 0.25f;
+		}
+	}
+
+	std::vector< ShadedVertex< Lambertian::FA > > shaded;
+	Lambertian::shade_vertices(parameters, vertices, &shaded);
+	if (shaded.size() != vertices.size()) throw Test::error("shade_vertices produced the wrong number of vertices.");
+	for (uint32_t i = 0; i < vertices.size(); i++) {
+		ShadedVertex< Lambertian::FA > expected;
+		Lambertian::shade_vertex(parameters, vertices[i].attributes, &expected.clip_position, &expected.attributes);
+		if (Test::differs(shaded[i].clip_position, expected.clip_position)) {
+			throw Test::error("shade_vertices clip position differs from shade_vertex.");
+		}
+		for (uint32_t a = 0; a < Lambertian::FA; a++) {
+			if (Test::differs(shaded[i].attributes[a], expected.attributes[a])) {
+				throw Test::error("shade_vertices attribute " + std::to_string(a) + " differs from shade_vertex.");
+			}
+		}
+	}
+});
+
+Test test_a1_math_simd_clip_outcodes("a1.math_simd.clip_outcodes", []() {
+	//(x,y,z,w) records with two extra floats each; an odd count, so batches are followed by leftovers:
+	constexpr size_t stride = 6;
+	std::vector< Vec4 > points{
+		Vec4{0.0f, 0.0f, 0.0f, 1.0f}, Vec4{1.0f, -1.0f, 1.0f, 1.0f}, Vec4{2.0f, 0.0f, 0.0f, 1.0f}, Vec4{0.0f, -3.0f, 0.5f, 2.0f},
+		Vec4{0.0f, 0.0f, 5.0f, 1.0f}, Vec4{-1.0f, 1.0f, -1.0f, 0.5f}, Vec4{0.0f, 0.0f, 0.0f, -1.0f}, Vec4{1.0f + 1e-7f, 0.0f, 0.0f, 1.0f},
+		Vec4{std::numeric_limits< float >::quiet_NaN(), 0.0f, 0.0f, 1.0f}, Vec4{-4.0f, 4.0f, -4.0f, 1.0f}, Vec4{0.25f, 0.5f, -0.75f, 1.0f},
+	};
+	std::vector< uint8_t > expected{0, 0, 0b10, 0b0100, 0b100000, 0b011001, 0b111111, 0, 0b11, 0b011001, 0};
+	std::vector< float > records(points.size() * stride, 7.0f);
+	for (size_t i = 0; i < points.size(); i++) {
+		for (uint32_t c = 0; c < 4; c++) records[i * stride + c] = points[i][c];
+	}
+	std::vector< uint8_t > codes(points.size()), scalar(points.size());
+	Batch::clip_outcodes(records.data(), stride, codes.data(), points.size(), 1e-6f);
+	Batch::Scalar::clip_outcodes(records.data(), stride, scalar.data(), points.size(), 1e-6f);
+	for (size_t i = 0; i < points.size(); i++) {
+		if (codes[i] != expected[i] || scalar[i] != expected[i]) {
+			throw Test::error("Outcode for " + to_string(points[i]) + " was " + std::to_string(codes[i]) + " (scalar " + std::to_string(scalar[i]) + "), expected " + std::to_string(expected[i]) + ".");
+		}
+	}
+});
+
+Test test_a1_math_simd_spectrum("a1.math_simd.spectrum", []() {
+	Spectrum a{0.25f, -1.5f, 3.0f}, b{2.0f, 0.5f, -0.125f};
+	auto expect = [](Spectrum got, float r, float g, float b, std::string const &what) {
+		if (got.r != r || got.g != g || got.b != b) {
+			throw Test::error("Spectrum " + what + " gave " + to_string(got) + ".");
+		}
+	};
+	expect(a + b, a.r + b.r, a.g + b.g, a.b + b.b, "+");
+	expect(a - b, a.r - b.r, a.g - b.g, a.b - b.b, "-");
+	expect(a * b, a.r * b.r, a.g * b.g, a.b * b.b, "*");
+	expect(a + 0.5f, a.r + 0.5f, a.g + 0.5f, a.b + 0.5f, "+ float");
+	expect(3.0f * a, a.r * 3.0f, a.g * 3.0f, a.b * 3.0f, "float *");
+	expect(a / 3.0f, a.r / 3.0f, a.g / 3.0f, a.b / 3.0f, "/ float");
+	Spectrum c = a;
+	c += b;
+	c *= b;
+	c *= 0.75f;
+	expect(c, (a.r + b.r) * b.r * 0.75f, (a.g + b.g) * b.g * 0.75f, (a.b + b.b) * b.b * 0.75f, "compound ops");
+
+	//the pad lane doesn't take part in comparisons:
+	Spectrum d = a;
+	d.data[3] = 1.0f;
+	if (d != a || !(d == a)) throw Test::error("Spectrum comparison looked at the pad.");
+
+	//batched ops match one-at-a-time ops:
+	std::vector< Spectrum > in, acc, expected;
+	for (uint32_t i = 0; i < 7; i++) {
+		in.emplace_back(float(i), 0.5f * float(i), 1.0f - float(i));
+		acc.emplace_back(1.0f, 2.0f, float(i));
+	}
+	expected = acc;
+	for (uint32_t i = 0; i < in.size(); i++) expected[i] += in[i] * 0.3f;
+	Batch::add_scaled(acc.data(), in.data(), 0.3f, in.size());
+	if (acc != expected) throw Test::error("Batch::add_scaled differs from Spectrum ops.");
+	Batch::scale(acc.data(), in.data(), 2.0f, in.size());
+	for (uint32_t i = 0; i < in.size(); i++) expected[i] = in[i] * 2.0f;
+	if (acc != expected) throw Test::error("Batch::scale differs from Spectrum ops.");
+
+	//images still store packed r,g,b floats:
+	HDR_Image image(7, 1, in);
+	std::vector< uint8_t > bytes = image.encode();
+	if (bytes.size() != 12 + 7 * 12) throw Test::error("Encoded image has " + std::to_string(bytes.size()) + " bytes.");
+	float first[6];
+	std::memcpy(first, bytes.data() + 12, sizeof(first));
+	if (first[3] != in[1].r || first[4] != in[1].g || first[5] != in[1].b) throw Test::error("Encoded pixels aren't packed.");
+	if (HDR_Image::decode(bytes.data(), bytes.size()) != image) throw Test::error("Decoded image differs.");
+});
@@ -0,0 +1,56 @@
+#include "test.h"
+
+#include "geometry/halfedge.h"
+#include "geometry/util.h"
+#include "rasterizer/mesh_cache.h"
+
+Test test_a1_mesh_cache_weld("a1.mesh_cache.weld", []() {
+	//flat-shaded cube: corners only share within a face (4 per quad face, instead of 6 per two triangles):
+	Raster_Mesh cube = Raster_Mesh::from_halfedge_mesh(Halfedge_Mesh::cube(1.0f));
+	if (cube.vertices.size() != 24 || cube.triangles.size() != 36 || cube.edges.size() != 72) {
+		throw Test::error("Cube converted to " + std::to_string(cube.vertices.size()) + " vertices, "
+			+ std::to_string(cube.triangles.size()) + " triangle and " + std::to_string(cube.edges.size()) + " edge indices.");
+	}
+
+	//smooth sphere: all corners at a vertex share it:
+	Halfedge_Mesh sphere = Halfedge_Mesh::from_indexed_mesh(Util::closed_sphere_mesh(1.0f, 2));
+	Raster_Mesh converted = Raster_Mesh::from_halfedge_mesh(sphere);
+	if (converted.vertices.size() != sphere.vertices.size()) {
+		throw Test::error("Sphere with " + std::to_string(sphere.vertices.size()) + " vertices converted to " + std::to_string(converted.vertices.size()) + ".");
+	}
+	for (uint32_t i : converted.triangles) {
+		if (i >= converted.vertices.size()) throw Test::error("Converted index out of range.");
+	}
+});
+
+Test test_a1_mesh_cache_reuse("a1.mesh_cache.reuse", []() {
+	Raster_Mesh_Cache &cache = Raster_Mesh_Cache::get();
+	cache.clear();
+
+	auto mesh = std::make_shared< Halfedge_Mesh >(Halfedge_Mesh::cube(1.0f));
+	auto first = cache.load(mesh);
+	if (cache.load(mesh) != first) throw Test::error("Unchanged mesh was converted again.");
+	if (cache.size() != 1) throw Test::error("Cache should hold one mesh.");
+
+	//edits in place are noticed:
+	mesh->vertices.front().position += Vec3{0.5f, 0.0f, 0.0f};
+	auto second = cache.load(mesh);
+	if (second == first) throw Test::error("Edited mesh reused a stale conversion.");
+	if (cache.load(mesh) != second) throw Test::error("Edited mesh was converted twice.");
+	Vec3 moved = mesh->vertices.front().position;
+	bool found = false;
+	for (auto const &v : second->vertices) {
+		if (v.attributes[Programs::Lambertian::VA_PositionX] == moved.x
+		 && v.attributes[Programs::Lambertian::VA_PositionY] == moved.y
+		 && v.attributes[Programs::Lambertian::VA_PositionZ] == moved.z) found = true;
+	}
+	if (!found) throw Test::error("Edited mesh's conversion doesn't have the moved vertex.");
+
+	//conversions handed out stay valid after the mesh is gone, but the cache lets go of them:
+	mesh.reset();
+	auto other = std::make_shared< Halfedge_Mesh >(Halfedge_Mesh::cube(2.0f));
+	cache.load(other);
+	if (cache.size() != 1) throw Test::error("Cache held on to a deleted mesh.");
+	if (second->vertices.size() != 24) throw Test::error("Handed-out conversion was changed.");
+	cache.clear();
+});
@@ -233,6 +233,35 @@ Test test_a1_task6_generate_mipmap("a1.task6.generate_mipmap", []() {
 });
 
 
+Test test_a1_task6_generate_mipmap_odd("a1.task6.generate_mipmap.odd", []() {
+	//odd sizes don't divide evenly, but each level should still have the same average color as the image:
+	HDR_Image image(7, 5);
+	Spectrum sum;
+	for (uint32_t y = 0; y < image.h; ++y) {
+		for (uint32_t x = 0; x < image.w; ++x) {
+			image.at(x, y) = Spectrum(float(x), float(y), float((x * 3 + y * 5) % 4));
+			sum += image.at(x, y);
+		}
+	}
+	Spectrum average = sum / float(image.w * image.h);
+
+	std::vector< HDR_Image > levels;
+	Textures::generate_mipmap(image, &levels);
+
+	for (uint32_t l = 0; l < levels.size(); ++l) {
+		Spectrum level_sum;
+		for (uint32_t y = 0; y < levels[l].h; ++y) {
+			for (uint32_t x = 0; x < levels[l].w; ++x) {
+				level_sum += levels[l].at(x, y);
+			}
+		}
+		Spectrum level_average = level_sum / float(levels[l].w * levels[l].h);
+		if (Test::differs(level_average, average)) {
+			throw Test::error("Mipmap level " + std::to_string(l) + " has average " + to_string(level_average) + " but the image has average " + to_string(average) + ".");
+		}
+	}
+});
+
 //-------------------------------------------
 //check LOD computation in lambertian program:
 
@@ -0,0 +1,104 @@
+#include "test.h"
+
+#include "scene/scene.h"
+
+#include <sstream>
+
+static HDR_Image gradient_image(uint32_t w, uint32_t h) {
+	HDR_Image image(w, h);
+	for (uint32_t y = 0; y < h; ++y) {
+		for (uint32_t x = 0; x < w; ++x) {
+			image.at(x, y) = Spectrum(x / float(w), y / float(h), 0.5f);
+		}
+	}
+	return image;
+}
+
+Test test_a1_texture_cache_lazy("a1.texture_cache.lazy", []() {
+	Scene scene;
+	auto original = std::make_shared<Texture>(Textures::Image(Textures::Image::Sampler::trilinear, gradient_image(32, 16)));
+	scene.textures.emplace("gradient", original);
+
+	std::stringstream file;
+	scene.save(file);
+	Scene loaded = Scene::load(file);
+
+	auto &image = std::get<Textures::Image>(loaded.textures.at("gradient")->texture);
+	if (!image.source || image.shared || image.image.w != 0) {
+		throw Test::error("Image texture loaded from an s3d file should not be decoded until it is used.");
+	}
+
+	//copies share the source, and loading them shares the decoded pixels:
+	Textures::Image a = image.copy(), b = image.copy();
+	a.load();
+	b.load();
+	if (a.source != image.source || !a.shared || a.shared != b.shared) {
+		throw Test::error("Copies of a lazily-loaded texture should share their decoded pixels.");
+	}
+	if (a.mipmap().size() != std::get<Textures::Image>(original->texture).levels.size()) {
+		throw Test::error("Loaded texture has the wrong number of mipmap levels.");
+	}
+
+	for (Vec2 uv : {Vec2{0.1f, 0.2f}, Vec2{0.5f, 0.5f}, Vec2{0.9f, 0.7f}}) {
+		for (float lod : {0.0f, 1.5f, 4.0f}) {
+			Spectrum expected = original->evaluate(uv, lod);
+			if (Test::differs(a.evaluate(uv, lod), expected) || Test::differs(b.evaluate(uv, lod), expected)) {
+				throw Test::error("Lazily-loaded texture samples differently than the original.");
+			}
+		}
+	}
+
+	//editing a copy leaves the others alone:
+	a.sampler = Textures::Image::Sampler::nearest;
+	a.make_valid();
+	if (a.source || !a.mipmap().empty() || !b.shared || b.mipmap().empty()) {
+		throw Test::error("Editing a copy of a shared texture should unshare only that copy.");
+	}
+});
+
+Test test_a1_texture_cache_budget("a1.texture_cache.budget", []() {
+	Texture_Cache &cache = Texture_Cache::get();
+	size_t old_budget = cache.budget();
+	cache.clear();
+
+	//sources that count how many times they are decoded:
+	uint32_t decodes = 0;
+	auto make_source = [&]() {
+		auto source = std::make_shared<Textures::Source>();
+		source->data = std::make_shared<std::vector<uint8_t> const>();
+		source->decode = [&](uint8_t const *, size_t) {
+			++decodes;
+			Textures::Pixels pixels;
+			pixels.image = gradient_image(16, 16);
+			return pixels;
+		};
+		return source;
+	};
+	auto first = make_source(), second = make_source();
+	size_t bytes = 16 * 16 * sizeof(Spectrum);
+
+	//room for one texture:
+	cache.set_budget(bytes);
+	auto held = cache.load(first);
+	cache.load(first);
+	cache.load(second);
+	if (decodes != 2 || cache.bytes() > bytes) {
+		throw Test::error("Cache decoded " + std::to_string(decodes) + " times and holds " + std::to_string(cache.bytes()) + " bytes; expected 2 decodes and at most " + std::to_string(bytes) + " bytes.");
+	}
+
+	//evicted pixels that are still in use are not decoded again:
+	cache.load(first);
+	if (decodes != 2) {
+		throw Test::error("Cache decoded pixels that were still in use again.");
+	}
+	//...but evicted pixels that are no longer used are:
+	held.reset();
+	cache.load(second);
+	cache.load(first);
+	if (decodes != 4) {
+		throw Test::error("Cache should have decoded evicted pixels again (decoded " + std::to_string(decodes) + " times, expected 4).");
+	}
+
+	cache.clear();
+	cache.set_budget(old_budget);
+});
@@ -0,0 +1,98 @@
+#include "test.h"
+
+#include "scene/texture.h"
+#include "util/rand.h"
+#include "util/tiled_image.h"
+
+static HDR_Image random_image(uint32_t w, uint32_t h, RNG &rng) {
+	HDR_Image image(w, h);
+	for (uint32_t y = 0; y < h; ++y) {
+		for (uint32_t x = 0; x < w; ++x) {
+			image.at(x, y) = Spectrum(rng.unit() * 4.0f, rng.unit(), rng.unit() * 0.01f);
+		}
+	}
+	return image;
+}
+
+Test test_a1_tiled_image_formats("a1.tiled_image.formats", []() {
+	RNG rng(0x711ed);
+	HDR_Image image = random_image(13, 21, rng);
+
+	//largest error allowed, relative to the largest channel of the texel:
+	for (auto [format, tolerance] : {std::pair{Tiled_Image::Format::Float, 0.0f},
+	                                 std::pair{Tiled_Image::Format::Half, 1.0f / 1024.0f},
+	                                 std::pair{Tiled_Image::Format::RGB9E5, 1.0f / 256.0f}}) {
+		Tiled_Image tiled(image, format);
+		if (tiled.w != image.w || tiled.h != image.h) {
+			throw Test::error("Tiled image has the wrong size.");
+		}
+		for (uint32_t y = 0; y < image.h; ++y) {
+			for (uint32_t x = 0; x < image.w; ++x) {
+				Spectrum a = image.at(x, y), b = tiled.at(x, y);
+				float max = std::max({a.r, a.g, a.b});
+				for (uint32_t c = 0; c < 3; ++c) {
+					if (std::abs(a[c] - b[c]) > tolerance * max) {
+						throw Test::error(std::string("Texel (") + std::to_string(x) + ", " + std::to_string(y) + ") stored as " + Tiled_Image::format_name(format)
+						                  + " reads back as " + std::to_string(b[c]) + " instead of " + std::to_string(a[c]) + ".");
+					}
+				}
+			}
+		}
+	}
+
+	//(no padding when the size is a multiple of the tile size)
+	HDR_Image square(64, 64);
+	if (Tiled_Image(square, Tiled_Image::Format::Float).bytes() != 64 * 64 * 12
+	 || Tiled_Image(square, Tiled_Image::Format::Half).bytes() != 64 * 64 * 6
+	 || Tiled_Image(square, Tiled_Image::Format::RGB9E5).bytes() != 64 * 64 * 4) {
+		throw Test::error("Tiled image texel data is not the expected size.");
+	}
+});
+
+Test test_a1_tiled_image_bilinear("a1.tiled_image.bilinear", []() {
+	RNG rng(0xb111);
+	HDR_Image image = random_image(19, 10, rng);
+	Tiled_Image tiled(image, Tiled_Image::Format::Float);
+
+	//reference bilinear filter, clamping to the border:
+	auto reference = [&](Vec2 uv) {
+		float x = image.w * std::clamp(uv.x, 0.0f, 1.0f) - 0.5f;
+		float y = image.h * std::clamp(uv.y, 0.0f, 1.0f) - 0.5f;
+		auto texel = [&](float tx, float ty) {
+			return image.at(uint32_t(std::clamp(int32_t(tx), 0, int32_t(image.w) - 1)),
+			                uint32_t(std::clamp(int32_t(ty), 0, int32_t(image.h) - 1)));
+		};
+		float fx = std::floor(x), fy = std::floor(y);
+		return lerp(lerp(texel(fx, fy), texel(fx + 1.0f, fy), x - fx),
+		            lerp(texel(fx, fy + 1.0f), texel(fx + 1.0f, fy + 1.0f), x - fx), y - fy);
+	};
+
+	for (uint32_t i = 0; i < 1000; ++i) {
+		Vec2 uv(rng.unit() * 1.2f - 0.1f, rng.unit() * 1.2f - 0.1f);
+		if (Test::differs(tiled.sample_bilinear(uv), reference(uv))) {
+			throw Test::error("Bilinear sample at " + std::to_string(uv.x) + ", " + std::to_string(uv.y) + " doesn't match the reference.");
+		}
+	}
+});
+
+Test test_a1_tiled_image_compact("a1.tiled_image.compact", []() {
+	RNG rng(0xc0ac7);
+	Textures::Image texture(Textures::Image::Sampler::nearest, random_image(33, 17, rng));
+
+	std::vector< std::pair< Vec2, Spectrum > > expected;
+	for (uint32_t i = 0; i < 100; ++i) {
+		Vec2 uv(rng.unit(), rng.unit());
+		expected.emplace_back(uv, texture.evaluate(uv, 0.0f));
+	}
+
+	texture.compact(Tiled_Image::Format::Float);
+	Textures::Image copy = texture.copy();
+	if (texture.image.w != 0 || copy.tiled.size() != 1) {
+		throw Test::error("Compacting a texture should replace its image with a tiled copy.");
+	}
+	for (auto const &[uv, value] : expected) {
+		if (Test::differs(copy.evaluate(uv, 0.0f), value)) {
+			throw Test::error("Compacted texture samples differently than the original.");
+		}
+	}
+});
@@ -0,0 +1,207 @@
+#include "test.h"
+
+//Actually include the *definitions* (not just the declarations):
+#include "rasterizer/pipeline.cpp"
+#include "util/hdr_image.h"
+#include "util/rand.h"
+
+//random primitives (some poking out of the view, so they get clipped), drawn by the Copy program:
+template< typename P >
+static std::vector< typename P::Vertex > random_primitives(RNG &rng, uint32_t count, uint32_t corners) {
+	std::vector< typename P::Vertex > vertices;
+	for (uint32_t i = 0; i < count; ++i) {
+		float r = rng.unit(), g = rng.unit(), b = rng.unit(), a = 0.2f + 0.6f * rng.unit();
+		for (uint32_t c = 0; c < corners; ++c) {
+			float x = 2.4f * rng.unit() - 1.2f, y = 2.4f * rng.unit() - 1.2f, z = 1.8f * rng.unit() - 0.9f;
+			vertices.emplace_back(typename P::Vertex{ std::array< float, 8 >{ x, y, z, 1.0f, r, g, b, a } });
+		}
+	}
+	return vertices;
+}
+
+//drawing everything in one run (binned into many tiles, drawn in parallel) matches drawing one primitive per run:
+template< typename P >
+static void check_order(uint32_t corners) {
+	for (SamplePattern const &pattern : SamplePattern::all_patterns()) {
+		if (pattern.centers_and_weights.size() > 4) continue; //(bigger patterns don't test anything new)
+		RNG rng(0x71ed);
+		std::vector< typename P::Vertex > vertices = random_primitives< P >(rng, 200, corners);
+
+		Framebuffer together(2 * P::TileSize + 6, P::TileSize + 10, pattern);
+		Framebuffer separately(together.width, together.height, pattern);
+
+		P::run(vertices, Programs::Copy::Parameters(), &together);
+		for (uint32_t i = 0; i < vertices.size(); i += corners) {
+			std::vector< typename P::Vertex > one(vertices.begin() + i, vertices.begin() + i + corners);
+			P::run(one, Programs::Copy::Parameters(), &separately);
+		}
+
+		for (size_t i = 0; i < together.colors.size(); ++i) {
+			if (together.colors[i] != separately.colors[i] || together.depths[i] != separately.depths[i]) {
+				throw Test::error("With sample pattern '" + pattern.name + "', drawing all primitives at once gave a different result at sample " + std::to_string(i) + ".");
+			}
+		}
+	}
+}
+
+Test test_a1_tiled_raster_triangles_over("a1.tiled_raster.triangles.over", []() {
+	check_order< Pipeline< PrimitiveType::Triangles, Programs::Copy, Pipeline_Blend_Over | Pipeline_Depth_Less | Pipeline_Interp_Smooth > >(3);
+});
+
+Test test_a1_tiled_raster_lines_add("a1.tiled_raster.lines.add", []() {
+	check_order< Pipeline< PrimitiveType::Lines, Programs::Copy, Pipeline_Blend_Add | Pipeline_Depth_Always | Pipeline_Interp_Flat > >(2);
+});
+
+//triangles sharing edges that run through pixel centers cover each of those pixels exactly once:
+Test test_a1_tiled_raster_shared_edges("a1.tiled_raster.shared_edges", []() {
+	using P = Pipeline< PrimitiveType::Triangles, Programs::Copy, Pipeline_Blend_Replace | Pipeline_Depth_Always | Pipeline_Interp_Flat >;
+	auto vertex = [](float x, float y) {
+		P::ClippedVertex v;
+		v.fb_position = Vec3{x, y, 0.5f};
+		v.inv_w = 1.0f;
+		v.attributes.fill(0.0f);
+		return v;
+	};
+	//a fan around (20.5, 20.5) filling the square [4.5,36.5]^2, with alternating windings:
+	std::vector< Vec2 > ring{
+		Vec2{4.5f, 4.5f}, Vec2{20.5f, 4.5f}, Vec2{36.5f, 4.5f}, Vec2{36.5f, 20.5f},
+		Vec2{36.5f, 36.5f}, Vec2{20.5f, 36.5f}, Vec2{4.5f, 36.5f}, Vec2{4.5f, 20.5f}
+	};
+	std::vector< uint32_t > hits(48 * 48, 0);
+	for (uint32_t i = 0; i < ring.size(); ++i) {
+		P::ClippedVertex center = vertex(20.5f, 20.5f);
+		P::ClippedVertex a = vertex(ring[i].x, ring[i].y);
+		P::ClippedVertex b = vertex(ring[(i + 1) % ring.size()].x, ring[(i + 1) % ring.size()].y);
+		auto emit = [&](P::Fragment const &f) { hits[uint32_t(f.fb_position.y) * 48 + uint32_t(f.fb_position.x)] += 1; };
+		if (i % 2) P::rasterize_triangle(center, a, b, emit);
+		else P::rasterize_triangle(center, b, a, emit);
+	}
+	for (uint32_t y = 0; y < 48; ++y) {
+		for (uint32_t x = 0; x < 48; ++x) {
+			bool interior = 5 <= x && x <= 35 && 5 <= y && y <= 35;
+			uint32_t h = hits[y * 48 + x];
+			if (h > 1 || (interior && h != 1)) {
+				throw Test::error("Pixel (" + std::to_string(x) + ", " + std::to_string(y) + ") was covered " + std::to_string(h) + " times.");
+			}
+		}
+	}
+});
+
+//opaque triangles drawn with Blend_Replace (depth pass, then shading only what is in front) look the same as
+// when drawn with Blend_Over (where every fragment that passes the depth test is shaded as it arrives):
+Test test_a1_tiled_raster_triangles_replace("a1.tiled_raster.triangles.replace", []() {
+	using Replace = Pipeline< PrimitiveType::Triangles, Programs::Copy, Pipeline_Blend_Replace | Pipeline_Depth_Less | Pipeline_Interp_Smooth >;
+	using Over = Pipeline< PrimitiveType::Triangles, Programs::Copy, Pipeline_Blend_Over | Pipeline_Depth_Less | Pipeline_Interp_Smooth >;
+	for (SamplePattern const &pattern : SamplePattern::all_patterns()) {
+		if (pattern.centers_and_weights.size() > 4) continue;
+		RNG rng(0x2e9a);
+		std::vector< Replace::Vertex > vertices = random_primitives< Replace >(rng, 300, 3);
+		for (auto &v : vertices) v.attributes[Programs::Copy::VA_ColorA] = 1.0f;
+
+		Framebuffer replaced(2 * Replace::TileSize + 6, Replace::TileSize + 10, pattern);
+		Framebuffer blended(replaced.width, replaced.height, pattern);
+		//(twice, so the second run starts from a full depth buffer)
+		for (uint32_t run = 0; run < 2; ++run) {
+			Replace::run(vertices, Programs::Copy::Parameters(), &replaced);
+			Over::run(vertices, Programs::Copy::Parameters(), &blended);
+		}
+
+		for (size_t i = 0; i < replaced.colors.size(); ++i) {
+			if (replaced.colors[i] != blended.colors[i] || replaced.depths[i] != blended.depths[i]) {
+				throw Test::error("With sample pattern '" + pattern.name + "', Blend_Replace and opaque Blend_Over differ at sample " + std::to_string(i) + ".");
+			}
+		}
+	}
+});
+
+//an indexed run draws the same as a run over the vertices the indices pick out:
+Test test_a1_tiled_raster_indexed("a1.tiled_raster.indexed", []() {
+	using P = Pipeline< PrimitiveType::Triangles, Programs::Copy, Pipeline_Blend_Over | Pipeline_Depth_Less | Pipeline_Interp_Correct >;
+	RNG rng(0x1d3c);
+	//a jittered grid (running off the edges of the view) with two triangles per cell:
+	constexpr uint32_t N = 9;
+	std::vector< P::Vertex > vertices;
+	for (uint32_t y = 0; y < N; ++y) {
+		for (uint32_t x = 0; x < N; ++x) {
+			float px = 2.6f * (float(x) + 0.4f * rng.unit()) / (N - 1) - 1.3f;
+			float py = 2.6f * (float(y) + 0.4f * rng.unit()) / (N - 1) - 1.3f;
+			float w = 0.5f + rng.unit();
+			vertices.emplace_back(P::Vertex{ std::array< float, 8 >{ px * w, py * w, (rng.unit() - 0.5f) * w, w, rng.unit(), rng.unit(), rng.unit(), 0.7f } });
+		}
+	}
+	std::vector< uint32_t > indices;
+	for (uint32_t y = 0; y + 1 < N; ++y) {
+		for (uint32_t x = 0; x + 1 < N; ++x) {
+			uint32_t i = y * N + x;
+			indices.insert(indices.end(), { i, i + 1, i + N + 1, i, i + N + 1, i + N });
+		}
+	}
+	std::vector< P::Vertex > expanded;
+	for (uint32_t i : indices) expanded.emplace_back(vertices[i]);
+
+	Framebuffer indexed(2 * P::TileSize + 6, P::TileSize + 10, SamplePattern::all_patterns()[0]);
+	Framebuffer flat(indexed.width, indexed.height, indexed.sample_pattern);
+	P::run(vertices, indices, Programs::Copy::Parameters(), &indexed);
+	P::run(expanded, Programs::Copy::Parameters(), &flat);
+	if (indexed.colors != flat.colors || indexed.depths != flat.depths) {
+		throw Test::error("Indexed and non-indexed runs drew different results.");
+	}
+
+	indices.back() = uint32_t(vertices.size());
+	bool threw = false;
+	try {
+		P::run(vertices, indices, Programs::Copy::Parameters(), &indexed);
+	} catch (std::runtime_error &) {
+		threw = true;
+	}
+	if (!threw) throw Test::error("Out-of-range index was not reported.");
+});
+
+//with flat attributes, shading once per pixel (and blending into its covered samples) matches shading every sample:
+Test test_a1_tiled_raster_sample_masks("a1.tiled_raster.sample_masks", []() {
+	using PerPixel = Pipeline< PrimitiveType::Triangles, Programs::Copy, Pipeline_Blend_Over | Pipeline_Depth_Less | Pipeline_Interp_Flat >;
+	using PerSample = Pipeline< PrimitiveType::Triangles, Programs::Copy, Pipeline_Blend_Over | Pipeline_Depth_Less | Pipeline_Interp_Flat | Pipeline_SampleShadingBit >;
+	for (SamplePattern const &pattern : SamplePattern::all_patterns()) {
+		if (pattern.centers_and_weights.size() < 2 || pattern.centers_and_weights.size() > 16) continue;
+		RNG rng(0x5a3b);
+		std::vector< PerPixel::Vertex > vertices = random_primitives< PerPixel >(rng, 200, 3);
+
+		Framebuffer per_pixel(2 * PerPixel::TileSize + 6, PerPixel::TileSize + 10, pattern);
+		Framebuffer per_sample(per_pixel.width, per_pixel.height, pattern);
+		PerPixel::run(vertices, Programs::Copy::Parameters(), &per_pixel);
+		PerSample::run(vertices, Programs::Copy::Parameters(), &per_sample);
+
+		for (size_t i = 0; i < per_pixel.colors.size(); ++i) {
+			if (per_pixel.colors[i] != per_sample.colors[i] || per_pixel.depths[i] != per_sample.depths[i]) {
+				throw Test::error("With sample pattern '" + pattern.name + "', per-pixel and per-sample shading differ at sample " + std::to_string(i) + ".");
+			}
+		}
+	}
+});
+
+//resolving just the tiles touched by each run keeps an image the same as resolving everything:
+Test test_a1_tiled_raster_resolve_touched("a1.tiled_raster.resolve_touched", []() {
+	using P = Pipeline< PrimitiveType::Triangles, Programs::Copy, Pipeline_Blend_Over | Pipeline_Depth_Less | Pipeline_Interp_Smooth >;
+	for (SamplePattern const &pattern : SamplePattern::all_patterns()) {
+		if (pattern.centers_and_weights.size() > 4) continue;
+		RNG rng(0x7e50);
+		Framebuffer fb(3 * Framebuffer::ResolveTileSize + 6, 2 * Framebuffer::ResolveTileSize + 10, pattern);
+		HDR_Image image;
+		if (fb.resolve_touched(&image) != 4 * 3) throw Test::error("First resolve didn't resolve every tile.");
+		for (uint32_t run = 0; run < 6; ++run) {
+			//(small triangles, so most runs leave some tiles alone)
+			std::vector< P::Vertex > vertices;
+			float cx = 2.0f * rng.unit() - 1.0f, cy = 2.0f * rng.unit() - 1.0f;
+			for (uint32_t c = 0; c < 6; ++c) {
+				vertices.emplace_back(P::Vertex{ std::array< float, 8 >{ cx + 0.3f * rng.unit(), cy + 0.3f * rng.unit(), rng.unit() - 0.5f, 1.0f, rng.unit(), rng.unit(), rng.unit(), 0.5f } });
+			}
+			P::run(vertices, Programs::Copy::Parameters(), &fb);
+			uint32_t resolved = fb.resolve_touched(&image);
+			if (resolved == 0 || resolved >= 4 * 3) throw Test::error("Run " + std::to_string(run) + " resolved " + std::to_string(resolved) + " tiles.");
+			if (image != fb.resolve_colors()) {
+				throw Test::error("With sample pattern '" + pattern.name + "', resolving touched tiles differs from resolving everything after run " + std::to_string(run) + ".");
+			}
+		}
+		if (fb.resolve_touched(&image) != 0) throw Test::error("Resolving again resolved tiles that didn't change.");
+	}
+});
@@ -0,0 +1,91 @@
+#include "test.h"
+#include "pathtracer/denoiser.h"
+#include "util/rand.h"
+#include "util/thread_pool.h"
+
+using PT::Denoise_Features;
+using PT::Denoise_Options;
+
+static Denoise_Features flat_features(uint32_t w, uint32_t h) {
+	Denoise_Features features;
+	features.w = w;
+	features.h = h;
+	features.albedo.assign(size_t(w) * h, Spectrum(0.5f, 0.6f, 0.7f));
+	features.normal.assign(size_t(w) * h, Vec3{0.0f, 1.0f, 0.0f});
+	return features;
+}
+
+Test test_a3_denoise_flat("a3.denoise.flat", []() {
+	uint32_t w = 64, h = 48;
+	Denoise_Features features = flat_features(w, h);
+
+	//noisy image of a uniformly lit surface:
+	RNG rng(0xde7015e);
+	Spectrum expected = Spectrum(0.5f, 0.6f, 0.7f) * 0.8f;
+	HDR_Image noisy(w, h);
+	for (uint32_t i = 0; i < w * h; ++i) {
+		noisy.at(i) = expected * (0.5f + rng.unit());
+	}
+
+	HDR_Image result = PT::denoise(noisy, features);
+
+	auto rms_error = [&](HDR_Image const &image) {
+		double sum = 0.0;
+		for (uint32_t i = 0; i < w * h; ++i) {
+			Spectrum d = image.at(i) - expected;
+			sum += d.r * d.r + d.g * d.g + d.b * d.b;
+		}
+		return std::sqrt(sum / (w * h));
+	};
+	double before = rms_error(noisy), after = rms_error(result);
+	if (!(after < 0.25 * before)) {
+		throw Test::error("Denoising a noisy flat image only reduced error from " + std::to_string(before) + " to " + std::to_string(after) + ".");
+	}
+});
+
+Test test_a3_denoise_edges("a3.denoise.edges", []() {
+	uint32_t w = 64, h = 32;
+	Denoise_Features features = flat_features(w, h);
+
+	//a dim floor meeting a bright wall at x = w/2, no noise:
+	HDR_Image image(w, h);
+	for (uint32_t y = 0; y < h; ++y) {
+		for (uint32_t x = 0; x < w; ++x) {
+			bool wall = (x >= w / 2);
+			features.normal[y * w + x] = wall ? Vec3{-1.0f, 0.0f, 0.0f} : Vec3{0.0f, 1.0f, 0.0f};
+			image.at(x, y) = features.albedo[y * w + x] * (wall ? 2.0f : 0.2f);
+		}
+	}
+
+	HDR_Image result = PT::denoise(image, features);
+
+	for (uint32_t y = 0; y < h; ++y) {
+		for (uint32_t x : {w / 2 - 1, w / 2}) {
+			Spectrum d = result.at(x, y) - image.at(x, y);
+			if (std::max({std::abs(d.r), std::abs(d.g), std::abs(d.b)}) > 0.01f * image.at(x, y).luma()) {
+				throw Test::error("Denoising blurred across a geometric edge at (" + std::to_string(x) + ", " + std::to_string(y) + ").");
+			}
+		}
+	}
+});
+
+Test test_a3_denoise_threads("a3.denoise.threads", []() {
+	uint32_t w = 37, h = 29;
+	Denoise_Features features = flat_features(w, h);
+	RNG rng(0x7412ead5);
+	HDR_Image noisy(w, h);
+	for (uint32_t i = 0; i < w * h; ++i) {
+		noisy.at(i) = Spectrum(rng.unit(), rng.unit(), rng.unit());
+		features.normal[i] = Vec3{rng.unit(), 1.0f, 0.0f}.unit();
+	}
+
+	Denoise_Options serial, parallel;
+	parallel.pool = &Thread_Pool::shared();
+	HDR_Image a = PT::denoise(noisy, features, serial);
+	HDR_Image b = PT::denoise(noisy, features, parallel);
+	for (uint32_t i = 0; i < w * h; ++i) {
+		if (!(a.at(i) == b.at(i))) {
+			throw Test::error("Denoising with several threads gave a different result than with one.");
+		}
+	}
+});
@@ -0,0 +1,99 @@
+#include "test.h"
+#include "util/hdr_image.h"
+
+#include <array>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+
+//a non-square image where every channel of every pixel is different:
+static HDR_Image gradient_image(uint32_t w, uint32_t h) {
+	HDR_Image image(w, h);
+	for (uint32_t y = 0; y < h; ++y) {
+		for (uint32_t x = 0; x < w; ++x) {
+			image.at(x, y) = Spectrum(0.25f + x, 0.5f + 100.0f * y, 1.0f / (1.0f + x + w * y));
+		}
+	}
+	return image;
+}
+
+static std::string temp_file(std::string const &name) {
+	return (std::filesystem::temp_directory_path() / ("scotty3d-test-" + name)).generic_string();
+}
+
+static void expect_same_image(HDR_Image const &got, HDR_Image const &expected) {
+	if (got.w != expected.w || got.h != expected.h) {
+		throw Test::error("Image is " + std::to_string(got.w) + "x" + std::to_string(got.h) + ", expected " + std::to_string(expected.w) + "x" + std::to_string(expected.h) + ".");
+	}
+	for (uint32_t y = 0; y < got.h; ++y) {
+		for (uint32_t x = 0; x < got.w; ++x) {
+			Spectrum a = got.at(x, y), b = expected.at(x, y);
+			if (a.r != b.r || a.g != b.g || a.b != b.b) {
+				throw Test::error("Pixel (" + std::to_string(x) + ", " + std::to_string(y) + ") is " + to_string(a) + ", expected " + to_string(b) + ".");
+			}
+		}
+	}
+}
+
+Test test_a3_hdr_output_exr("a3.hdr_output.exr", []() {
+	HDR_Image image = gradient_image(7, 3);
+	std::string filename = temp_file("exr.exr");
+	image.save(filename);
+	HDR_Image loaded = HDR_Image::load(filename);
+	std::filesystem::remove(filename);
+	expect_same_image(loaded, image);
+});
+
+Test test_a3_hdr_output_exr_regions("a3.hdr_output.exr.regions", []() {
+	//write an image as out-of-order regions (as the pathtracer's tiles would be):
+	uint32_t w = 10, h = 6;
+	HDR_Image image = gradient_image(w, h);
+	std::string filename = temp_file("exr-regions.exr");
+	{
+		HDR_Image_Writer writer(filename, w, h);
+		for (auto [x0, y0, x1, y1] : std::vector< std::array< uint32_t, 4 > >{{4, 2, 10, 6}, {0, 0, 4, 6}, {4, 0, 10, 2}}) {
+			HDR_Image region(x1 - x0, y1 - y0);
+			for (uint32_t y = y0; y < y1; ++y) {
+				for (uint32_t x = x0; x < x1; ++x) {
+					region.at(x - x0, y - y0) = image.at(x, y);
+				}
+			}
+			writer.write(x0, y0, region);
+		}
+	}
+	HDR_Image loaded = HDR_Image::load(filename);
+	std::filesystem::remove(filename);
+	expect_same_image(loaded, image);
+});
+
+Test test_a3_hdr_output_pfm("a3.hdr_output.pfm", []() {
+	uint32_t w = 5, h = 2;
+	HDR_Image image = gradient_image(w, h);
+	std::string filename = temp_file("pfm.pfm");
+	image.save(filename);
+
+	std::ifstream file(filename, std::ios::binary);
+	std::string bytes((std::istreambuf_iterator< char >(file)), std::istreambuf_iterator< char >());
+	file.close();
+	std::filesystem::remove(filename);
+
+	std::string header = "PF\n5 2\n-1.0\n";
+	if (bytes.substr(0, header.size()) != header) {
+		throw Test::error("PFM header is '" + bytes.substr(0, header.size()) + "', expected '" + header + "'.");
+	}
+	if (bytes.size() != header.size() + size_t(w) * h * 12) {
+		throw Test::error("PFM is " + std::to_string(bytes.size()) + " bytes, expected " + std::to_string(header.size() + w * h * 12) + ".");
+	}
+	//scanlines go from the bottom up, as packed r,g,b floats:
+	for (uint32_t y = 0; y < h; ++y) {
+		for (uint32_t x = 0; x < w; ++x) {
+			float rgb[3];
+			std::memcpy(rgb, bytes.data() + header.size() + (size_t(y) * w + x) * 12, 12);
+			Spectrum expected = image.at(x, y);
+			if (rgb[0] != expected.r || rgb[1] != expected.g || rgb[2] != expected.b) {
+				throw Test::error("PFM pixel (" + std::to_string(x) + ", " + std::to_string(y) + ") is (" + std::to_string(rgb[0]) + ", " + std::to_string(rgb[1]) + ", " + std::to_string(rgb[2]) + "), expected (" + std::to_string(expected.r) + ", " + std::to_string(expected.g) + ", " + std::to_string(expected.b) + ").");
+			}
+		}
+	}
+});
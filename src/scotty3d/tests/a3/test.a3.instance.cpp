@@ -0,0 +1,84 @@
+#include "test.h"
+#include "pathtracer/instance.h"
+#include "scene/shape.h"
+
+//NOTE: instances of spheres are hit with Shapes::Sphere::hit, so the hit test needs task 2 (sphere hits) to be done.
+
+//one transform of each kind an instance handles differently (identity, translation, general affine):
+static const std::vector< std::pair< std::string, Mat4 > > Transforms = {
+	{"identity", Mat4::I},
+	{"translation", Mat4::translate(Vec3{1.0f, -2.0f, 3.0f})},
+	{"affine", Mat4::translate(Vec3{0.5f, 1.0f, -1.5f}) * Mat4::euler(Vec3{30.0f, -45.0f, 10.0f}) * Mat4::scale(Vec3{2.0f, 0.5f, 1.5f})},
+};
+
+//what an instance should report, computed with full matrices (the way instances used to work):
+static PT::Trace reference_hit(Shape const &shape, Mat4 const &T, Ray ray) {
+	Mat4 iT = T.inverse();
+	ray.transform(iT);
+	PT::Trace trace = shape.hit(ray);
+	if (trace.hit) trace.transform(T, iT.T());
+	return trace;
+}
+
+static BBox reference_bbox(Shape const &shape, Mat4 const &T) {
+	BBox box;
+	for (Vec3 corner : shape.bbox().corners()) {
+		box.enclose(T * corner);
+	}
+	return box;
+}
+
+Test test_a3_instance_bbox("a3.instance.bbox", []() {
+	Shape sphere(Shapes::Sphere{1.5f});
+	for (auto const &[kind, T] : Transforms) {
+		PT::Instance instance(&sphere, nullptr, T);
+		BBox got = instance.bbox(), expected = reference_bbox(sphere, T);
+		if (Test::differs(got.min, expected.min) || Test::differs(got.max, expected.max)) {
+			throw Test::error("Bounding box of " + kind + " instance is " + to_string(got.min) + " - " + to_string(got.max) + ", expected " + to_string(expected.min) + " - " + to_string(expected.max) + ".");
+		}
+	}
+});
+
+Test test_a3_instance_hit("a3.instance.hit", []() {
+	Shape sphere(Shapes::Sphere{1.5f});
+	if (!sphere.hit(Ray(Vec3{0.0f, 0.0f, -5.0f}, Vec3{0.0f, 0.0f, 1.0f})).hit) {
+		throw Test::ignored("Sphere hits (task 2) aren't done yet.");
+	}
+
+	for (auto const &[kind, T] : Transforms) {
+		PT::Instance instance(&sphere, nullptr, T);
+		Vec3 center = T * Vec3{0.0f, 0.0f, 0.0f};
+
+		//rays from around the instance towards (and past) it, some of them with limited distance:
+		std::vector< Ray > rays;
+		for (Vec3 from : {Vec3{0.0f, 0.0f, -8.0f}, Vec3{6.0f, 5.0f, 2.0f}, Vec3{-3.0f, 7.0f, -4.0f}}) {
+			for (Vec3 aim : {Vec3{0.0f, 0.0f, 0.0f}, Vec3{0.4f, -0.3f, 0.2f}, Vec3{2.5f, 0.0f, 0.0f}, Vec3{0.0f, 4.0f, 0.0f}}) {
+				rays.emplace_back(center + from, aim - from);
+				rays.emplace_back(center + from, aim - from, Vec2{0.0f, 6.0f});
+			}
+		}
+		//...and from inside it:
+		rays.emplace_back(center, Vec3{1.0f, 2.0f, -0.5f});
+
+		for (Ray const &ray : rays) {
+			PT::Trace got = instance.hit(ray), expected = reference_hit(sphere, T, ray);
+			std::string what = kind + " instance hit by ray from " + to_string(ray.point) + " in direction " + to_string(ray.dir);
+			if (got.hit != expected.hit) {
+				throw Test::error(what + (got.hit ? " hit it, expected a miss." : " missed it, expected a hit."));
+			}
+			if (!got.hit) continue;
+			if (Test::differs(got.position, expected.position) || Test::differs(got.origin, expected.origin)) {
+				throw Test::error(what + " hit at " + to_string(got.position) + " (from " + to_string(got.origin) + "), expected " + to_string(expected.position) + " (from " + to_string(expected.origin) + ").");
+			}
+			if (Test::differs(got.normal, expected.normal)) {
+				throw Test::error(what + " has normal " + to_string(got.normal) + ", expected " + to_string(expected.normal) + ".");
+			}
+			if (Test::differs(got.uv, expected.uv)) {
+				throw Test::error(what + " has uv " + to_string(got.uv) + ", expected " + to_string(expected.uv) + ".");
+			}
+			if (std::abs(got.distance - expected.distance) > Test::differs_eps * std::max(1.0f, expected.distance)) {
+				throw Test::error(what + " has distance " + std::to_string(got.distance) + ", expected " + std::to_string(expected.distance) + ".");
+			}
+		}
+	}
+});
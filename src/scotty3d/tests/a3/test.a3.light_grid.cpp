@@ -0,0 +1,46 @@
+#include "test.h"
+
+#include "pathtracer/light_grid.h"
+
+Test test_a3_light_grid_learn("a3.light_grid.learn", []() {
+	PT::Light_Grid grid;
+	grid.reset(BBox(Vec3{-1.0f}, Vec3{1.0f}), 2);
+
+	RNG rng(0x1234);
+	if (grid.trained() || grid.probabilities(Vec3{0.0f}) || grid.select(rng, Vec3{0.0f}) >= 2) {
+		throw Test::error("Untrained light grid should pick lights uniformly.");
+	}
+
+	//light 0 is bright on the -x side, light 1 on the +x side:
+	Vec3 left{-0.9f, 0.0f, 0.0f}, right{0.9f, 0.0f, 0.0f};
+	for (uint32_t i = 0; i < 10; ++i) {
+		grid.record(left, 0, 1.0f);
+		grid.record(left, 1, 0.0f);
+		grid.record(right, 0, 0.0f);
+		grid.record(right, 1, 1.0f);
+	}
+	grid.finish();
+	if (!grid.trained()) throw Test::error("Light grid should be trained after finish().");
+
+	float uniform = PT::Light_Grid::Uniform_Fraction / 2.0f;
+	float const *p = grid.probabilities(left);
+	if (Test::differs(p[0], 1.0f - uniform) || Test::differs(p[1], uniform)) {
+		throw Test::error("Light grid learned probabilities " + std::to_string(p[0]) + ", " + std::to_string(p[1]) + " on the left; expected " + std::to_string(1.0f - uniform) + ", " + std::to_string(uniform) + ".");
+	}
+
+	//select() should follow probabilities():
+	uint32_t picked[2] = {0, 0};
+	for (uint32_t i = 0; i < 10000; ++i) {
+		picked[grid.select(rng, right)] += 1;
+	}
+	float expected = grid.probabilities(right)[0] * 10000.0f;
+	if (std::abs(picked[0] - expected) > 200.0f) {
+		throw Test::error("Light grid picked light 0 " + std::to_string(picked[0]) + " times out of 10000; expected about " + std::to_string(expected) + ".");
+	}
+
+	//cells with nothing recorded stay uniform:
+	float const *middle = grid.probabilities(Vec3{0.0f, 0.9f, 0.9f});
+	if (Test::differs(middle[0], 0.5f) || Test::differs(middle[1], 0.5f)) {
+		throw Test::error("Light grid cell without training data should be uniform.");
+	}
+});
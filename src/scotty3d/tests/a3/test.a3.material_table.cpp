@@ -0,0 +1,67 @@
+#include "test.h"
+#include "pathtracer/material_table.h"
+
+using PT::Material_Table;
+
+Test test_a3_material_table_flags("a3.material_table.flags", []() {
+	auto white = std::make_shared<Texture>(Textures::Constant{Spectrum{1.0f}});
+
+	std::vector< Material > list;
+	list.emplace_back(Materials::Lambertian{white});
+	list.emplace_back(Materials::Mirror{white});
+	list.emplace_back(Materials::Refract{white});
+	list.emplace_back(Materials::Glass{white, white});
+	list.emplace_back(Materials::Emissive{white});
+
+	Material_Table table;
+	for (auto const &material : list) table.add(material);
+
+	if (table.size() != list.size()) {
+		throw Test::error("Table has " + std::to_string(table.size()) + " materials, expected " + std::to_string(list.size()) + ".");
+	}
+	for (uint32_t id = 0; id < table.size(); ++id) {
+		Material const &material = list[id];
+		if (table.id(&table.material(id)) != id) {
+			throw Test::error("Material id doesn't round-trip through its pointer.");
+		}
+		if (table.is_emissive(id) != material.is_emissive()
+		 || table.is_specular(id) != material.is_specular()
+		 || table.is_sided(id) != material.is_sided()) {
+			throw Test::error("Table flags for material " + std::to_string(id) + " differ from the material's.");
+		}
+	}
+});
+
+Test test_a3_material_table_textures("a3.material_table.textures", []() {
+	auto bright = std::make_shared<Texture>(Textures::Constant{Spectrum{2.0f, 4.0f, 1.0f}});
+
+	HDR_Image pixels(2, 2);
+	pixels.at(0, 0) = Spectrum(0.1f, 0.2f, 0.3f);
+	pixels.at(1, 0) = Spectrum(0.4f, 0.5f, 0.6f);
+	pixels.at(0, 1) = Spectrum(0.7f, 0.8f, 0.9f);
+	pixels.at(1, 1) = Spectrum(1.0f, 0.0f, 0.5f);
+	auto image = std::make_shared<Texture>(Textures::Image{Textures::Image::Sampler::nearest, pixels});
+
+	Material_Table table;
+	uint32_t lamp = table.add(Material(Materials::Emissive{bright}));
+	uint32_t poster = table.add(Material(Materials::Lambertian{image}));
+	uint32_t glowing_poster = table.add(Material(Materials::Emissive{image}));
+	uint32_t untextured = table.add(Material(Materials::Lambertian{}));
+
+	for (Vec2 uv : {Vec2{0.25f, 0.25f}, Vec2{0.75f, 0.25f}, Vec2{0.25f, 0.75f}, Vec2{0.75f, 0.75f}}) {
+		if (Test::differs(table.emission(lamp, uv), bright->evaluate(uv))
+		 || Test::differs(table.albedo(lamp, uv), bright->evaluate(uv))) {
+			throw Test::error("Constant emissive material doesn't match its texture.");
+		}
+		if (Test::differs(table.emission(poster, uv), Spectrum{})
+		 || Test::differs(table.albedo(poster, uv), image->evaluate(uv))) {
+			throw Test::error("Image-textured lambertian material doesn't match its texture.");
+		}
+		if (Test::differs(table.emission(glowing_poster, uv), image->evaluate(uv))) {
+			throw Test::error("Image-textured emissive material doesn't match its texture.");
+		}
+		if (Test::differs(table.albedo(untextured, uv), Spectrum{})) {
+			throw Test::error("Material without a texture should have zero albedo.");
+		}
+	}
+});
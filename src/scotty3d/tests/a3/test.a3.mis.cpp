@@ -0,0 +1,151 @@
+#include "test.h"
+#include "pathtracer/pathtracer.h"
+#include "util/rand.h"
+
+//NOTE: these tests trace real rays (without a BVH), so they need tasks 2 (triangle hits), 4 (Lambertian,
+// direct + indirect lighting), 5 (mirror), and 6 (area light sampling). They report themselves as ignored
+// (rather than failing) while the tasks they depend on are obviously not done yet.
+
+using Shading_Info = PT::Pathtracer::Shading_Info;
+
+//a 10x10 floor at y = 0 made of 'floor' (given a texture of 'color'), under a 1x1 square light at y = 1 with 'Radiance' emission:
+static const Spectrum Radiance = Spectrum(4.0f, 2.0f, 1.0f);
+static const std::vector< Vec3 > Light_Corners = {
+	Vec3{-0.5f, 1.0f, -0.5f}, Vec3{0.5f, 1.0f, -0.5f}, Vec3{0.5f, 1.0f, 0.5f}, Vec3{-0.5f, 1.0f, 0.5f}
+};
+
+static Scene floor_and_light(Spectrum color, std::function< Material(std::weak_ptr< Texture >) > const &floor) {
+	Scene scene;
+	auto transform = std::make_shared<Transform>();
+	scene.transforms.emplace("transform", transform);
+
+	scene.textures.emplace("color", std::make_shared<Texture>(Textures::Constant{color, 1.0f}));
+	scene.textures.emplace("radiance", std::make_shared<Texture>(Textures::Constant{Radiance, 1.0f}));
+	scene.materials.emplace("floor", std::make_shared<Material>(floor(scene.textures.at("color"))));
+	scene.materials.emplace("light", std::make_shared<Material>(Materials::Emissive{scene.textures.at("radiance")}));
+
+	//(with corner normals, since hits interpolate them)
+	auto quad = [](std::vector< Vec3 > const &corners) {
+		auto mesh = std::make_shared<Halfedge_Mesh>(Halfedge_Mesh::from_indexed_faces(corners, {{0, 1, 2, 3}}));
+		mesh->set_corner_normals();
+		return mesh;
+	};
+	scene.meshes.emplace("floor", quad({Vec3{-5.0f, 0.0f, 5.0f}, Vec3{5.0f, 0.0f, 5.0f}, Vec3{5.0f, 0.0f, -5.0f}, Vec3{-5.0f, 0.0f, -5.0f}}));
+	scene.meshes.emplace("light", quad(Light_Corners));
+
+	for (std::string name : {"floor", "light"}) {
+		auto instance = std::make_shared<Instance::Mesh>();
+		instance->transform = transform;
+		instance->mesh = scene.meshes.at(name);
+		instance->material = scene.materials.at(name);
+		scene.instances.meshes.emplace(name, instance);
+	}
+	return scene;
+}
+
+//the floor at (1,0,0), seen from (3,2,0) -- which mirrors to the light's center:
+static Shading_Info floor_hit(PT::Pathtracer &pathtracer) {
+	Vec3 eye{3.0f, 2.0f, 0.0f}, at{1.0f, 0.0f, 0.0f};
+	std::optional<Shading_Info> hit = pathtracer.shading_info(Ray(eye, at - eye, Vec2{0.0f, std::numeric_limits<float>::infinity()}, 4));
+	if (!hit) throw Test::ignored("Ray towards the floor didn't hit it (are triangle hits done?).");
+	if (Test::differs(hit->pos, at)) throw Test::error("Ray towards the floor hit it at " + to_string(hit->pos) + ", expected " + to_string(at) + ".");
+	return *hit;
+}
+
+//mean of 'n' estimates, with standard error of the mean (by luma):
+template< typename F >
+static std::pair< Spectrum, float > mean(uint32_t n, F&& estimate) {
+	Spectrum sum;
+	double luma = 0.0, luma2 = 0.0;
+	for (uint32_t i = 0; i < n; ++i) {
+		Spectrum e = estimate();
+		sum += e;
+		luma += e.luma();
+		luma2 += double(e.luma()) * e.luma();
+	}
+	double variance = std::max(luma2 / n - (luma / n) * (luma / n), 0.0);
+	return {sum * (1.0f / n), float(std::sqrt(variance / n))};
+}
+
+//does 'got' match 'expected' to within 'tolerance' (relative to expected's luma)?
+static void expect_near(std::string const &what, Spectrum got, Spectrum expected, float tolerance) {
+	for (uint32_t c = 0; c < 3; ++c) {
+		if (std::abs(got[c] - expected[c]) > tolerance * expected.luma()) {
+			throw Test::error(what + " is " + to_string(got) + ", expected " + to_string(expected) + ".");
+		}
+	}
+}
+
+Test test_a3_mis_diffuse("a3.mis.diffuse", []() {
+	Spectrum albedo = Spectrum(0.5f, 0.6f, 0.7f);
+	Scene scene = floor_and_light(albedo, [](std::weak_ptr< Texture > color) {
+		return Material(Materials::Lambertian{color});
+	});
+	PT::Pathtracer pathtracer;
+	pathtracer.use_bvh(false);
+	pathtracer.build_scene(scene);
+	Shading_Info hit = floor_hit(pathtracer);
+
+	//reflected radiance from an upward-facing diffuse point lit by a polygon (Lambert's formula for irradiance):
+	float irradiance = 0.0f;
+	for (uint32_t i = 0; i < Light_Corners.size(); ++i) {
+		Vec3 a = (Light_Corners[i] - hit.pos).unit();
+		Vec3 b = (Light_Corners[(i + 1) % Light_Corners.size()] - hit.pos).unit();
+		irradiance += 0.5f * std::acos(std::clamp(dot(a, b), -1.0f, 1.0f)) * cross(a, b).unit().y;
+	}
+	Spectrum expected = albedo * Radiance * (std::abs(irradiance) / PI_F);
+
+	if (hit.bsdf.evaluate(hit.out_dir, Vec3{0.0f, 1.0f, 0.0f}, hit.uv).luma() == 0.0f) {
+		throw Test::ignored("Lambertian BSDF evaluates to zero (is task 4 done?).");
+	}
+
+	RNG rng(0x3115);
+	uint32_t samples = 20000;
+	auto [mis, mis_error] = mean(samples, [&]() { return pathtracer.sample_lighting_mis(rng, hit); });
+	//(five standard errors is far outside what a correct estimator will see with a fixed seed)
+	expect_near("MIS estimate", mis, expected, std::max(5.0f * mis_error / expected.luma(), 0.01f));
+
+	auto [separate, separate_error] = mean(samples, [&]() {
+		return pathtracer.sample_direct_lighting_task6(rng, hit) + pathtracer.sample_indirect_lighting(rng, hit);
+	});
+	if (separate.luma() == 0.0f) {
+		throw Test::ignored("MIS estimate is correct, but the separate direct + indirect estimate is zero (are tasks 4 and 6 done?).");
+	}
+	expect_near("Separate direct + indirect estimate", separate, expected, std::max(5.0f * separate_error / expected.luma(), 0.01f));
+	expect_near("MIS estimate (compared to the separate estimate)", mis, separate, 5.0f * (mis_error + separate_error) / separate.luma());
+});
+
+Test test_a3_mis_specular("a3.mis.specular", []() {
+	//a mirror floor reflects exactly one direction, so every estimate should be the same:
+	Spectrum reflectance = Spectrum(0.8f, 0.7f, 0.6f);
+	Scene scene = floor_and_light(reflectance, [](std::weak_ptr< Texture > color) {
+		Materials::Mirror mirror;
+		mirror.reflectance = color;
+		return Material(mirror);
+	});
+	PT::Pathtracer pathtracer;
+	pathtracer.use_bvh(false);
+	pathtracer.build_scene(scene);
+	Shading_Info hit = floor_hit(pathtracer);
+
+	Spectrum expected = reflectance * Radiance;
+
+	RNG rng(0x3112);
+	if (hit.bsdf.scatter(rng, hit.out_dir, hit.uv).attenuation.luma() == 0.0f) {
+		throw Test::ignored("Mirror BSDF scatters nothing (is task 5 done?).");
+	}
+
+	for (uint32_t i = 0; i < 16; ++i) {
+		//(if this comes out zero, a discrete BSDF's pdf() was used as a density)
+		expect_near("MIS estimate", pathtracer.sample_lighting_mis(rng, hit), expected, 0.001f);
+	}
+
+	Spectrum separate = pathtracer.sample_direct_lighting_task6(rng, hit) + pathtracer.sample_indirect_lighting(rng, hit);
+	if (separate.luma() == 0.0f) {
+		throw Test::ignored("MIS estimate is correct, but the separate direct + indirect estimate is zero (are tasks 4 and 6 done?).");
+	}
+	for (uint32_t i = 0; i < 16; ++i) {
+		expect_near("Separate direct + indirect estimate",
+			pathtracer.sample_direct_lighting_task6(rng, hit) + pathtracer.sample_indirect_lighting(rng, hit), expected, 0.001f);
+	}
+});
@@ -0,0 +1,39 @@
+#include "test.h"
+
+#include "util/rand.h"
+
+#include <string>
+
+Test test_a3_rng_advance("a3.rng.advance", []() {
+	for (uint64_t steps : {0ull, 1ull, 7ull, 1000ull, 12345ull}) {
+		RNG stepped(0x5eed, 3), jumped(0x5eed, 3);
+		for (uint64_t i = 0; i < steps; ++i) stepped.bits();
+		jumped.advance(steps);
+		for (uint32_t i = 0; i < 4; ++i) {
+			if (stepped.bits() != jumped.bits()) {
+				throw Test::error("RNG::advance(" + std::to_string(steps) + ") doesn't match calling bits() that many times.");
+			}
+		}
+	}
+});
+
+Test test_a3_rng_streams("a3.rng.streams", []() {
+	RNG a(0x5eed, 0), b(0x5eed, 1), c(0x5eed, 0);
+	uint32_t same_ab = 0, same_ac = 0;
+	for (uint32_t i = 0; i < 1000; ++i) {
+		uint32_t va = a.bits(), vb = b.bits(), vc = c.bits();
+		if (va == vb) same_ab += 1;
+		if (va == vc) same_ac += 1;
+	}
+	if (same_ac != 1000) throw Test::error("Same seed and stream should give the same sequence.");
+	if (same_ab > 1) throw Test::error("Different streams should give different sequences.");
+
+	//values stay in range:
+	RNG rng(1);
+	for (uint32_t i = 0; i < 100000; ++i) {
+		float u = rng.unit();
+		if (!(u >= 0.0f && u < 1.0f)) throw Test::error("RNG::unit() returned " + std::to_string(u) + ", outside of [0,1).");
+		int32_t v = rng.integer(-3, 4);
+		if (v < -3 || v >= 4) throw Test::error("RNG::integer(-3,4) returned " + std::to_string(v) + ".");
+	}
+});
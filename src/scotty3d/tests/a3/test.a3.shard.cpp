@@ -0,0 +1,148 @@
+#include "test.h"
+#include "pathtracer/pathtracer.h"
+#include "util/rand.h"
+
+#include <cstring>
+#include <sstream>
+
+using Shard = PT::Pathtracer::Shard;
+
+//an accumulator as if 'samples' samples of values in [0,4) had been added to each pixel:
+static Shard full_render(uint32_t w, uint32_t h, uint32_t samples, RNG &rng) {
+	Shard full;
+	full.count = 1;
+	full.seed = 0x5eed;
+	full.indices = {0};
+	full.w = w;
+	full.h = h;
+	full.accumulator.assign(size_t(w) * h, std::array< int64_t, 3 >{});
+	full.accumulator_samples.assign(size_t(w) * h, 0);
+	for (size_t i = 0; i < full.accumulator.size(); ++i) {
+		for (uint32_t s = 0; s < samples; ++s) {
+			for (uint32_t c = 0; c < 3; ++c) {
+				full.accumulator[i][c] += int64_t(rng.integer(0, 1 << 26)); //[0,4) in 40.24 fixed point
+			}
+		}
+		full.accumulator_samples[i] = samples;
+	}
+	return full;
+}
+
+//split 'full' into two shards of a two-shard render, with a random part of every pixel's sums in each:
+static std::array< Shard, 2 > split(Shard const &full, RNG &rng) {
+	std::array< Shard, 2 > parts{full, full};
+	for (uint32_t p = 0; p < 2; ++p) {
+		parts[p].count = 2;
+		parts[p].indices = {p};
+	}
+	for (size_t i = 0; i < full.accumulator.size(); ++i) {
+		uint32_t n = full.accumulator_samples[i];
+		uint32_t n0 = uint32_t(rng.integer(0, int32_t(n) + 1));
+		parts[0].accumulator_samples[i] = n0;
+		parts[1].accumulator_samples[i] = n - n0;
+		for (uint32_t c = 0; c < 3; ++c) {
+			int64_t a0 = n0 == 0 ? 0 : full.accumulator[i][c] * n0 / n;
+			parts[0].accumulator[i][c] = a0;
+			parts[1].accumulator[i][c] = full.accumulator[i][c] - a0;
+		}
+	}
+	return parts;
+}
+
+static Shard round_trip(Shard const &shard) {
+	std::stringstream stream;
+	shard.save(stream);
+	return Shard::load(stream);
+}
+
+static void expect_same_image(HDR_Image const &got, HDR_Image const &expected) {
+	if (got.w != expected.w || got.h != expected.h) {
+		throw Test::error("Image is " + std::to_string(got.w) + "x" + std::to_string(got.h) + ", expected " + std::to_string(expected.w) + "x" + std::to_string(expected.h) + ".");
+	}
+	for (uint32_t y = 0; y < got.h; ++y) {
+		for (uint32_t x = 0; x < got.w; ++x) {
+			Spectrum a = got.at(x, y), b = expected.at(x, y);
+			if (a.r != b.r || a.g != b.g || a.b != b.b) {
+				throw Test::error("Pixel (" + std::to_string(x) + ", " + std::to_string(y) + ") is " + to_string(a) + ", expected " + to_string(b) + ".");
+			}
+		}
+	}
+}
+
+Test test_a3_shard_merge("a3.shard.merge", []() {
+	RNG rng(0x5a4d);
+	Shard full = full_render(13, 7, 16, rng);
+	auto parts = split(full, rng);
+
+	Shard first = round_trip(parts[1]);
+	Shard second = round_trip(parts[0]);
+	if (first.complete()) throw Test::error("One shard of two says it is complete.");
+
+	//merge in the "wrong" order, since merging should not depend on order:
+	first.merge(second);
+	if (!first.complete()) throw Test::error("Both shards merged, but not complete.");
+	if (first.indices != std::vector< uint32_t >{0, 1}) throw Test::error("Merged shard indices are not {0, 1}.");
+	if (first.accumulator != full.accumulator || first.accumulator_samples != full.accumulator_samples) {
+		throw Test::error("Merged accumulator differs from unsharded accumulator.");
+	}
+	expect_same_image(first.to_image(), full.to_image());
+});
+
+Test test_a3_shard_mismatch("a3.shard.mismatch", []() {
+	RNG rng(0x3a7c);
+	Shard full = full_render(5, 4, 2, rng);
+	auto parts = split(full, rng);
+
+	auto expect_throw = [](Shard merged, Shard const &other, std::string const &what) {
+		try {
+			merged.merge(other);
+		} catch (std::runtime_error const &) {
+			return;
+		}
+		throw Test::error("Merging " + what + " did not throw.");
+	};
+
+	expect_throw(parts[0], parts[0], "the same shard twice");
+
+	Shard other_seed = parts[1];
+	other_seed.seed += 1;
+	expect_throw(parts[0], other_seed, "shards with different seeds");
+
+	Shard other_size = full_render(4, 5, 2, rng);
+	other_size.count = 2;
+	other_size.indices = {1};
+	expect_throw(parts[0], other_size, "shards of different sizes");
+});
+
+Test test_a3_shard_bad_stream("a3.shard.bad_stream", []() {
+	RNG rng(0xbad5);
+	Shard full = full_render(6, 3, 4, rng);
+	std::stringstream stream;
+	full.save(stream);
+	std::string bytes = stream.str();
+
+	auto expect_throw = [](std::string const &data, std::string const &what) {
+		std::istringstream in(data);
+		try {
+			Shard::load(in);
+		} catch (std::runtime_error const &) {
+			return;
+		}
+		throw Test::error("Loading a " + what + " did not throw.");
+	};
+
+	expect_throw(bytes.substr(0, bytes.size() - 1), "shard missing its last byte");
+	expect_throw(bytes.substr(0, 10), "truncated shard header");
+	expect_throw("", "empty stream");
+
+	std::string wrong_version = bytes;
+	uint32_t version = 0;
+	std::memcpy(&version, wrong_version.data() + 4, 4);
+	version += 1;
+	std::memcpy(wrong_version.data() + 4, &version, 4);
+	expect_throw(wrong_version, "shard with an unknown version");
+
+	std::string wrong_fourcc = bytes;
+	wrong_fourcc[0] = 'x';
+	expect_throw(wrong_fourcc, "shard with the wrong fourcc");
+});
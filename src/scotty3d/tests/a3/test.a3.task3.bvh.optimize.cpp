@@ -0,0 +1,120 @@
+#include "test.h"
+#include "pathtracer/bvh.h"
+#include "pathtracer/tri_mesh.h"
+#include "util/rand.h"
+#include "util/thread_pool.h"
+
+// NOTE: these tests build their (deliberately poor) trees by hand, so they don't depend on BVH::build.
+
+using PT::BVH;
+using PT::Tri_Mesh_Vert;
+using PT::Triangle;
+
+static BBox triangle_box(std::vector<Tri_Mesh_Vert> const& verts, uint32_t i) {
+	BBox box;
+	for (uint32_t j = 0; j < 3; j++) box.enclose(verts[i * 3 + j].position);
+	return box;
+}
+
+// Split primitives [start, start+size) in half by index order, ignoring their positions:
+static size_t build_by_index(BVH<Triangle>& bvh, std::vector<BBox> const& boxes, size_t start, size_t size) {
+	BVH<Triangle>::Node node;
+	node.start = start;
+	node.size = size;
+	node.l = node.r = 0;
+	for (size_t i = start; i < start + size; i++) node.bbox.enclose(boxes[i]);
+	if (size > 2) {
+		node.l = build_by_index(bvh, boxes, start, size / 2);
+		node.r = build_by_index(bvh, boxes, start + size / 2, size - size / 2);
+	}
+	bvh.nodes.push_back(node);
+	return bvh.nodes.size() - 1;
+}
+
+static void check_layout(BVH<Triangle> const& bvh, size_t idx, std::vector<Tri_Mesh_Vert> const& verts) {
+	BVH<Triangle>::Node const& node = bvh.nodes.at(idx);
+	if (node.is_leaf()) {
+		for (size_t i = node.start; i < node.start + node.size; i++) {
+			// find the input triangle this primitive is:
+			BBox box;
+			for (uint32_t t = 0; t < verts.size() / 3; t++) {
+				if (bvh.primitives.at(i) == Triangle(const_cast<Tri_Mesh_Vert*>(verts.data()), t * 3, t * 3 + 1, t * 3 + 2)) {
+					box = triangle_box(verts, t);
+					break;
+				}
+			}
+			if (Test::differs(hmin(box.min, node.bbox.min), node.bbox.min) ||
+			    Test::differs(hmax(box.max, node.bbox.max), node.bbox.max)) {
+				throw Test::error("A leaf's bbox does not contain its primitives!");
+			}
+		}
+		return;
+	}
+	BVH<Triangle>::Node const& l = bvh.nodes.at(node.l);
+	BVH<Triangle>::Node const& r = bvh.nodes.at(node.r);
+	if (node.size != l.size + r.size) {
+		throw Test::error("A node's children contain a different number of primitives than the node!");
+	}
+	if (node.start != l.start || l.start + l.size != r.start) {
+		throw Test::error("A node's children do not cover a contiguous range of primitives!");
+	}
+	if (Test::differs(node.bbox.min, hmin(l.bbox.min, r.bbox.min)) ||
+	    Test::differs(node.bbox.max, hmax(l.bbox.max, r.bbox.max))) {
+		throw Test::error("A node's bbox was not tight about its children!");
+	}
+	check_layout(bvh, node.l, verts);
+	check_layout(bvh, node.r, verts);
+}
+
+static void expect_optimized(uint32_t n_tris, Thread_Pool* pool) {
+
+	RNG rng(0x5c077d3d);
+
+	std::vector<Tri_Mesh_Vert> verts;
+	verts.reserve(n_tris * 3);
+	for (uint32_t i = 0; i < n_tris; i++) {
+		Vec3 o = Vec3{rng.unit(), rng.unit(), rng.unit()} * 10.0f;
+		for (uint32_t j = 0; j < 3; j++) {
+			verts.push_back({o + Vec3{rng.unit(), rng.unit(), rng.unit()} * 0.5f, Vec3{0, 1, 0}});
+		}
+	}
+
+	std::vector<Triangle> prims;
+	std::vector<BBox> boxes;
+	for (uint32_t i = 0; i < n_tris; i++) {
+		prims.emplace_back(verts.data(), i * 3, i * 3 + 1, i * 3 + 2);
+		boxes.emplace_back(triangle_box(verts, i));
+	}
+
+	BVH<Triangle> bvh;
+	bvh.primitives = std::move(prims);
+	bvh.root_idx = build_by_index(bvh, boxes, 0, n_tris);
+
+	float before = bvh.sah_cost();
+	size_t changed = bvh.optimize(pool, 30.0f);
+	float after = bvh.sah_cost();
+
+	if (changed == 0 || !(after < 0.9f * before)) {
+		throw Test::error("Optimizing a poorly-built tree did not lower its SAH cost (" + std::to_string(before) +
+		                  " -> " + std::to_string(after) + ")!");
+	}
+	if (bvh.primitives.size() != n_tris || bvh.nodes.at(bvh.root_idx).size != n_tris) {
+		throw Test::error("Optimization changed the number of primitives!");
+	}
+	check_layout(bvh, bvh.root_idx, verts);
+
+	// a second pass shouldn't make things worse:
+	bvh.optimize(pool, 30.0f);
+	if (bvh.sah_cost() > after + Test::differs_eps) {
+		throw Test::error("Re-optimizing a tree raised its SAH cost!");
+	}
+}
+
+Test test_a3_task3_bvh_optimize_serial("a3.task3.bvh.optimize.serial", []() {
+	expect_optimized(64, nullptr);
+});
+
+Test test_a3_task3_bvh_optimize_parallel("a3.task3.bvh.optimize.parallel", []() {
+	Thread_Pool pool(4);
+	expect_optimized(2000, &pool);
+});
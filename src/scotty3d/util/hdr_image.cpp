@@ -5,6 +5,7 @@
 #include <sf_libs/stb_image.h>
 #include <sf_libs/tinyexr.h>
 
+#include <algorithm>
 #include <cstring>
 
 HDR_Image::HDR_Image(uint32_t w, uint32_t h, Spectrum color) : w(w), h(h) {
@@ -100,7 +101,8 @@ HDR_Image HDR_Image::load(const std::string& file) {
 }
 
 void HDR_Image::save(std::string const &filename) const {
-	warn("TODO: write image saving!");
+	HDR_Image_Writer writer(filename, w, h);
+	writer.write(0, 0, *this);
 }
 
 constexpr char Raw_Float_format[4] = {'r','a','w','f'};
@@ -121,12 +123,12 @@ HDR_Image HDR_Image::decode(uint8_t const *buffer, size_t length) {
 	if (std::memcmp(header.format, Raw_Float_format, 4) == 0) {
 		//raw!
 		if (length != header.width * header.height * 3 * 4) throw std::runtime_error("Buffer doesn't have the right number of bytes for a raw 32-bit floating point image.");
+		//(stored as packed r,g,b floats; Spectrum has a pad after each)
 		std::vector< Spectrum > pixels(header.width * header.height);
-		static_assert(sizeof(Spectrum) == 12, "Spectrum is packed");
-		static_assert(offsetof(Spectrum, r) == 0, "Spectrum r is first.");
-		static_assert(offsetof(Spectrum, g) == 4, "Spectrum g is second.");
-		static_assert(offsetof(Spectrum, b) == 8, "Spectrum b is third.");
-		std::memcpy(pixels.data(), buffer, sizeof(Spectrum) * pixels.size());
+		for (auto &pixel : pixels) {
+			std::memcpy(pixel.data, buffer, 12);
+			buffer += 12;
+		}
 		return HDR_Image(header.width, header.height, pixels);
 	} else {
 		throw std::runtime_error("Unrecognized format for image storage.");
@@ -146,9 +148,11 @@ std::vector< uint8_t > HDR_Image::encode() const {
 	std::memcpy(buffer, reinterpret_cast< const char * >(&w), 4); buffer += 4;
 	std::memcpy(buffer, reinterpret_cast< const char * >(&h), 4); buffer += 4;
 
-	//data:
-	std::memcpy(buffer, reinterpret_cast< const char * >(pixels.data()), 12 * pixels.size());
-	buffer += 12 * pixels.size();
+	//data (packed r,g,b floats):
+	for (auto const &pixel : pixels) {
+		std::memcpy(buffer, pixel.data, 12);
+		buffer += 12;
+	}
 	assert(buffer == data.data() + data.size());
 
 	return data;
@@ -233,3 +237,136 @@ bool operator!=(const HDR_Image& a, const HDR_Image& b) {
 	}
 	return false;
 }
+
+static std::string lowercase_extension(std::string const &filename) {
+	size_t dot = filename.find_last_of('.');
+	if (dot == std::string::npos) return "";
+	std::string ext = filename.substr(dot);
+	std::transform(ext.begin(), ext.end(), ext.begin(), [](char c) { return char(std::tolower(c)); });
+	return ext;
+}
+
+bool HDR_Image_Writer::supports(std::string const &filename) {
+	std::string ext = lowercase_extension(filename);
+	return ext == ".exr" || ext == ".pfm";
+}
+
+HDR_Image_Writer::HDR_Image_Writer(std::string const &filename_, uint32_t w_, uint32_t h_)
+	: w(w_), h(h_), filename(filename_) {
+
+	std::string ext = lowercase_extension(filename);
+	if (ext == ".exr") {
+		format = Format::EXR;
+	} else if (ext == ".pfm") {
+		format = Format::PFM;
+	} else {
+		throw std::runtime_error("Don't know how to write floating point image '" + filename + "' (expecting .exr or .pfm).");
+	}
+
+	file.open(filename, std::ios::binary | std::ios::trunc);
+	if (!file) throw std::runtime_error("Failed to open '" + filename + "' for writing.");
+
+	auto put = [&](auto const &val) {
+		file.write(reinterpret_cast< const char * >(&val), sizeof(val));
+	};
+
+	std::streamoff end = 0;
+	if (format == Format::PFM) {
+		//PFM: text header, then rows of RGB floats from the bottom up (negative scale means little-endian):
+		file << "PF\n" << w << " " << h << "\n-1.0\n";
+		data_begin = file.tellp();
+		end = data_begin + std::streamoff(w) * h * 12;
+	} else {
+		//OpenEXR: magic number, version 2 (single-part scanline), header attributes:
+		put(uint32_t(20000630));
+		put(uint32_t(2));
+		auto attribute = [&](char const *name, char const *type, uint32_t size) {
+			file.write(name, std::strlen(name) + 1);
+			file.write(type, std::strlen(type) + 1);
+			put(size);
+		};
+		//channels are stored in alphabetical order, each as 32-bit float:
+		attribute("channels", "chlist", 3 * (2 + 16) + 1);
+		for (char const *name : {"B", "G", "R"}) {
+			file.write(name, 2);
+			put(int32_t(2)); //FLOAT
+			put(uint32_t(0)); //pLinear + reserved
+			put(int32_t(1)); //x sampling
+			put(int32_t(1)); //y sampling
+		}
+		file.put('\0');
+		attribute("compression", "compression", 1);
+		file.put('\0'); //NO_COMPRESSION
+		for (char const *window : {"dataWindow", "displayWindow"}) {
+			attribute(window, "box2i", 16);
+			put(int32_t(0));
+			put(int32_t(0));
+			put(int32_t(w) - 1);
+			put(int32_t(h) - 1);
+		}
+		attribute("lineOrder", "lineOrder", 1);
+		file.put('\0'); //INCREASING_Y
+		attribute("pixelAspectRatio", "float", 4);
+		put(1.0f);
+		attribute("screenWindowCenter", "v2f", 8);
+		put(0.0f);
+		put(0.0f);
+		attribute("screenWindowWidth", "float", 4);
+		put(1.0f);
+		file.put('\0'); //end of header
+
+		//uncompressed scanlines all have the same size, so the whole layout is known up front:
+		// (offset table, then per scanline: y, byte count, and each channel's row of floats)
+		uint32_t scanline_bytes = w * 3 * 4;
+		data_begin = file.tellp() + std::streamoff(8) * h;
+		for (uint32_t y = 0; y < h; ++y) {
+			put(uint64_t(data_begin + std::streamoff(y) * (8 + scanline_bytes)));
+		}
+		for (uint32_t y = 0; y < h; ++y) {
+			file.seekp(data_begin + std::streamoff(y) * (8 + scanline_bytes));
+			put(int32_t(y));
+			put(scanline_bytes);
+		}
+		end = data_begin + std::streamoff(h) * (8 + scanline_bytes);
+	}
+
+	//extend the file to its full size (leaving the pixels zero):
+	if (end > file.tellp()) {
+		file.seekp(end - 1);
+		file.put('\0');
+	}
+	file.flush();
+	if (!file) throw std::runtime_error("Failed to write header of '" + filename + "'.");
+}
+
+void HDR_Image_Writer::write(uint32_t x, uint32_t y, HDR_Image const &region) {
+	if (x + region.w > w || y + region.h > h) {
+		throw std::runtime_error("Region is outside of the image being written to '" + filename + "'.");
+	}
+
+	std::vector< float > row;
+	for (uint32_t j = 0; j < region.h; ++j) {
+		Spectrum const *pixels = region.data().data() + j * region.w;
+		if (format == Format::PFM) {
+			//packed r,g,b floats:
+			row.resize(3 * region.w);
+			for (uint32_t i = 0; i < region.w; ++i) std::memcpy(&row[3 * i], pixels[i].data, 12);
+			file.seekp(data_begin + (std::streamoff(y + j) * w + x) * 12);
+			file.write(reinterpret_cast< const char * >(row.data()), 4 * row.size());
+		} else {
+			//EXR scanlines go top-down:
+			uint32_t scanline = h - 1 - (y + j);
+			std::streamoff begin = data_begin + std::streamoff(scanline) * (8 + w * 12) + 8;
+			row.resize(region.w);
+			for (uint32_t c = 0; c < 3; ++c) {
+				//channel order is B, G, R:
+				for (uint32_t i = 0; i < region.w; ++i) row[i] = pixels[i][2 - c];
+				file.seekp(begin + (std::streamoff(c) * w + x) * 4);
+				file.write(reinterpret_cast< const char * >(row.data()), 4 * row.size());
+			}
+		}
+	}
+	file.flush();
+	if (!file) throw std::runtime_error("Failed to write pixels to '" + filename + "'.");
+}
+
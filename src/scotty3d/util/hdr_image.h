@@ -1,6 +1,7 @@
 
 #pragma once
 
+#include <fstream>
 #include <vector>
 
 #include "../lib/spectrum.h"
@@ -34,6 +35,15 @@ public:
 
 	//direct data access (row-major, bottom-left origin):
 	const std::vector<Spectrum>& data() const;
+	//pointer to the w pixels of row y:
+	Spectrum *row(uint32_t y) {
+		assert(y < h);
+		return pixels.data() + size_t(y) * w;
+	}
+	Spectrum const *row(uint32_t y) const {
+		assert(y < h);
+		return pixels.data() + size_t(y) * w;
+	}
 
 	//range-checked access helpers:
 	Spectrum& at(uint32_t x, uint32_t y) {
@@ -57,7 +67,7 @@ public:
 
 	//file I/O:
 	static HDR_Image load(const std::string& filename); //load from a file, throws on error
-	void save(std::string const &filename) const;
+	void save(std::string const &filename) const; //save linear floats (see HDR_Image_Writer for formats), throws on error
 
 	//memory I/O:
 	static HDR_Image decode(uint8_t const *buffer, size_t length); //load from memory buffer, throws on error
@@ -77,3 +87,39 @@ private:
 };
 
 bool operator!=(const HDR_Image& a, const HDR_Image& b);
+
+/*
+ *
+ * HDR_Image_Writer writes a floating-point image to a file one region at a time,
+ * so the whole image never has to be in memory at once.
+ *
+ * Format is picked from the extension:
+ *  .exr -- OpenEXR, uncompressed scanlines
+ *  .pfm -- portable float map
+ *
+ * The file is laid out (as black) when the writer is created; regions may be written in any
+ * order, and writing a region again overwrites it.
+ *
+ */
+class HDR_Image_Writer {
+public:
+	HDR_Image_Writer(std::string const &filename, uint32_t w, uint32_t h); //throws on error
+	~HDR_Image_Writer() = default;
+
+	HDR_Image_Writer(const HDR_Image_Writer& src) = delete;
+	HDR_Image_Writer& operator=(const HDR_Image_Writer& src) = delete;
+
+	//can 'filename' be written by this class?
+	static bool supports(std::string const &filename);
+
+	//write 'region' with its bottom left at pixel (x,y) of the image, throws on error:
+	void write(uint32_t x, uint32_t y, HDR_Image const &region);
+
+	uint32_t w = 0, h = 0;
+
+private:
+	enum class Format { EXR, PFM } format;
+	std::ofstream file;
+	std::streamoff data_begin = 0; //offset of the first scanline
+	std::string filename;
+};
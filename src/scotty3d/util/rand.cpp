@@ -6,6 +6,9 @@
 #include <random>
 #include <thread>
 
+//PCG32 (XSH RR variant) constants:
+static constexpr uint64_t Multiplier = 6364136223846793005ull;
+
 RNG::RNG() {
 	random_seed();
 }
@@ -14,15 +17,42 @@ RNG::RNG(uint32_t seed) {
 	this->seed(seed);
 }
 
+RNG::RNG(uint32_t seed, uint32_t stream) {
+	this->seed(seed, stream);
+}
+
+uint32_t RNG::bits() {
+	uint64_t old = state;
+	state = old * Multiplier + increment;
+	uint32_t xorshifted = uint32_t(((old >> 18u) ^ old) >> 27u);
+	uint32_t rot = uint32_t(old >> 59u);
+	return (xorshifted >> rot) | (xorshifted << ((32u - rot) & 31u));
+}
+
+void RNG::advance(uint64_t steps) {
+	//the state update is an affine map, so apply it 'steps' times by repeated squaring:
+	uint64_t mul = Multiplier, add = increment;
+	uint64_t total_mul = 1, total_add = 0;
+	while (steps > 0) {
+		if (steps & 1u) {
+			total_mul *= mul;
+			total_add = total_add * mul + add;
+		}
+		add = (mul + 1u) * add;
+		mul *= mul;
+		steps >>= 1u;
+	}
+	state = total_mul * state + total_add;
+}
+
 float RNG::unit() {
 	//not using std::uniform_real_distribution because it has different behavior on different standard libraries
-	static_assert(decltype(mt)::min() == 0 && decltype(mt)::max() == 0xffffffff, "Mersenne Twister has the expected range.");
-	return std::scalbn(float(mt()), -32);
+	// (24 bits, so that every value is exactly representable and the result is never 1.0f)
+	return std::scalbn(float(bits() >> 8u), -24);
 }
 
 int32_t RNG::integer(int32_t min, int32_t max) {
 	//not using std::uniform_int_distribution because it has different behavior on different standard libraries
-	static_assert(decltype(mt)::min() == 0 && decltype(mt)::max() == 0xffffffff, "Mersenne Twister has the expected range.");
 	uint64_t size = int64_t(max) - int64_t(min);
 	//true, but for readability will not do it: static_assert(int64_t(std::numeric_limits< int32_t >::max()) - int64_t(std::numeric_limits< int32_t >::min()) == std::numeric_limits< uint32_t >::max(), "range size fits into uint32_t");
 	//maximum value such that (max_val + 1) is a multiple of size:
@@ -30,7 +60,7 @@ int32_t RNG::integer(int32_t min, int32_t max) {
 	uint32_t val;
 	//rejection sample a value less than max_val:
 	do {
-		val = mt();
+		val = bits();
 	} while (val > max_val);
 	return int32_t(int64_t(uint64_t(val) % size) + int64_t(min));
 }
@@ -39,9 +69,14 @@ bool RNG::coin_flip(float p) {
 	return unit() < p;
 }
 
-void RNG::seed(uint32_t s) {
+void RNG::seed(uint32_t s, uint32_t stream) {
 	_seed = s;
-	mt.seed(_seed);
+	//(PCG's standard seeding procedure)
+	state = 0;
+	increment = (uint64_t(stream) << 1u) | 1u;
+	bits();
+	state += s;
+	bits();
 }
 
 void RNG::random_seed() {
@@ -51,8 +86,7 @@ void RNG::random_seed() {
 		static_cast<std::random_device::result_type>(
 			std::hash<std::thread::id>()(std::this_thread::get_id())) +
 		static_cast<std::random_device::result_type>(std::hash<std::time_t>()(std::time(nullptr)));
-	_seed = static_cast<uint32_t>(s);
-	mt.seed(_seed);
+	seed(static_cast<uint32_t>(s));
 }
 
 uint32_t RNG::get_seed() {
@@ -1,8 +1,10 @@
 #pragma once
 
-#include <random>
+#include <cstdint>
 
 //wraps a pseudo-random number generator with some convenience functions.
+// (the generator is PCG32 -- see pcg-random.org -- which has 16 bytes of state, so seeding is cheap,
+//  and which supports independent streams and jumping ahead in a stream)
 
 struct RNG {
 	//start with a random (random-device-based) seed:
@@ -13,6 +15,10 @@ struct RNG {
 	// (same sequence of numbers on every run!)
 	RNG(uint32_t seed);
 
+	//start with a specified seed on one of 2^32 independent streams:
+	// (e.g., one stream per tile or per pixel)
+	RNG(uint32_t seed, uint32_t stream);
+
 	// Generate random float in the range [0,1)
 	float unit();
 
@@ -22,13 +28,20 @@ struct RNG {
 	// Return true with probability p and false with probability 1-p
 	bool coin_flip(float p);
 
-	void seed(uint32_t s);
+	// Generate 32 random bits
+	uint32_t bits();
+
+	// Skip ahead as if bits() had been called 'steps' times (takes O(log steps) time)
+	void advance(uint64_t steps);
+
+	void seed(uint32_t s, uint32_t stream = 0);
 	void random_seed();
 	uint32_t get_seed();
 
 	static inline uint32_t fixed_seed = 0; //0 = 'pick a new seed every render', otherwise use as seed
 
-	std::mt19937 mt;
 private:
+	uint64_t state = 0;
+	uint64_t increment = 1; //(selects the stream; always odd)
 	uint32_t _seed = 0;
 };
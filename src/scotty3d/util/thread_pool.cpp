@@ -10,6 +10,11 @@ Thread_Pool::~Thread_Pool() {
 	stop();
 }
 
+Thread_Pool& Thread_Pool::shared() {
+	static Thread_Pool pool(std::max(1u, std::thread::hardware_concurrency()));
+	return pool;
+}
+
 void Thread_Pool::start(uint32_t threads) {
 	n_threads = threads;
 	stop_now = false;
@@ -1,12 +1,14 @@
 
 #pragma once
 
+#include <algorithm>
 #include <condition_variable>
 #include <functional>
 #include <future>
 #include <mutex>
 #include <queue>
 #include <thread>
+#include <vector>
 
 #include "../lib/log.h"
 
@@ -15,10 +17,18 @@ public:
 	Thread_Pool(uint32_t threads);
 	~Thread_Pool();
 
+	//one thread per core, shared by jobs that split up work and wait for it (e.g., with for_each_chunk):
+	// (long-running or cancellable work, like rendering, should get its own pool)
+	static Thread_Pool& shared();
+
 	void stop();
 	void wait();
 	void clear();
 
+	uint32_t size() const {
+		return n_threads;
+	}
+
 	template<class F, class... Args>
 	auto enqueue(F&& f, Args&&... args)
 		-> std::future<typename std::invoke_result<F, Args...>::type> {
@@ -38,6 +48,21 @@ public:
 		return res;
 	}
 
+	//run f(begin, end) over [0,n) in chunks of at most 'chunk', waiting for all of them to finish:
+	// (don't call from a task running on this pool, since it may end up waiting on itself)
+	template<class F>
+	void for_each_chunk(uint32_t n, uint32_t chunk, F const &f) {
+		assert(chunk > 0);
+		std::vector<std::future<void>> chunks;
+		for (uint32_t begin = 0; begin < n; begin += chunk) {
+			uint32_t end = std::min(n, begin + chunk);
+			chunks.emplace_back(enqueue([&f, begin, end]() { f(begin, end); }));
+		}
+		for (auto& c : chunks) {
+			c.get();
+		}
+	}
+
 private:
 	void start(uint32_t);
 	uint32_t n_threads;
@@ -0,0 +1,193 @@
+
+#include "tiled_image.h"
+#include "../lib/log.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+//bits of a 3-bit value spread to every other bit (for building Morton indices within a tile):
+static constexpr uint32_t Spread3[8] = {0, 1, 4, 5, 16, 17, 20, 21};
+
+//IEEE half-float conversions (round to nearest even; values too large for a half are clamped to the largest half):
+static uint16_t float_to_half(float f) {
+	uint32_t x;
+	std::memcpy(&x, &f, sizeof(x));
+	uint32_t sign = (x >> 16) & 0x8000;
+	uint32_t abs = x & 0x7fffffff;
+	if (abs >= 0x7f800000) { //inf or nan
+		return uint16_t(sign | 0x7c00 | (abs > 0x7f800000 ? 0x200 : 0));
+	}
+	if (abs >= 0x477ff000) { //would round to >= 65520
+		return uint16_t(sign | 0x7bff);
+	}
+	if (abs < 0x38800000) { //below 2^-14, so a denormal half
+		float v;
+		std::memcpy(&v, &abs, sizeof(v));
+		return uint16_t(sign | uint32_t(std::nearbyint(v * 16777216.0f)));
+	}
+	//re-bias exponent (127 -> 15) and round mantissa (23 -> 10 bits):
+	uint32_t half = (abs - 0x38000000) >> 13;
+	uint32_t rest = abs & 0x1fff;
+	if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) half += 1;
+	return uint16_t(sign | half);
+}
+
+static float half_to_float(uint16_t half) {
+	uint32_t sign = uint32_t(half & 0x8000) << 16;
+	uint32_t exp = (half >> 10) & 0x1f;
+	uint32_t mant = half & 0x3ff;
+	if (exp == 0) {
+		float v = mant * (1.0f / 16777216.0f);
+		return sign ? -v : v;
+	}
+	uint32_t x = sign | (exp == 31 ? (0x7f800000 | (mant << 13)) : (((exp + 112) << 23) | (mant << 13)));
+	float f;
+	std::memcpy(&f, &x, sizeof(f));
+	return f;
+}
+
+//shared-exponent packing as per the EXT_texture_shared_exponent spec:
+static constexpr int32_t RGB9E5_Mantissa_Bits = 9;
+static constexpr int32_t RGB9E5_Exp_Bias = 15;
+static constexpr float RGB9E5_Max = (511.0f / 512.0f) * 65536.0f;
+
+static uint32_t float3_to_rgb9e5(Spectrum s) {
+	float c[3];
+	for (uint32_t i = 0; i < 3; ++i) {
+		//(also maps nan to zero)
+		c[i] = (s[i] > 0.0f ? std::min(s[i], RGB9E5_Max) : 0.0f);
+	}
+	float max = std::max(c[0], std::max(c[1], c[2]));
+
+	int32_t exp = -RGB9E5_Exp_Bias - 1;
+	if (max > 0.0f) {
+		int32_t e;
+		std::frexp(max, &e); //max = m * 2^e with m in [0.5,1), so floor(log2(max)) = e - 1
+		exp = std::max(exp, e - 1);
+	}
+	exp += 1 + RGB9E5_Exp_Bias;
+
+	//if max rounds up to 2^9, need the next exponent:
+	if (std::floor(max / std::ldexp(1.0f, exp - RGB9E5_Exp_Bias - RGB9E5_Mantissa_Bits) + 0.5f) == float(1 << RGB9E5_Mantissa_Bits)) {
+		exp += 1;
+	}
+
+	float scale = std::ldexp(1.0f, RGB9E5_Exp_Bias + RGB9E5_Mantissa_Bits - exp);
+	uint32_t packed = uint32_t(exp) << 27;
+	for (uint32_t i = 0; i < 3; ++i) {
+		packed |= uint32_t(std::floor(c[i] * scale + 0.5f)) << (9 * i);
+	}
+	return packed;
+}
+
+static Spectrum rgb9e5_to_float3(uint32_t packed) {
+	float scale = std::ldexp(1.0f, int32_t(packed >> 27) - RGB9E5_Exp_Bias - RGB9E5_Mantissa_Bits);
+	return Spectrum(float(packed & 0x1ff) * scale, float((packed >> 9) & 0x1ff) * scale, float((packed >> 18) & 0x1ff) * scale);
+}
+
+Tiled_Image::Tiled_Image(HDR_Image const &image, Format format_) : w(image.w), h(image.h), format(format_) {
+	switch (format) {
+		case Format::Float: texel_bytes = 12; break;
+		case Format::Half: texel_bytes = 6; break;
+		case Format::RGB9E5: texel_bytes = 4; break;
+	}
+	tiles_x = (w + Tile_Size - 1) / Tile_Size;
+	uint32_t tiles_y = (h + Tile_Size - 1) / Tile_Size;
+	data.assign(size_t(tiles_x) * tiles_y * Tile_Size * Tile_Size * texel_bytes, 0);
+
+	for (uint32_t y = 0; y < h; ++y) {
+		for (uint32_t x = 0; x < w; ++x) {
+			encode(image.at(x, y), data.data() + offset(x, y));
+		}
+	}
+}
+
+size_t Tiled_Image::offset(uint32_t x, uint32_t y) const {
+	size_t tile = size_t(y / Tile_Size) * tiles_x + (x / Tile_Size);
+	uint32_t morton = Spread3[x % Tile_Size] | (Spread3[y % Tile_Size] << 1);
+	return (tile * (Tile_Size * Tile_Size) + morton) * texel_bytes;
+}
+
+void Tiled_Image::encode(Spectrum value, uint8_t *texel) const {
+	if (format == Format::Float) {
+		float f[3] = {value.r, value.g, value.b};
+		std::memcpy(texel, f, sizeof(f));
+	} else if (format == Format::Half) {
+		uint16_t f[3] = {float_to_half(value.r), float_to_half(value.g), float_to_half(value.b)};
+		std::memcpy(texel, f, sizeof(f));
+	} else { assert(format == Format::RGB9E5);
+		uint32_t packed = float3_to_rgb9e5(value);
+		std::memcpy(texel, &packed, sizeof(packed));
+	}
+}
+
+Spectrum Tiled_Image::decode(uint8_t const *texel) const {
+	if (format == Format::Float) {
+		float f[3];
+		std::memcpy(f, texel, sizeof(f));
+		return Spectrum(f[0], f[1], f[2]);
+	} else if (format == Format::Half) {
+		uint16_t f[3];
+		std::memcpy(f, texel, sizeof(f));
+		return Spectrum(half_to_float(f[0]), half_to_float(f[1]), half_to_float(f[2]));
+	} else { assert(format == Format::RGB9E5);
+		uint32_t packed;
+		std::memcpy(&packed, texel, sizeof(packed));
+		return rgb9e5_to_float3(packed);
+	}
+}
+
+Spectrum Tiled_Image::at(uint32_t x, uint32_t y) const {
+	assert(x < w && y < h);
+	return decode(data.data() + offset(x, y));
+}
+
+Spectrum Tiled_Image::sample_nearest(Vec2 uv) const {
+	if (w == 0 || h == 0) return Spectrum();
+
+	//the texel with the nearest center is the texel that contains (x,y):
+	uint32_t ix = std::min(uint32_t(w * std::clamp(uv.x, 0.0f, 1.0f)), w - 1);
+	uint32_t iy = std::min(uint32_t(h * std::clamp(uv.y, 0.0f, 1.0f)), h - 1);
+	return at(ix, iy);
+}
+
+Spectrum Tiled_Image::sample_bilinear(Vec2 uv) const {
+	if (w == 0 || h == 0) return Spectrum();
+
+	//position relative to texel centers:
+	float x = w * std::clamp(uv.x, 0.0f, 1.0f) - 0.5f;
+	float y = h * std::clamp(uv.y, 0.0f, 1.0f) - 0.5f;
+	float fx = std::floor(x), fy = std::floor(y);
+	float tx = x - fx, ty = y - fy;
+
+	//footprint, clamped to the border:
+	uint32_t x0 = uint32_t(std::clamp(int32_t(fx), 0, int32_t(w) - 1));
+	uint32_t x1 = uint32_t(std::clamp(int32_t(fx) + 1, 0, int32_t(w) - 1));
+	uint32_t y0 = uint32_t(std::clamp(int32_t(fy), 0, int32_t(h) - 1));
+	uint32_t y1 = uint32_t(std::clamp(int32_t(fy) + 1, 0, int32_t(h) - 1));
+
+	uint8_t const *base = data.data();
+	Spectrum s00 = decode(base + offset(x0, y0));
+	Spectrum s10 = decode(base + offset(x1, y0));
+	Spectrum s01 = decode(base + offset(x0, y1));
+	Spectrum s11 = decode(base + offset(x1, y1));
+	return lerp(lerp(s00, s10, tx), lerp(s01, s11, tx), ty);
+}
+
+const char *Tiled_Image::format_name(Format format) {
+	switch (format) {
+		case Format::Float: return "float";
+		case Format::Half: return "half";
+		case Format::RGB9E5: return "rgb9e5";
+	}
+	return "?";
+}
+
+Tiled_Image::Format Tiled_Image::parse_format(std::string const &name) {
+	for (Format format : {Format::Float, Format::Half, Format::RGB9E5}) {
+		if (name == format_name(format)) return format;
+	}
+	throw std::runtime_error("Unknown texture format '" + name + "' (expecting float, half, or rgb9e5).");
+}
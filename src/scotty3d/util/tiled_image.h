@@ -0,0 +1,62 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "../lib/mathlib.h"
+#include "hdr_image.h"
+
+/*
+ *
+ * Tiled_Image is a read-only copy of an HDR_Image laid out for random-access sampling.
+ *
+ * Texels are stored in 8x8 tiles (row-major order of tiles); within a tile, texels are in Morton
+ * (Z-curve) order. So any 2x2 footprint that doesn't cross a tile edge lies within one tile
+ * (a few cache lines), and an even-aligned 2x2 quad is four consecutive texels.
+ *
+ * Texels can be stored compressed:
+ *  Float  -- 3 x 32-bit float (12 bytes, exact)
+ *  Half   -- 3 x 16-bit float (6 bytes)
+ *  RGB9E5 -- 9-bit mantissas with a shared 5-bit exponent (4 bytes; no negative values)
+ *
+ * The origin is located in the bottom left, as with HDR_Image.
+ *
+ */
+class Tiled_Image {
+public:
+	enum class Format : uint8_t { Float, Half, RGB9E5 };
+
+	Tiled_Image() = default;
+	Tiled_Image(HDR_Image const &image, Format format);
+
+	static constexpr uint32_t Tile_Size = 8;
+
+	//texel lookup (asserts that (x,y) is within the image):
+	Spectrum at(uint32_t x, uint32_t y) const;
+
+	//sample using the same conventions as Textures::sample_nearest and Textures::sample_bilinear:
+	// uv of [0,1]x[0,1] corresponds to [0,w]x[0,h], texel centers are at half-integers, uv is clamped to the border
+	Spectrum sample_nearest(Vec2 uv) const;
+	Spectrum sample_bilinear(Vec2 uv) const;
+
+	//size of the texel data:
+	size_t bytes() const {
+		return data.size();
+	}
+
+	uint32_t w = 0, h = 0;
+	Format format = Format::Float;
+
+	//name of a format ("float", "half", "rgb9e5") and back (throws on unknown names):
+	static const char *format_name(Format format);
+	static Format parse_format(std::string const &name);
+
+private:
+	uint32_t tiles_x = 0; //tiles per row
+	uint32_t texel_bytes = 0;
+	std::vector< uint8_t > data;
+
+	size_t offset(uint32_t x, uint32_t y) const;
+	Spectrum decode(uint8_t const *texel) const;
+	void encode(Spectrum value, uint8_t *texel) const;
+};